@@ -0,0 +1,217 @@
+/*
+ * atlas.c
+ *
+ * glyph atlas: where the bitmaps of the glyphs drawn recently are in the
+ * font texture, so glyphs are only rasterised when they are first drawn
+ *
+ * The texture is divided into shelves from the top down. A glyph goes on
+ * the lowest shelf it fits on which still has room, otherwise a new shelf
+ * as high as the glyph (rounded up to ATLAS_SHELF_STEP) is added below the
+ * others. Once there is no more room, the shelf used least recently (that
+ * is high enough) is emptied, its glyphs are rasterised again when they
+ * are drawn again. Every glyph has a pixel of space around it so the
+ * texture filter doesn't pick up its neighbours.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "atlas.h"
+
+#define ATLAS_SHELF_STEP 4 /* px */
+#define ATLAS_FIRST_TABLE 256
+
+static unsigned hash_codepoint(uint32_t codepoint, int table_size)
+{
+    return (codepoint * 2654435761u) & (table_size - 1);
+}
+
+void atlas_init(struct glyph_atlas *a, int width, int height)
+{
+    memset(a, 0, sizeof(*a));
+    a->width = width;
+    a->height = height;
+}
+
+void atlas_free(struct glyph_atlas *a)
+{
+    free(a->shelves);
+    free(a->glyphs);
+    free(a->table);
+    memset(a, 0, sizeof(*a));
+}
+
+struct atlas_glyph *atlas_find(const struct glyph_atlas *a, uint32_t codepoint)
+{
+    if (codepoint < 128)
+        return a->ascii[codepoint] ? &a->glyphs[a->ascii[codepoint] - 1] : NULL;
+
+    if (a->table_size == 0)
+        return NULL;
+
+    for (unsigned i = hash_codepoint(codepoint, a->table_size); a->table[i] != 0; i = (i + 1) & (a->table_size - 1))
+    {
+        struct atlas_glyph *g = &a->glyphs[a->table[i] - 1];
+        if (g->codepoint == codepoint)
+            return g;
+    }
+
+    return NULL;
+}
+
+static void insert_glyph(struct glyph_atlas *a, int index)
+{
+    if (a->glyphs[index].codepoint < 128)
+    {
+        a->ascii[a->glyphs[index].codepoint] = index + 1;
+        return;
+    }
+
+    unsigned i = hash_codepoint(a->glyphs[index].codepoint, a->table_size);
+
+    while (a->table[i] != 0)
+        i = (i + 1) & (a->table_size - 1);
+
+    a->table[i] = index + 1;
+}
+
+/* new glyph for codepoint (which isn't there yet), not in the atlas */
+struct atlas_glyph *atlas_add(struct glyph_atlas *a, uint32_t codepoint)
+{
+    if (a->n_glyphs == a->glyphs_allocated)
+    {
+        a->glyphs_allocated = a->glyphs_allocated ? 2 * a->glyphs_allocated : ATLAS_FIRST_TABLE / 2;
+        a->glyphs = realloc(a->glyphs, a->glyphs_allocated * sizeof(struct atlas_glyph));
+    }
+
+    /* at most half full */
+    if (2 * (a->n_glyphs + 1) > a->table_size)
+    {
+        free(a->table);
+        a->table_size = a->table_size ? 2 * a->table_size : ATLAS_FIRST_TABLE;
+        a->table = calloc(a->table_size, sizeof(int));
+
+        for (int i = 0; i < a->n_glyphs; i++)
+            insert_glyph(a, i);
+    }
+
+    struct atlas_glyph *g = &a->glyphs[a->n_glyphs];
+    memset(g, 0, sizeof(*g));
+    g->codepoint = codepoint;
+    g->shelf = -1;
+
+    insert_glyph(a, a->n_glyphs++);
+
+    return g;
+}
+
+/* remove the glyphs of shelf s from the atlas */
+static void empty_shelf(struct glyph_atlas *a, int s)
+{
+    for (int i = 0; i < a->n_glyphs; i++)
+    {
+        if (a->glyphs[i].shelf == s)
+            a->glyphs[i].shelf = -1;
+    }
+
+    a->shelves[s].used = 0;
+}
+
+static int add_shelf(struct glyph_atlas *a, int height)
+{
+    height = (height + ATLAS_SHELF_STEP - 1) / ATLAS_SHELF_STEP * ATLAS_SHELF_STEP;
+    if (a->shelves_height + height > a->height)
+        return -1;
+
+    a->shelves = realloc(a->shelves, (a->n_shelves + 1) * sizeof(struct atlas_shelf));
+
+    struct atlas_shelf *shelf = &a->shelves[a->n_shelves];
+    shelf->y = a->shelves_height;
+    shelf->height = height;
+    shelf->used = 0;
+    shelf->last_used = 0;
+
+    a->shelves_height += height;
+
+    return a->n_shelves++;
+}
+
+/* shelf with room for a width x height box, emptying one if needed; -1 if it can't fit */
+static int find_shelf(struct glyph_atlas *a, int width, int height)
+{
+    int best = -1;
+
+    for (int s = 0; s < a->n_shelves; s++)
+    {
+        const struct atlas_shelf *shelf = &a->shelves[s];
+
+        if ((shelf->height >= height) && (shelf->used + width <= a->width) &&
+                ((best < 0) || (shelf->height < a->shelves[best].height)))
+            best = s;
+    }
+
+    if (best >= 0)
+        return best;
+
+    best = add_shelf(a, height);
+    if (best >= 0)
+        return best;
+
+    /* full, the glyphs drawn least recently go */
+    for (int s = 0; s < a->n_shelves; s++)
+    {
+        if ((a->shelves[s].height >= height) && ((best < 0) || (a->shelves[s].last_used < a->shelves[best].last_used)))
+            best = s;
+    }
+
+    if (best < 0)
+    {
+        /* all shelves are too low for it, start over */
+        for (int i = 0; i < a->n_glyphs; i++)
+            a->glyphs[i].shelf = -1;
+
+        a->n_shelves = 0;
+        a->shelves_height = 0;
+
+        return add_shelf(a, height);
+    }
+
+    empty_shelf(a, best);
+
+    return best;
+}
+
+/**
+ * Find room for the bitmap of g (g->width x g->height) and set where it
+ * goes. Other glyphs may be removed from the atlas. Returns false if the
+ * bitmap is larger than the atlas.
+ */
+bool atlas_place(struct glyph_atlas *a, struct atlas_glyph *g)
+{
+    int width = g->width + 2 * ATLAS_PADDING;
+    int height = g->height + 2 * ATLAS_PADDING;
+
+    if ((width > a->width) || (height > a->height))
+        return false;
+
+    int s = find_shelf(a, width, height);
+    if (s < 0)
+        return false;
+
+    struct atlas_shelf *shelf = &a->shelves[s];
+
+    g->x = shelf->used + ATLAS_PADDING;
+    g->y = shelf->y + ATLAS_PADDING;
+    g->shelf = s;
+
+    shelf->used += width;
+    shelf->last_used = ++a->clock;
+
+    return true;
+}
+
+/* g (which is in the atlas) is drawn */
+void atlas_use(struct glyph_atlas *a, const struct atlas_glyph *g)
+{
+    a->shelves[g->shelf].last_used = ++a->clock;
+}
@@ -0,0 +1,61 @@
+#ifndef __ATLAS_H__
+#define __ATLAS_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ATLAS_PADDING 1 /* px of empty space around every bitmap */
+
+/* a glyph of a font, its bitmap is in the atlas unless shelf is -1 */
+struct atlas_glyph {
+    uint32_t codepoint;
+    bool missing; /* the font doesn't have it */
+    int width; /* of the bitmap */
+    int height;
+    int left;
+    int top;
+    int advance;
+    int x; /* of the bitmap in the atlas */
+    int y;
+    int shelf;
+};
+
+struct atlas_shelf {
+    int y;
+    int height;
+    int used; /* width taken from the left */
+    uint64_t last_used;
+};
+
+/*
+ * Texture area holding the bitmaps of the glyphs drawn recently. It is
+ * packed in shelves (rows of glyphs of about the same height), when it's
+ * full the shelf used least recently is emptied for new glyphs.
+ */
+struct glyph_atlas {
+    int width;
+    int height;
+    int shelves_height; /* taken from the top */
+    struct atlas_shelf *shelves;
+    int n_shelves;
+
+    struct atlas_glyph *glyphs; /* every glyph looked up, also the ones not in the atlas */
+    int n_glyphs;
+    int glyphs_allocated;
+    int *table; /* glyph index + 1 by codepoint, open addressing */
+    int table_size;
+    int ascii[128]; /* glyph index + 1 of the ASCII ones, without hashing */
+
+    uint64_t clock;
+};
+
+void atlas_init(struct glyph_atlas *a, int width, int height);
+void atlas_free(struct glyph_atlas *a);
+
+struct atlas_glyph *atlas_find(const struct glyph_atlas *a, uint32_t codepoint);
+struct atlas_glyph *atlas_add(struct glyph_atlas *a, uint32_t codepoint);
+
+bool atlas_place(struct glyph_atlas *a, struct atlas_glyph *g);
+void atlas_use(struct glyph_atlas *a, const struct atlas_glyph *g);
+
+#endif // __ATLAS_H__
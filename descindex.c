@@ -0,0 +1,303 @@
+/*
+ * descindex.c
+ *
+ * inverted index over the one-line page descriptions, used by the
+ * description search (like apropos)
+ *
+ * The descriptions are split into words (runs of letters and digits,
+ * lowercase). For each distinct word the index keeps the sorted list of
+ * descriptions containing it. Every word of a query is taken as the start
+ * of a word, so the descriptions matching a query are those found in the
+ * lists of the words beginning with each query word.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "descindex.h"
+
+#define MAX_WORD_LENGTH 64
+
+struct word_ref {
+    const char *word;
+    int32_t index;
+};
+
+static int is_word_char(unsigned char c)
+{
+    return ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) || ((c >= '0') && (c <= '9')) || (c >= 0x80);
+}
+
+static unsigned char fold(unsigned char c)
+{
+    return ((c >= 'A') && (c <= 'Z')) ? (c | 0x20) : c;
+}
+
+/* next word of *s into word (lowercase, cut to MAX_WORD_LENGTH), returns 0 at the end */
+static int next_word(const char **s, char *word)
+{
+    const char *p = *s;
+
+    while (*p && !is_word_char(*p))
+        p++;
+
+    if (*p == '\0')
+        return 0;
+
+    int len = 0;
+    while (is_word_char(*p))
+    {
+        if (len < MAX_WORD_LENGTH)
+            word[len++] = fold(*p);
+        p++;
+    }
+
+    word[len] = '\0';
+    *s = p;
+    return 1;
+}
+
+static int cmp_word_ref(const void *a, const void *b)
+{
+    const struct word_ref *wa = (const struct word_ref *)a;
+    const struct word_ref *wb = (const struct word_ref *)b;
+
+    int c = strcmp(wa->word, wb->word);
+    if (c != 0)
+        return c;
+
+    return (wa->index > wb->index) - (wa->index < wb->index);
+}
+
+/**
+ * Build the index over count descriptions, descs[i] may be NULL for
+ * a page without a description.
+ */
+struct desc_index *desc_index_build(const char * const *descs, int count)
+{
+    struct desc_index *d = calloc(1, sizeof(struct desc_index));
+    struct word_ref *refs = NULL;
+    char *words = NULL;
+
+    if (d == NULL)
+        return NULL;
+
+    /* all words of all descriptions, every one followed by its '\0' */
+    size_t n_refs = 0;
+    size_t words_size = 0;
+    for (int i = 0; i < count; i++)
+    {
+        const char *s = descs[i];
+        char word[MAX_WORD_LENGTH + 1];
+
+        while (s && next_word(&s, word))
+        {
+            n_refs++;
+            words_size += strlen(word) + 1;
+        }
+    }
+
+    d->n_strings = count;
+    d->lengths = malloc((count + 1) * sizeof(uint16_t));
+    refs = malloc((n_refs + 1) * sizeof(struct word_ref));
+    words = malloc(words_size + 1);
+
+    if ((d->lengths == NULL) || (refs == NULL) || (words == NULL))
+        goto fail;
+
+    size_t n = 0;
+    char *w = words;
+    for (int i = 0; i < count; i++)
+    {
+        const char *s = descs[i];
+        size_t len = s ? strlen(s) : 0;
+        d->lengths[i] = (len > UINT16_MAX) ? UINT16_MAX : len;
+
+        while (s && next_word(&s, w))
+        {
+            refs[n].word = w;
+            refs[n].index = i;
+            n++;
+            w += strlen(w) + 1;
+        }
+    }
+
+    qsort(refs, n_refs, sizeof(struct word_ref), &cmp_word_ref);
+
+    /* at most one word and one posting per reference */
+    d->words = malloc(words_size + 1);
+    d->word_offsets = malloc((n_refs + 1) * sizeof(uint32_t));
+    d->offsets = malloc((n_refs + 2) * sizeof(uint32_t));
+    d->postings = malloc((n_refs + 1) * sizeof(int32_t));
+
+    if ((d->words == NULL) || (d->word_offsets == NULL) || (d->offsets == NULL) || (d->postings == NULL))
+        goto fail;
+
+    size_t words_used = 0;
+    size_t n_postings = 0;
+    for (size_t i = 0; i < n_refs; i++)
+    {
+        if ((i == 0) || (strcmp(refs[i - 1].word, refs[i].word) != 0))
+        {
+            size_t len = strlen(refs[i].word);
+            memcpy(&d->words[words_used], refs[i].word, len + 1);
+            d->word_offsets[d->n_words] = words_used;
+            d->offsets[d->n_words] = n_postings;
+            d->n_words++;
+            words_used += len + 1;
+        }
+        else if (d->postings[n_postings - 1] == refs[i].index)
+        {
+            continue; /* word repeated within the description */
+        }
+
+        d->postings[n_postings++] = refs[i].index;
+    }
+
+    d->offsets[d->n_words] = n_postings;
+
+    free(refs);
+    free(words);
+
+    return d;
+
+fail:
+    free(refs);
+    free(words);
+    desc_index_free(d);
+    return NULL;
+}
+
+void desc_index_free(struct desc_index *d)
+{
+    if (d == NULL)
+        return;
+
+    free(d->words);
+    free(d->word_offsets);
+    free(d->offsets);
+    free(d->postings);
+    free(d->lengths);
+    free(d);
+}
+
+static const char *word_at(const struct desc_index *d, int i)
+{
+    return &d->words[d->word_offsets[i]];
+}
+
+/* first word which is not less than word */
+static int lower_bound_word(const struct desc_index *d, const char *word)
+{
+    int lo = 0;
+    int hi = d->n_words;
+
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (strcmp(word_at(d, mid), word) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/**
+ * Find the descriptions containing words beginning with every word of
+ * the query. Matches (ascending string indices) and their goodness, which
+ * prefers whole word matches and short descriptions, are returned in
+ * arrays allocated with malloc.
+ *
+ * Returns the number of matches, or -1 if the query has no words.
+ */
+int desc_index_query(const struct desc_index *d, const char *query, int32_t **matches_out, int32_t **goodness_out)
+{
+    *matches_out = NULL;
+    *goodness_out = NULL;
+
+    /* number of query words found in each description so far */
+    uint8_t *found = calloc(d->n_strings + 1, 1);
+    if (found == NULL)
+        return -1;
+
+    int n_query_words = 0;
+    const char *s = query;
+    char word[MAX_WORD_LENGTH + 1];
+
+    while (next_word(&s, word) && (n_query_words < UINT8_MAX))
+    {
+        size_t len = strlen(word);
+
+        for (int i = lower_bound_word(d, word); (i < d->n_words) && (strncmp(word_at(d, i), word, len) == 0); i++)
+        {
+            /* only descriptions which had all previous words, once per query word */
+            for (uint32_t k = d->offsets[i]; k < d->offsets[i + 1]; k++)
+            {
+                int32_t index = d->postings[k];
+                if (found[index] == n_query_words)
+                    found[index]++;
+            }
+        }
+
+        n_query_words++;
+    }
+
+    if (n_query_words == 0)
+    {
+        free(found);
+        return -1;
+    }
+
+    int n_matches = 0;
+    for (int i = 0; i < d->n_strings; i++)
+    {
+        if (found[i] == n_query_words)
+            n_matches++;
+    }
+
+    int32_t *matches = malloc((n_matches + 1) * sizeof(int32_t));
+    int32_t *goodness = calloc(n_matches + 1, sizeof(int32_t));
+
+    if ((matches == NULL) || (goodness == NULL))
+    {
+        free(found);
+        free(matches);
+        free(goodness);
+        return -1;
+    }
+
+    n_matches = 0;
+    for (int i = 0; i < d->n_strings; i++)
+    {
+        if (found[i] == n_query_words)
+        {
+            matches[n_matches] = i;
+            goodness[n_matches] = -(int32_t)d->lengths[i];
+            n_matches++;
+        }
+    }
+
+    /* query words which are whole words of the description rank higher */
+    memset(found, 0, d->n_strings);
+    s = query;
+    for (int q = 0; (q < n_query_words) && next_word(&s, word); q++)
+    {
+        int i = lower_bound_word(d, word);
+        if ((i < d->n_words) && (strcmp(word_at(d, i), word) == 0))
+        {
+            for (uint32_t k = d->offsets[i]; k < d->offsets[i + 1]; k++)
+                found[d->postings[k]]++;
+        }
+    }
+
+    for (int k = 0; k < n_matches; k++)
+        goodness[k] += found[matches[k]] * 65536;
+
+    free(found);
+
+    *matches_out = matches;
+    *goodness_out = goodness;
+    return n_matches;
+}
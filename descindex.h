@@ -0,0 +1,22 @@
+#ifndef __DESCINDEX_H__
+#define __DESCINDEX_H__
+
+#include <stdint.h>
+
+/* posting lists of all words occurring in a list of descriptions */
+struct desc_index {
+    char *words; /* sorted, each one terminated by '\0' */
+    uint32_t *word_offsets; /* word i starts at words[word_offsets[i]] */
+    uint32_t *offsets; /* postings of word i are postings[offsets[i]] .. postings[offsets[i + 1] - 1] */
+    int32_t *postings; /* string indices, ascending within a list */
+    uint16_t *lengths; /* length of each description */
+    int n_words;
+    int n_strings;
+};
+
+struct desc_index *desc_index_build(const char * const *descs, int count);
+void desc_index_free(struct desc_index *d);
+
+int desc_index_query(const struct desc_index *d, const char *query, int32_t **matches_out, int32_t **goodness_out);
+
+#endif // __DESCINDEX_H__
@@ -0,0 +1,407 @@
+/*
+ * doccache.c
+ *
+ * formatted pages stored in the cache directory, so opening a big page
+ * again maps the formatted text instead of parsing and formatting it
+ *
+ * A file holds one page at one line length: where each line starts in
+ * the cells and the cells of all lines (see document.h), which the viewer
+ * uses right from the mapping. The file is named after a hash of the source
+ * path and the line length and is only used if the stored path,
+ * modification time and size of the source still match.
+ *
+ * Using a stored page sets the modification time of its file. When the
+ * files take more than DOC_CACHE_MAX_SIZE after one is written, the ones
+ * used least recently are removed.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "manindex.h"
+#include "doccache.h"
+
+#ifdef __APPLE__
+#define st_mtim st_mtimespec
+#endif
+
+#define DOC_CACHE_MAGIC "MANGLDOC"
+#define DOC_CACHE_VERSION 4
+
+#define DOC_CACHE_MAX_SIZE (256 << 20) /* bytes */
+#define DOC_CACHE_PRUNED_SIZE (DOC_CACHE_MAX_SIZE / 4 * 3) /* left after pruning, so it isn't done for every page */
+
+struct doc_cache_header {
+    char magic[8];
+    uint32_t version;
+    int32_t line_length;
+    int64_t sec; /* modification time of the source */
+    int64_t nsec;
+    int64_t size; /* of the source */
+    uint32_t n_lines;
+    uint32_t path_size; /* with '\0', padded to 8 bytes in the file */
+    uint64_t n_cells;
+};
+
+#define PADDED_PATH_SIZE(h) (((h)->path_size + 7) & ~7u)
+
+static const char *get_path(const struct doc_cache *dc)
+{
+    return (const char *)dc->map + sizeof(struct doc_cache_header);
+}
+
+static const uint32_t *get_lines(const struct doc_cache *dc)
+{
+    const struct doc_cache_header *h = dc->map;
+    return (const uint32_t *)(get_path(dc) + PADDED_PATH_SIZE(h));
+}
+
+static const cell_t *get_cells(const struct doc_cache *dc)
+{
+    const struct doc_cache_header *h = dc->map;
+    return (const cell_t *)(get_lines(dc) + h->n_lines + 1);
+}
+
+/* FNV-1a */
+static uint64_t hash_path(const char *path)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (const unsigned char *p = (const unsigned char *)path; *p; p++)
+    {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+/**
+ * Modification time and size of filename, taken before it's read so a
+ * change while it's formatted makes the stored page stale.
+ * Returns 0 on success, -1 (with src zeroed) if it can't be found.
+ */
+int doc_cache_stat(const char *filename, struct doc_source *src)
+{
+    memset(src, 0, sizeof(*src));
+
+    struct stat sb;
+    if (stat(filename, &sb) != 0)
+        return -1;
+
+    src->sec = sb.st_mtim.tv_sec;
+    src->nsec = sb.st_mtim.tv_nsec;
+    src->size = sb.st_size;
+    return 0;
+}
+
+/* directory of the stored pages, created if necessary */
+static int doc_cache_dir(char *out, size_t out_len)
+{
+    if (manindex_cache_filename("pages", out, out_len) != 0)
+        return -1;
+
+    if ((mkdir(out, 0755) != 0) && (errno != EEXIST))
+        return -1;
+
+    return 0;
+}
+
+/* path of the cache file of a page, creating the directory if necessary */
+static int doc_cache_filename(const char *filename, int line_length, char *out, size_t out_len)
+{
+    char dir[1024];
+
+    if (doc_cache_dir(dir, sizeof(dir)) != 0)
+        return -1;
+
+    if (snprintf(out, out_len, "%s/%016llx-%d", dir, (unsigned long long)hash_path(filename), line_length) >= out_len)
+        return -1;
+
+    return 0;
+}
+
+static int validate(const struct doc_cache *dc, const struct doc_cache_header *key, const char *filename)
+{
+    const struct doc_cache_header *h = dc->map;
+
+    if (dc->map_size < sizeof(*h))
+        return -1;
+
+    if ((memcmp(h->magic, DOC_CACHE_MAGIC, sizeof(h->magic)) != 0) || (h->version != DOC_CACHE_VERSION))
+        return -1;
+
+    /* the page it was made from */
+    if ((h->line_length != key->line_length) || (h->sec != key->sec) || (h->nsec != key->nsec) || (h->size != key->size))
+        return -1;
+
+    uint64_t expected = sizeof(*h) + PADDED_PATH_SIZE(h) + ((uint64_t)h->n_lines + 1) * sizeof(uint32_t) +
+        h->n_cells * sizeof(cell_t);
+
+    if ((expected != dc->map_size) || (h->path_size != strlen(filename) + 1) || (strcmp(get_path(dc), filename) != 0))
+        return -1;
+
+    const uint32_t *lines = get_lines(dc);
+    for (uint32_t i = 0; i < h->n_lines; i++)
+    {
+        if ((lines[i] > lines[i + 1]) || (lines[i + 1] > h->n_cells))
+            return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Map the stored page of filename formatted at line_length, src is set to
+ * the source it was made from. Returns 0 on success, -1 if there is none
+ * or the source has changed.
+ */
+int doc_cache_open(const char *filename, int line_length, struct doc_cache *dc, struct doc_source *src)
+{
+    memset(dc, 0, sizeof(*dc));
+
+    char cache_filename[1024];
+    if ((doc_cache_stat(filename, src) != 0) || (doc_cache_filename(filename, line_length, cache_filename, sizeof(cache_filename)) != 0))
+        return -1;
+
+    struct doc_cache_header key;
+    key.line_length = line_length;
+    key.sec = src->sec;
+    key.nsec = src->nsec;
+    key.size = src->size;
+
+    int fd = open(cache_filename, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+
+    struct stat sb;
+    if ((fstat(fd, &sb) != 0) || (sb.st_size < (off_t)sizeof(struct doc_cache_header)))
+    {
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED)
+        return -1;
+
+    dc->map = map;
+    dc->map_size = sb.st_size;
+
+    if (validate(dc, &key, filename) != 0)
+    {
+        doc_cache_close(dc);
+        return -1;
+    }
+
+    /* used now, pruning removes it last */
+    utimensat(AT_FDCWD, cache_filename, NULL, 0);
+
+    return 0;
+}
+
+void doc_cache_close(struct doc_cache *dc)
+{
+    if (dc->map)
+        munmap(dc->map, dc->map_size);
+
+    memset(dc, 0, sizeof(*dc));
+}
+
+int doc_cache_n_lines(const struct doc_cache *dc)
+{
+    return ((const struct doc_cache_header *)dc->map)->n_lines;
+}
+
+/* line i, its cells are in the mapping */
+struct doc_line doc_cache_line(const struct doc_cache *dc, int i)
+{
+    const uint32_t *lines = get_lines(dc);
+    struct doc_line line = { get_cells(dc) + lines[i], lines[i + 1] - lines[i] };
+
+    return line;
+}
+
+static int write_all(int fd, const void *data, size_t size)
+{
+    const char *ptr = data;
+
+    while (size > 0)
+    {
+        ssize_t written = write(fd, ptr, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        ptr += written;
+        size -= written;
+    }
+
+    return 0;
+}
+
+struct stored_file {
+    char *name;
+    int64_t sec; /* last use */
+    int64_t nsec;
+    int64_t size;
+};
+
+static int cmp_stored_file(const void *a, const void *b)
+{
+    const struct stored_file *fa = a;
+    const struct stored_file *fb = b;
+
+    if (fa->sec != fb->sec)
+        return (fa->sec < fb->sec) ? -1 : 1;
+    if (fa->nsec != fb->nsec)
+        return (fa->nsec < fb->nsec) ? -1 : 1;
+    return 0;
+}
+
+/* remove the files used least recently if all of them take more than DOC_CACHE_MAX_SIZE */
+static void prune(void)
+{
+    char dir[1024];
+    if (doc_cache_dir(dir, sizeof(dir)) != 0)
+        return;
+
+    DIR *d = opendir(dir);
+    if (d == NULL)
+        return;
+
+    struct stored_file *files = NULL;
+    size_t n_files = 0;
+    size_t files_allocated = 0;
+    int64_t total = 0;
+
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL)
+    {
+        if (de->d_name[0] == '.')
+            continue;
+
+        char path[1400];
+        snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+
+        struct stat sb;
+        if ((stat(path, &sb) != 0) || !S_ISREG(sb.st_mode))
+            continue;
+
+        if (n_files == files_allocated)
+        {
+            files_allocated = files_allocated ? 2 * files_allocated : 64;
+            struct stored_file *tmp = realloc(files, files_allocated * sizeof(struct stored_file));
+            if (tmp == NULL)
+                break;
+            files = tmp;
+        }
+
+        struct stored_file f = { strdup(de->d_name), sb.st_mtim.tv_sec, sb.st_mtim.tv_nsec, sb.st_size };
+        files[n_files++] = f;
+        total += sb.st_size;
+    }
+
+    closedir(d);
+
+    if (total > DOC_CACHE_MAX_SIZE)
+    {
+        qsort(files, n_files, sizeof(struct stored_file), &cmp_stored_file);
+
+        for (size_t i = 0; (i < n_files) && (total > DOC_CACHE_PRUNED_SIZE); i++)
+        {
+            char path[1400];
+            snprintf(path, sizeof(path), "%s/%s", dir, files[i].name);
+
+            if ((unlink(path) == 0) || (errno == ENOENT))
+                total -= files[i].size;
+        }
+    }
+
+    for (size_t i = 0; i < n_files; i++)
+        free(files[i].name);
+
+    free(files);
+}
+
+/* store the lines of a page formatted at line_length from src (see doc_cache_stat()) */
+int doc_cache_write(const char *filename, const struct doc_source *src, int line_length, const struct doc_line *lines, int n_lines)
+{
+    struct doc_cache_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, DOC_CACHE_MAGIC, sizeof(h.magic));
+    h.version = DOC_CACHE_VERSION;
+    h.line_length = line_length;
+    h.sec = src->sec;
+    h.nsec = src->nsec;
+    h.size = src->size;
+    h.n_lines = n_lines;
+    h.path_size = strlen(filename) + 1;
+
+    char cache_filename[1024];
+    if (((src->sec == 0) && (src->nsec == 0)) || (doc_cache_filename(filename, line_length, cache_filename, sizeof(cache_filename)) != 0))
+        return -1;
+
+    /* where the lines start, then all cells in one piece */
+    uint32_t *starts = malloc((n_lines + 1) * sizeof(uint32_t));
+    for (int i = 0; i < n_lines; i++)
+    {
+        starts[i] = h.n_cells;
+        h.n_cells += lines[i].length;
+    }
+    starts[n_lines] = h.n_cells;
+
+    cell_t *cells = malloc(h.n_cells * sizeof(cell_t) + 1);
+    for (int i = 0; i < n_lines; i++)
+        memcpy(cells + starts[i], lines[i].cells, lines[i].length * sizeof(cell_t));
+
+    /* pages are stored from several threads and processes */
+    char tmp_filename[1100];
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.XXXXXX", cache_filename);
+
+    int fd = mkstemp(tmp_filename);
+    if (fd == -1)
+    {
+        free(starts);
+        free(cells);
+        return -1;
+    }
+
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    fchmod(fd, 0644);
+
+    static const char padding[8];
+
+    int failed = (write_all(fd, &h, sizeof(h)) != 0) ||
+        (write_all(fd, filename, h.path_size) != 0) ||
+        (write_all(fd, padding, PADDED_PATH_SIZE(&h) - h.path_size) != 0) ||
+        (write_all(fd, starts, (n_lines + 1) * sizeof(uint32_t)) != 0) ||
+        (write_all(fd, cells, h.n_cells * sizeof(cell_t)) != 0);
+
+    close(fd);
+    free(starts);
+    free(cells);
+
+    if (failed || (rename(tmp_filename, cache_filename) != 0))
+    {
+        unlink(tmp_filename);
+        return -1;
+    }
+
+    prune();
+
+    return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef __DOCCACHE_H__
+#define __DOCCACHE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "document.h"
+
+/* mapped formatted page */
+struct doc_cache {
+    void *map;
+    size_t map_size;
+};
+
+/* the file a page is formatted from, a stored page is only used while it's the same */
+struct doc_source {
+    int64_t sec; /* modification time */
+    int64_t nsec;
+    int64_t size;
+};
+
+int doc_cache_stat(const char *filename, struct doc_source *src);
+
+int doc_cache_open(const char *filename, int line_length, struct doc_cache *dc, struct doc_source *src);
+void doc_cache_close(struct doc_cache *dc);
+
+int doc_cache_n_lines(const struct doc_cache *dc);
+struct doc_line doc_cache_line(const struct doc_cache *dc, int i);
+
+int doc_cache_write(const char *filename, const struct doc_source *src, int line_length, const struct doc_line *lines, int n_lines);
+
+#endif // __DOCCACHE_H__
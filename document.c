@@ -0,0 +1,145 @@
+/*
+ * document.c
+ *
+ * text of a formatted page, a line is an array of cells (code point and
+ * attributes) instead of text with the overstrike sequences of a terminal
+ *
+ * The cells are appended to blocks growing from DOC_FIRST_BLOCK up to
+ * DOC_MAX_BLOCK cells. A line is always within one block, the line being
+ * added moves to a new block when the current one is full. The blocks are
+ * only freed with the document, so finished lines can be given to another
+ * document while more lines are added.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "document.h"
+
+#define DOC_FIRST_BLOCK 4096 /* cells */
+#define DOC_MAX_BLOCK 65536
+#define DOC_FIRST_LINES 256
+
+struct doc_block {
+    struct doc_block *next;
+    size_t size; /* cells */
+    size_t used;
+    cell_t cells[];
+};
+
+static void reserve_lines(struct document *d, int n_lines)
+{
+    if (n_lines <= d->lines_allocated)
+        return;
+
+    int new_n_lines = (d->lines_allocated > 0) ? d->lines_allocated : DOC_FIRST_LINES;
+    while (new_n_lines < n_lines)
+        new_n_lines *= 2;
+
+    d->lines = realloc(d->lines, new_n_lines * sizeof(struct doc_line));
+    d->lines_allocated = new_n_lines;
+}
+
+/* start a new line, the cells added go there */
+void doc_add_line(struct document *d)
+{
+    reserve_lines(d, d->n_lines + 1);
+
+    struct doc_line *line = &d->lines[d->n_lines++];
+    line->cells = d->blocks ? &d->blocks->cells[d->blocks->used] : NULL;
+    line->length = 0;
+}
+
+void doc_add_cell(struct document *d, cell_t cell)
+{
+    struct doc_line *line = &d->lines[d->n_lines - 1];
+    struct doc_block *b = d->blocks;
+
+    if ((b == NULL) || (b->used == b->size))
+    {
+        size_t size = b ? b->size * 2 : DOC_FIRST_BLOCK;
+        if (size > DOC_MAX_BLOCK)
+            size = DOC_MAX_BLOCK;
+        if (size < 2 * (line->length + 1))
+            size = 2 * (line->length + 1);
+
+        /* the line moves over */
+        struct doc_block *new_block = malloc(sizeof(struct doc_block) + size * sizeof(cell_t));
+        new_block->next = b;
+        new_block->size = size;
+        new_block->used = line->length;
+        if (line->length > 0)
+            memcpy(new_block->cells, line->cells, line->length * sizeof(cell_t));
+
+        if (b)
+            b->used -= line->length;
+
+        d->blocks = b = new_block;
+        line->cells = b->cells;
+    }
+
+    b->cells[b->used++] = cell;
+    line->length++;
+}
+
+/* cells of the line being added, they may be changed */
+cell_t *doc_last_line(struct document *d, int *length)
+{
+    struct doc_line *line = &d->lines[d->n_lines - 1];
+
+    *length = line->length;
+    return (cell_t *)line->cells;
+}
+
+/* keep only the first length cells of the line being added */
+void doc_truncate_last_line(struct document *d, int length)
+{
+    struct doc_line *line = &d->lines[d->n_lines - 1];
+
+    if (length < line->length)
+    {
+        d->blocks->used -= line->length - length;
+        line->length = length;
+    }
+}
+
+void doc_remove_last_line(struct document *d)
+{
+    doc_truncate_last_line(d, 0);
+    d->n_lines--;
+}
+
+/* add lines of another document, they stay in its blocks */
+void doc_add_lines(struct document *d, const struct doc_line *lines, int n_lines)
+{
+    reserve_lines(d, d->n_lines + n_lines);
+
+    memcpy(&d->lines[d->n_lines], lines, n_lines * sizeof(struct doc_line));
+    d->n_lines += n_lines;
+}
+
+/* memory used by d */
+size_t doc_size(const struct document *d)
+{
+    size_t size = d->lines_allocated * sizeof(struct doc_line);
+
+    for (const struct doc_block *b = d->blocks; b; b = b->next)
+        size += sizeof(struct doc_block) + b->size * sizeof(cell_t);
+
+    return size;
+}
+
+void doc_free(struct document *d)
+{
+    struct doc_block *b = d->blocks;
+
+    while (b)
+    {
+        struct doc_block *next = b->next;
+        free(b);
+        b = next;
+    }
+
+    free(d->lines);
+    memset(d, 0, sizeof(*d));
+}
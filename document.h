@@ -0,0 +1,49 @@
+#ifndef __DOCUMENT_H__
+#define __DOCUMENT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* a character of a formatted page: its code point and CELL_* attributes */
+typedef uint32_t cell_t;
+
+#define CELL_BOLD 0x01
+#define CELL_ITALIC 0x02 /* underlined by the formatter */
+#define CELL_DIM 0x04 /* other overstrikes */
+
+#define MAKE_CELL(c, attr) ((cell_t)(c) | ((cell_t)(attr) << 24))
+#define CELL_CHAR(cell) ((cell) & 0xffffff)
+#define CELL_ATTR(cell) ((cell) >> 24)
+
+struct doc_line {
+    const cell_t *cells;
+    uint32_t length;
+};
+
+struct doc_block;
+
+/*
+ * Text of a formatted page. The cells of its lines are in blocks which
+ * don't move, so lines given to another document stay valid while more
+ * are added. A document without blocks only refers to the cells of
+ * another one or to a mapped file.
+ */
+struct document {
+    struct doc_line *lines;
+    int n_lines;
+    int lines_allocated;
+    struct doc_block *blocks; /* the newest one first */
+};
+
+void doc_add_line(struct document *d);
+void doc_add_cell(struct document *d, cell_t cell);
+cell_t *doc_last_line(struct document *d, int *length);
+void doc_truncate_last_line(struct document *d, int length);
+
+void doc_add_lines(struct document *d, const struct doc_line *lines, int n_lines);
+void doc_remove_last_line(struct document *d);
+
+size_t doc_size(const struct document *d);
+void doc_free(struct document *d);
+
+#endif // __DOCUMENT_H__
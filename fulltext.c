@@ -0,0 +1,1099 @@
+/*
+ * fulltext.c
+ *
+ * full-text index of the formatted text of all man pages, stored in the
+ * cache directory and mapped into memory
+ *
+ * The text of every page is split into words (letters, digits and '_',
+ * lowercase) numbered from the start of the page. For every distinct word
+ * the index keeps the pages containing it with the numbers (positions) of
+ * all its occurrences. The lists are delta encoded and written as varints
+ * (seven bits per byte, the high bit set on all but the last byte):
+ *
+ *     for every page:  page - previous page, number of positions,
+ *                      first position, position - previous position, ...
+ *
+ * The positions find phrases (consecutive words). The page text itself is
+ * stored zlib compressed, so the line of a hit can be shown and found
+ * again in the viewer.
+ *
+ * Pages are identified by file name and modification time, so an update
+ * only has to format the pages which changed and copies the rest.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <math.h>
+#include <zlib.h>
+
+#include "hashmap.h"
+#include "fulltext.h"
+
+#define FULLTEXT_MAGIC "MANGLFTX"
+#define FULLTEXT_VERSION 1
+
+#define MAX_WORD_LENGTH 64
+#define MAX_QUERY_WORDS 8
+#define MAX_PREFIX_TERMS 64 /* the last query word is a prefix as long as it doesn't match more words */
+
+struct fulltext_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t n_docs;
+    uint32_t n_terms;
+    uint32_t reserved;
+    uint64_t strings_size;
+    uint64_t blob_size;
+};
+
+struct fulltext_doc {
+    uint32_t file; /* in strings */
+    uint32_t n_words;
+    int64_t sec; /* modification time of the file */
+    int64_t nsec;
+    uint64_t text; /* in blob */
+    uint32_t text_size; /* compressed */
+    uint32_t text_raw_size;
+};
+
+struct fulltext_term {
+    uint32_t word; /* in strings */
+    uint32_t n_docs;
+    uint64_t postings; /* in blob */
+    uint64_t postings_size;
+};
+
+/* growing byte array */
+struct bytes {
+    uint8_t *data;
+    size_t size;
+    size_t allocated;
+};
+
+static int bytes_reserve(struct bytes *b, size_t size)
+{
+    if ((b->size + size) <= b->allocated)
+        return 0;
+
+    size_t new_size = b->allocated ? b->allocated * 2 : 64;
+    while (new_size < (b->size + size))
+        new_size *= 2;
+
+    uint8_t *new_data = realloc(b->data, new_size);
+    if (new_data == NULL)
+        return -1;
+
+    b->data = new_data;
+    b->allocated = new_size;
+    return 0;
+}
+
+static int bytes_append(struct bytes *b, const void *data, size_t size)
+{
+    if (bytes_reserve(b, size) != 0)
+        return -1;
+
+    memcpy(&b->data[b->size], data, size);
+    b->size += size;
+    return 0;
+}
+
+static int put_varint(struct bytes *b, uint32_t value)
+{
+    if (bytes_reserve(b, 5) != 0)
+        return -1;
+
+    while (value >= 0x80)
+    {
+        b->data[b->size++] = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+
+    b->data[b->size++] = value;
+    return 0;
+}
+
+/* returns NULL if the varint doesn't end before end */
+static const uint8_t *get_varint(const uint8_t *p, const uint8_t *end, uint32_t *value)
+{
+    uint32_t v = 0;
+
+    for (int shift = 0; (p < end) && (shift < 35); shift += 7)
+    {
+        uint8_t byte = *p++;
+        v |= (uint32_t)(byte & 0x7f) << shift;
+
+        if ((byte & 0x80) == 0)
+        {
+            *value = v;
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+static int is_word_char(unsigned char c)
+{
+    return ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) || ((c >= '0') && (c <= '9')) ||
+        (c == '_') || (c >= 0x80);
+}
+
+/**
+ * Next word of the text starting at *s: lowercase copy (cut to
+ * MAX_WORD_LENGTH) in word, the start of the word in the text in *start.
+ * Returns 0 at the end of the text.
+ */
+static int next_word(const char **s, char *word, const char **start)
+{
+    const char *p = *s;
+
+    while (*p && !is_word_char(*p))
+        p++;
+
+    if (*p == '\0')
+        return 0;
+
+    if (start)
+        *start = p;
+
+    int len = 0;
+    while (is_word_char(*p))
+    {
+        if (len < MAX_WORD_LENGTH)
+            word[len++] = ((*p >= 'A') && (*p <= 'Z')) ? (*p | 0x20) : *p;
+        p++;
+    }
+
+    word[len] = '\0';
+    *s = p;
+    return 1;
+}
+
+/* reading */
+
+static const struct fulltext_header *get_header(const struct fulltext *ft)
+{
+    return (const struct fulltext_header *)ft->map;
+}
+
+static const struct fulltext_doc *get_docs(const struct fulltext *ft)
+{
+    return (const struct fulltext_doc *)((const char *)ft->map + sizeof(struct fulltext_header));
+}
+
+static const struct fulltext_term *get_terms(const struct fulltext *ft)
+{
+    return (const struct fulltext_term *)(get_docs(ft) + get_header(ft)->n_docs);
+}
+
+static const char *get_strings(const struct fulltext *ft)
+{
+    return (const char *)(get_terms(ft) + get_header(ft)->n_terms);
+}
+
+static const uint8_t *get_blob(const struct fulltext *ft)
+{
+    return (const uint8_t *)(get_strings(ft) + get_header(ft)->strings_size);
+}
+
+static int validate(const struct fulltext *ft)
+{
+    const struct fulltext_header *h = get_header(ft);
+
+    if (ft->map_size < sizeof(*h))
+        return -1;
+
+    if ((memcmp(h->magic, FULLTEXT_MAGIC, sizeof(h->magic)) != 0) || (h->version != FULLTEXT_VERSION))
+        return -1;
+
+    uint64_t expected = sizeof(*h) + (uint64_t)h->n_docs * sizeof(struct fulltext_doc) +
+        (uint64_t)h->n_terms * sizeof(struct fulltext_term) + h->strings_size + h->blob_size;
+
+    if ((expected != ft->map_size) || (h->strings_size == 0))
+        return -1;
+
+    const char *strings = get_strings(ft);
+    if (strings[h->strings_size - 1] != '\0')
+        return -1;
+
+    const struct fulltext_doc *docs = get_docs(ft);
+    for (uint32_t i = 0; i < h->n_docs; i++)
+    {
+        if ((docs[i].file >= h->strings_size) || (docs[i].text + docs[i].text_size > h->blob_size))
+            return -1;
+    }
+
+    const struct fulltext_term *terms = get_terms(ft);
+    for (uint32_t i = 0; i < h->n_terms; i++)
+    {
+        if ((terms[i].word >= h->strings_size) || (terms[i].postings + terms[i].postings_size > h->blob_size))
+            return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Map the index file. Returns 0 on success, -1 if it is missing or broken.
+ */
+int fulltext_open(const char *filename, struct fulltext *ft)
+{
+    memset(ft, 0, sizeof(*ft));
+
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+
+    struct stat sb;
+    if ((fstat(fd, &sb) != 0) || (sb.st_size < (off_t)sizeof(struct fulltext_header)))
+    {
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED)
+        return -1;
+
+    ft->map = map;
+    ft->map_size = sb.st_size;
+
+    if (validate(ft) != 0)
+    {
+        fulltext_close(ft);
+        return -1;
+    }
+
+    return 0;
+}
+
+void fulltext_close(struct fulltext *ft)
+{
+    if (ft->map)
+        munmap(ft->map, ft->map_size);
+
+    memset(ft, 0, sizeof(*ft));
+}
+
+int fulltext_doc_count(const struct fulltext *ft)
+{
+    return ft->map ? get_header(ft)->n_docs : 0;
+}
+
+const char *fulltext_doc_file(const struct fulltext *ft, int doc)
+{
+    return &get_strings(ft)[get_docs(ft)[doc].file];
+}
+
+void fulltext_doc_mtime(const struct fulltext *ft, int doc, int64_t *sec, int64_t *nsec)
+{
+    *sec = get_docs(ft)[doc].sec;
+    *nsec = get_docs(ft)[doc].nsec;
+}
+
+/* first term which is not less than word */
+static uint32_t lower_bound_term(const struct fulltext *ft, const char *word)
+{
+    const struct fulltext_term *terms = get_terms(ft);
+    const char *strings = get_strings(ft);
+    uint32_t lo = 0;
+    uint32_t hi = get_header(ft)->n_terms;
+
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (strcmp(&strings[terms[mid].word], word) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/* (doc << 32) | position of every occurrence of a term, appended to pairs */
+static int decode_term(const struct fulltext *ft, uint32_t t, uint64_t **pairs, size_t *n_pairs, size_t *allocated)
+{
+    const struct fulltext_term *term = &get_terms(ft)[t];
+    const uint8_t *p = get_blob(ft) + term->postings;
+    const uint8_t *end = p + term->postings_size;
+    uint32_t doc = (uint32_t)-1;
+
+    for (uint32_t i = 0; i < term->n_docs; i++)
+    {
+        uint32_t delta, count, position = 0;
+
+        if (((p = get_varint(p, end, &delta)) == NULL) || ((p = get_varint(p, end, &count)) == NULL))
+            return -1;
+
+        doc += delta;
+
+        if (*n_pairs + count > *allocated)
+        {
+            size_t new_size = *allocated ? *allocated * 2 : 1024;
+            while (new_size < *n_pairs + count)
+                new_size *= 2;
+
+            uint64_t *new_pairs = realloc(*pairs, new_size * sizeof(uint64_t));
+            if (new_pairs == NULL)
+                return -1;
+
+            *pairs = new_pairs;
+            *allocated = new_size;
+        }
+
+        for (uint32_t k = 0; k < count; k++)
+        {
+            uint32_t gap;
+            if ((p = get_varint(p, end, &gap)) == NULL)
+                return -1;
+
+            position += gap;
+            (*pairs)[(*n_pairs)++] = ((uint64_t)doc << 32) | position;
+        }
+    }
+
+    return 0;
+}
+
+static int cmp_uint64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* occurrences of one query word, grouped by page */
+struct word_hits {
+    uint64_t *pairs; /* (doc << 32) | position, ascending */
+    size_t n_pairs;
+    uint32_t *docs; /* distinct pages */
+    size_t *first; /* pairs of docs[i] are pairs[first[i]] .. pairs[first[i + 1] - 1] */
+    size_t n_docs;
+};
+
+static void free_word_hits(struct word_hits *w)
+{
+    free(w->pairs);
+    free(w->docs);
+    free(w->first);
+}
+
+static int find_word_hits(const struct fulltext *ft, const char *word, int is_prefix, struct word_hits *w)
+{
+    const char *strings = get_strings(ft);
+    const struct fulltext_term *terms = get_terms(ft);
+    uint32_t n_terms = get_header(ft)->n_terms;
+    size_t len = strlen(word);
+    size_t allocated = 0;
+
+    memset(w, 0, sizeof(*w));
+
+    uint32_t first = lower_bound_term(ft, word);
+    uint32_t last = first;
+
+    if (is_prefix)
+    {
+        while ((last < n_terms) && (strncmp(&strings[terms[last].word], word, len) == 0))
+            last++;
+
+        if (last - first > MAX_PREFIX_TERMS)
+            is_prefix = 0;
+    }
+
+    if (!is_prefix)
+        last = ((first < n_terms) && (strcmp(&strings[terms[first].word], word) == 0)) ? first + 1 : first;
+
+    for (uint32_t t = first; t < last; t++)
+    {
+        if (decode_term(ft, t, &w->pairs, &w->n_pairs, &allocated) != 0)
+            return -1;
+    }
+
+    /* several words with this prefix */
+    if (last - first > 1)
+        qsort(w->pairs, w->n_pairs, sizeof(uint64_t), &cmp_uint64);
+
+    w->docs = malloc((w->n_pairs + 1) * sizeof(uint32_t));
+    w->first = malloc((w->n_pairs + 2) * sizeof(size_t));
+    if ((w->docs == NULL) || (w->first == NULL))
+        return -1;
+
+    for (size_t i = 0; i < w->n_pairs; i++)
+    {
+        uint32_t doc = w->pairs[i] >> 32;
+        if ((w->n_docs == 0) || (w->docs[w->n_docs - 1] != doc))
+        {
+            w->docs[w->n_docs] = doc;
+            w->first[w->n_docs] = i;
+            w->n_docs++;
+        }
+    }
+
+    w->first[w->n_docs] = w->n_pairs;
+    return 0;
+}
+
+/* is position in the sorted occurrences of a page */
+static int has_position(const uint64_t *pairs, size_t count, uint64_t value)
+{
+    size_t lo = 0;
+    size_t hi = count;
+
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (pairs[mid] < value)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return (lo < count) && (pairs[lo] == value);
+}
+
+/**
+ * Find the pages containing all words of the query (the last one may be
+ * the start of a word), ranked with BM25. Pages where the words appear
+ * as a phrase rank higher. The position of a hit is the first occurrence
+ * of the phrase or else of the least frequent word.
+ *
+ * Returns the number of hits (array allocated with malloc), or -1 if the
+ * query has no words.
+ */
+int fulltext_query(const struct fulltext *ft, const char *query, struct fulltext_hit **hits_out)
+{
+    *hits_out = NULL;
+
+    if (ft->map == NULL)
+        return -1;
+
+    char words[MAX_QUERY_WORDS][MAX_WORD_LENGTH + 1];
+    int n_words = 0;
+    const char *s = query;
+
+    while ((n_words < MAX_QUERY_WORDS) && next_word(&s, words[n_words], NULL))
+        n_words++;
+
+    if (n_words == 0)
+        return -1;
+
+    /* the last word is still being typed unless it is followed by something */
+    int last_is_prefix = is_word_char(query[strlen(query) - 1]);
+
+    struct word_hits w[MAX_QUERY_WORDS];
+    memset(w, 0, sizeof(w));
+
+    struct fulltext_hit *hits = NULL;
+    int n_hits = -1;
+
+    for (int i = 0; i < n_words; i++)
+    {
+        if (find_word_hits(ft, words[i], last_is_prefix && (i == n_words - 1), &w[i]) != 0)
+            goto out;
+    }
+
+    const struct fulltext_header *h = get_header(ft);
+    const struct fulltext_doc *docs = get_docs(ft);
+
+    double total_words = 0;
+    for (uint32_t d = 0; d < h->n_docs; d++)
+        total_words += docs[d].n_words;
+
+    double average_words = (h->n_docs > 0) ? total_words / h->n_docs : 1;
+
+    /* the least frequent word bounds the hits */
+    int rarest = 0;
+    for (int i = 1; i < n_words; i++)
+    {
+        if (w[i].n_docs < w[rarest].n_docs)
+            rarest = i;
+    }
+
+    hits = malloc((w[rarest].n_docs + 1) * sizeof(struct fulltext_hit));
+    if (hits == NULL)
+        goto out;
+
+    n_hits = 0;
+    size_t cursor[MAX_QUERY_WORDS] = {0};
+
+    for (size_t k = 0; k < w[rarest].n_docs; k++)
+    {
+        uint32_t doc = w[rarest].docs[k];
+        size_t index[MAX_QUERY_WORDS];
+        int in_all = 1;
+
+        for (int i = 0; (i < n_words) && in_all; i++)
+        {
+            while ((cursor[i] < w[i].n_docs) && (w[i].docs[cursor[i]] < doc))
+                cursor[i]++;
+
+            in_all = (cursor[i] < w[i].n_docs) && (w[i].docs[cursor[i]] == doc);
+            index[i] = cursor[i];
+        }
+
+        if (!in_all)
+            continue;
+
+        const double k1 = 1.2;
+        const double b = 0.75;
+        double score = 0;
+
+        for (int i = 0; i < n_words; i++)
+        {
+            double tf = w[i].first[index[i] + 1] - w[i].first[index[i]];
+            double df = w[i].n_docs;
+            double idf = log(1.0 + (h->n_docs - df + 0.5) / (df + 0.5));
+            score += idf * tf * (k1 + 1) / (tf + k1 * (1 - b + b * docs[doc].n_words / average_words));
+        }
+
+        /* first occurrence of the words as a phrase */
+        int64_t phrase = -1;
+        if (n_words > 1)
+        {
+            for (size_t p = w[0].first[index[0]]; (p < w[0].first[index[0] + 1]) && (phrase < 0); p++)
+            {
+                int found = 1;
+                for (int i = 1; (i < n_words) && found; i++)
+                {
+                    size_t begin = w[i].first[index[i]];
+                    found = has_position(&w[i].pairs[begin], w[i].first[index[i] + 1] - begin, w[0].pairs[p] + i);
+                }
+
+                if (found)
+                    phrase = (uint32_t)w[0].pairs[p];
+            }
+        }
+
+        if (phrase >= 0)
+            score *= 2;
+
+        hits[n_hits].doc = doc;
+        hits[n_hits].score = score * 1000;
+        hits[n_hits].position = (phrase >= 0) ? phrase : (uint32_t)w[rarest].pairs[w[rarest].first[k]];
+        n_hits++;
+    }
+
+out:
+    for (int i = 0; i < n_words; i++)
+        free_word_hits(&w[i]);
+
+    if (n_hits < 0)
+    {
+        free(hits);
+        return -1;
+    }
+
+    *hits_out = hits;
+    return n_hits;
+}
+
+/**
+ * Text of the line containing the word at position in a page (without
+ * leading spaces) and the word itself as it appears in the text.
+ * Returns the line number, or -1 if it can't be found.
+ */
+int fulltext_hit_line(const struct fulltext *ft, int doc, int position, char *line, size_t line_len, char *word, size_t word_len)
+{
+    const struct fulltext_doc *d = &get_docs(ft)[doc];
+
+    char *text = malloc(d->text_raw_size + 1);
+    if (text == NULL)
+        return -1;
+
+    uLongf size = d->text_raw_size;
+    if ((uncompress((Bytef *)text, &size, get_blob(ft) + d->text, d->text_size) != Z_OK) || (size != d->text_raw_size))
+    {
+        free(text);
+        return -1;
+    }
+
+    text[size] = '\0';
+
+    const char *s = text;
+    const char *start = NULL;
+    const char *line_start = text;
+    char tmp[MAX_WORD_LENGTH + 1];
+    int line_number = 0;
+    int ret = -1;
+
+    for (int i = 0; next_word(&s, tmp, &start); i++)
+    {
+        /* lines passed since the previous word */
+        for (const char *c = line_start; (c = memchr(c, '\n', start - c)) != NULL; c++)
+        {
+            line_start = c + 1;
+            line_number++;
+        }
+
+        if (i == position)
+        {
+            const char *line_end = strchr(start, '\n');
+            if (line_end == NULL)
+                line_end = start + strlen(start);
+
+            while ((line_start < line_end) && (*line_start == ' '))
+                line_start++;
+
+            snprintf(line, line_len, "%.*s", (int)(line_end - line_start), line_start);
+            snprintf(word, word_len, "%.*s", (int)(s - start), start);
+            ret = line_number;
+            break;
+        }
+    }
+
+    free(text);
+    return ret;
+}
+
+/* building */
+
+struct builder_term {
+    char *word;
+    struct bytes postings;
+    uint32_t n_docs;
+    uint32_t last_doc;
+};
+
+struct builder_doc {
+    char *file;
+    int64_t sec;
+    int64_t nsec;
+    uint32_t n_words;
+    uint8_t *text;
+    uint32_t text_size;
+    uint32_t text_raw_size;
+};
+
+struct fulltext_builder {
+    map_t words; /* word -> index in terms + 1 */
+    struct builder_term *terms;
+    size_t n_terms;
+    size_t terms_allocated;
+    struct builder_doc *docs;
+    size_t n_docs;
+    size_t docs_allocated;
+};
+
+struct fulltext_builder *fulltext_builder_new(void)
+{
+    struct fulltext_builder *b = calloc(1, sizeof(struct fulltext_builder));
+    if (b == NULL)
+        return NULL;
+
+    b->words = hashmap_new();
+    return b;
+}
+
+void fulltext_builder_free(struct fulltext_builder *b)
+{
+    if (b == NULL)
+        return;
+
+    for (size_t i = 0; i < b->n_terms; i++)
+    {
+        free(b->terms[i].word);
+        free(b->terms[i].postings.data);
+    }
+
+    for (size_t i = 0; i < b->n_docs; i++)
+    {
+        free(b->docs[i].file);
+        free(b->docs[i].text);
+    }
+
+    free(b->terms);
+    free(b->docs);
+    hashmap_free(b->words);
+    free(b);
+}
+
+static struct builder_term *get_builder_term(struct fulltext_builder *b, const char *word)
+{
+    void *value = NULL;
+    if (hashmap_get(b->words, word, strlen(word), &value) == MAP_OK)
+        return &b->terms[(intptr_t)value - 1];
+
+    if (b->n_terms == b->terms_allocated)
+    {
+        size_t new_size = b->terms_allocated ? b->terms_allocated * 2 : 4096;
+        struct builder_term *new_terms = realloc(b->terms, new_size * sizeof(struct builder_term));
+        if (new_terms == NULL)
+            return NULL;
+
+        b->terms = new_terms;
+        b->terms_allocated = new_size;
+    }
+
+    struct builder_term *t = &b->terms[b->n_terms];
+    memset(t, 0, sizeof(*t));
+    t->word = strdup(word);
+    t->last_doc = (uint32_t)-1;
+
+    if ((t->word == NULL) || (hashmap_put(b->words, word, strlen(word), (void *)(intptr_t)(b->n_terms + 1)) != MAP_OK))
+    {
+        free(t->word);
+        return NULL;
+    }
+
+    b->n_terms++;
+    return t;
+}
+
+static struct builder_doc *new_builder_doc(struct fulltext_builder *b)
+{
+    if (b->n_docs == b->docs_allocated)
+    {
+        size_t new_size = b->docs_allocated ? b->docs_allocated * 2 : 1024;
+        struct builder_doc *new_docs = realloc(b->docs, new_size * sizeof(struct builder_doc));
+        if (new_docs == NULL)
+            return NULL;
+
+        b->docs = new_docs;
+        b->docs_allocated = new_size;
+    }
+
+    struct builder_doc *d = &b->docs[b->n_docs++];
+    memset(d, 0, sizeof(*d));
+    return d;
+}
+
+/* start the entry of a page in the postings of a term, pages have to come in ascending order */
+static int begin_posting(struct builder_term *t, uint32_t doc, uint32_t count)
+{
+    if ((put_varint(&t->postings, doc - t->last_doc) != 0) || (put_varint(&t->postings, count) != 0))
+        return -1;
+
+    t->last_doc = doc;
+    t->n_docs++;
+    return 0;
+}
+
+/**
+ * Copy the pages of an older index for which keep[doc] is set. Has to be
+ * called before any page is added.
+ */
+int fulltext_builder_add_unchanged(struct fulltext_builder *b, const struct fulltext *old, const char *keep)
+{
+    if ((old->map == NULL) || (b->n_docs != 0))
+        return -1;
+
+    const struct fulltext_header *h = get_header(old);
+    const struct fulltext_doc *docs = get_docs(old);
+    const struct fulltext_term *terms = get_terms(old);
+    const char *strings = get_strings(old);
+    const uint8_t *blob = get_blob(old);
+
+    uint32_t *remap = malloc((h->n_docs + 1) * sizeof(uint32_t));
+    if (remap == NULL)
+        return -1;
+
+    for (uint32_t i = 0; i < h->n_docs; i++)
+    {
+        remap[i] = (uint32_t)-1;
+        if (!keep[i])
+            continue;
+
+        struct builder_doc *d = new_builder_doc(b);
+        if (d == NULL)
+            goto fail;
+
+        d->file = strdup(&strings[docs[i].file]);
+        d->sec = docs[i].sec;
+        d->nsec = docs[i].nsec;
+        d->n_words = docs[i].n_words;
+        d->text = malloc(docs[i].text_size + 1);
+        d->text_size = docs[i].text_size;
+        d->text_raw_size = docs[i].text_raw_size;
+
+        if ((d->file == NULL) || (d->text == NULL))
+            goto fail;
+
+        memcpy(d->text, blob + docs[i].text, docs[i].text_size);
+        remap[i] = b->n_docs - 1;
+    }
+
+    for (uint32_t i = 0; i < h->n_terms; i++)
+    {
+        const uint8_t *p = blob + terms[i].postings;
+        const uint8_t *end = p + terms[i].postings_size;
+        struct builder_term *t = NULL;
+        uint32_t doc = (uint32_t)-1;
+
+        for (uint32_t k = 0; k < terms[i].n_docs; k++)
+        {
+            uint32_t delta, count;
+            if (((p = get_varint(p, end, &delta)) == NULL) || ((p = get_varint(p, end, &count)) == NULL))
+                goto fail;
+
+            doc += delta;
+
+            /* the positions are relative to the page, they are copied as they are */
+            const uint8_t *positions = p;
+            for (uint32_t n = 0; n < count; n++)
+            {
+                uint32_t gap;
+                if ((p = get_varint(p, end, &gap)) == NULL)
+                    goto fail;
+            }
+
+            if (remap[doc] == (uint32_t)-1)
+                continue;
+
+            if ((t == NULL) && ((t = get_builder_term(b, &strings[terms[i].word])) == NULL))
+                goto fail;
+
+            if ((begin_posting(t, remap[doc], count) != 0) || (bytes_append(&t->postings, positions, p - positions) != 0))
+                goto fail;
+        }
+    }
+
+    free(remap);
+    return 0;
+
+fail:
+    free(remap);
+    return -1;
+}
+
+/**
+ * Add a page, text is its formatted text with lines separated by '\n'.
+ * After a failure the builder shouldn't be written.
+ */
+int fulltext_builder_add(struct fulltext_builder *b, const char *file, int64_t sec, int64_t nsec, const char *text)
+{
+    size_t text_len = strlen(text);
+    if (text_len > UINT32_MAX)
+        return -1;
+
+    /* (term << 32) | position of every word, sorted to group the positions by term */
+    size_t n_pairs = 0;
+    size_t allocated = 1024;
+    uint64_t *pairs = malloc(allocated * sizeof(uint64_t));
+    if (pairs == NULL)
+        return -1;
+
+    const char *s = text;
+    char word[MAX_WORD_LENGTH + 1];
+
+    while (next_word(&s, word, NULL))
+    {
+        struct builder_term *t = get_builder_term(b, word);
+        if (t == NULL)
+            goto fail;
+
+        if (n_pairs == allocated)
+        {
+            uint64_t *new_pairs = realloc(pairs, allocated * 2 * sizeof(uint64_t));
+            if (new_pairs == NULL)
+                goto fail;
+
+            pairs = new_pairs;
+            allocated *= 2;
+        }
+
+        pairs[n_pairs] = ((uint64_t)(t - b->terms) << 32) | n_pairs;
+        n_pairs++;
+    }
+
+    qsort(pairs, n_pairs, sizeof(uint64_t), &cmp_uint64);
+
+    struct builder_doc *d = new_builder_doc(b);
+    if (d == NULL)
+        goto fail;
+
+    uint32_t doc = b->n_docs - 1;
+
+    for (size_t i = 0; i < n_pairs;)
+    {
+        struct builder_term *t = &b->terms[pairs[i] >> 32];
+
+        size_t count = 1;
+        while ((i + count < n_pairs) && ((pairs[i + count] >> 32) == (pairs[i] >> 32)))
+            count++;
+
+        if (begin_posting(t, doc, count) != 0)
+            goto fail;
+
+        uint32_t previous = 0;
+        for (size_t k = i; k < i + count; k++)
+        {
+            uint32_t position = (uint32_t)pairs[k];
+            if (put_varint(&t->postings, position - previous) != 0)
+                goto fail;
+            previous = position;
+        }
+
+        i += count;
+    }
+
+    free(pairs);
+    pairs = NULL;
+
+    uLongf compressed_size = compressBound(text_len);
+    d->file = strdup(file);
+    d->sec = sec;
+    d->nsec = nsec;
+    d->n_words = n_pairs;
+    d->text = malloc(compressed_size);
+    d->text_raw_size = text_len;
+
+    if ((d->file == NULL) || (d->text == NULL) ||
+            (compress2(d->text, &compressed_size, (const Bytef *)text, text_len, Z_BEST_SPEED) != Z_OK))
+        return -1;
+
+    d->text_size = compressed_size;
+    return 0;
+
+fail:
+    free(pairs);
+    return -1;
+}
+
+static int write_all(int fd, const void *data, size_t size)
+{
+    const char *ptr = data;
+
+    while (size > 0)
+    {
+        ssize_t written = write(fd, ptr, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        ptr += written;
+        size -= written;
+    }
+
+    return 0;
+}
+
+struct term_ref {
+    const char *word;
+    uint32_t index;
+};
+
+static int cmp_term_ref(const void *a, const void *b)
+{
+    return strcmp(((const struct term_ref *)a)->word, ((const struct term_ref *)b)->word);
+}
+
+/**
+ * Store the index. The file is replaced atomically so a running instance
+ * can keep using the old mapping.
+ */
+int fulltext_builder_write(struct fulltext_builder *b, const char *filename)
+{
+    struct term_ref *order = malloc((b->n_terms + 1) * sizeof(struct term_ref));
+    struct fulltext_doc *docs = calloc(b->n_docs + 1, sizeof(struct fulltext_doc));
+    struct fulltext_term *terms = calloc(b->n_terms + 1, sizeof(struct fulltext_term));
+    struct bytes strings = {0};
+    uint64_t blob_size = 0;
+    int ret = -1;
+    int fd = -1;
+    char tmp_filename[1100];
+
+    if ((order == NULL) || (docs == NULL) || (terms == NULL) || (bytes_append(&strings, "", 1) != 0))
+        goto out;
+
+    for (size_t i = 0; i < b->n_terms; i++)
+    {
+        order[i].word = b->terms[i].word;
+        order[i].index = i;
+    }
+
+    qsort(order, b->n_terms, sizeof(struct term_ref), &cmp_term_ref);
+
+    for (size_t i = 0; i < b->n_terms; i++)
+    {
+        const struct builder_term *t = &b->terms[order[i].index];
+
+        terms[i].word = strings.size;
+        terms[i].n_docs = t->n_docs;
+        terms[i].postings = blob_size;
+        terms[i].postings_size = t->postings.size;
+        blob_size += t->postings.size;
+
+        if (bytes_append(&strings, t->word, strlen(t->word) + 1) != 0)
+            goto out;
+    }
+
+    for (size_t i = 0; i < b->n_docs; i++)
+    {
+        const struct builder_doc *d = &b->docs[i];
+
+        docs[i].file = strings.size;
+        docs[i].n_words = d->n_words;
+        docs[i].sec = d->sec;
+        docs[i].nsec = d->nsec;
+        docs[i].text = blob_size;
+        docs[i].text_size = d->text_size;
+        docs[i].text_raw_size = d->text_raw_size;
+        blob_size += d->text_size;
+
+        if (bytes_append(&strings, d->file, strlen(d->file) + 1) != 0)
+            goto out;
+    }
+
+    if (strings.size > UINT32_MAX)
+        goto out;
+
+    struct fulltext_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, FULLTEXT_MAGIC, sizeof(h.magic));
+    h.version = FULLTEXT_VERSION;
+    h.n_docs = b->n_docs;
+    h.n_terms = b->n_terms;
+    h.strings_size = strings.size;
+    h.blob_size = blob_size;
+
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.%ld", filename, (long)getpid());
+
+    fd = open(tmp_filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1)
+        goto out;
+
+    int failed = (write_all(fd, &h, sizeof(h)) != 0) ||
+        (write_all(fd, docs, b->n_docs * sizeof(struct fulltext_doc)) != 0) ||
+        (write_all(fd, terms, b->n_terms * sizeof(struct fulltext_term)) != 0) ||
+        (write_all(fd, strings.data, strings.size) != 0);
+
+    for (size_t i = 0; (i < b->n_terms) && !failed; i++)
+    {
+        const struct builder_term *t = &b->terms[order[i].index];
+        failed = write_all(fd, t->postings.data, t->postings.size) != 0;
+    }
+
+    for (size_t i = 0; (i < b->n_docs) && !failed; i++)
+        failed = write_all(fd, b->docs[i].text, b->docs[i].text_size) != 0;
+
+    close(fd);
+
+    if (failed || (rename(tmp_filename, filename) != 0))
+    {
+        unlink(tmp_filename);
+        goto out;
+    }
+
+    ret = 0;
+
+out:
+    free(order);
+    free(docs);
+    free(terms);
+    free(strings.data);
+    return ret;
+}
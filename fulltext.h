@@ -0,0 +1,37 @@
+#ifndef __FULLTEXT_H__
+#define __FULLTEXT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* mapped full-text index */
+struct fulltext {
+    void *map;
+    size_t map_size;
+};
+
+struct fulltext_hit {
+    int32_t doc;
+    int32_t score;
+    int32_t position; /* word number within the page */
+};
+
+int fulltext_open(const char *filename, struct fulltext *ft);
+void fulltext_close(struct fulltext *ft);
+
+int fulltext_doc_count(const struct fulltext *ft);
+const char *fulltext_doc_file(const struct fulltext *ft, int doc);
+void fulltext_doc_mtime(const struct fulltext *ft, int doc, int64_t *sec, int64_t *nsec);
+
+int fulltext_query(const struct fulltext *ft, const char *query, struct fulltext_hit **hits_out);
+int fulltext_hit_line(const struct fulltext *ft, int doc, int position, char *line, size_t line_len, char *word, size_t word_len);
+
+struct fulltext_builder;
+
+struct fulltext_builder *fulltext_builder_new(void);
+void fulltext_builder_free(struct fulltext_builder *b);
+int fulltext_builder_add_unchanged(struct fulltext_builder *b, const struct fulltext *old, const char *keep);
+int fulltext_builder_add(struct fulltext_builder *b, const char *file, int64_t sec, int64_t nsec, const char *text);
+int fulltext_builder_write(struct fulltext_builder *b, const char *filename);
+
+#endif // __FULLTEXT_H__
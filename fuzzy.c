@@ -0,0 +1,228 @@
+/*
+ * fuzzy.c
+ *
+ * fuzzy matching of the search term against page names, modelled after fzf
+ *
+ * The characters of the term have to appear in the name in the same order,
+ * but not necessarily next to each other. Of all the ways to place them the
+ * one with the best score is used: every matched character scores, gaps
+ * between matched characters cost, and characters at the start of a word
+ * (after '_', '-', '.', '(' or a space, at a lower-to-uppercase change or
+ * at the first digit) get a bonus, which consecutive characters inherit.
+ * So "pthmutl" scores high on pthread_mutex_lock, where every piece of the
+ * term starts a word.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "fuzzy.h"
+
+#define SCORE_MATCH 16
+#define SCORE_GAP_START (-3)
+#define SCORE_GAP_EXTENSION (-1)
+
+#define BONUS_BOUNDARY (SCORE_MATCH / 2)
+#define BONUS_BOUNDARY_WHITE (BONUS_BOUNDARY + 2)
+#define BONUS_BOUNDARY_DELIMITER (BONUS_BOUNDARY + 1)
+#define BONUS_NON_WORD (SCORE_MATCH / 2)
+#define BONUS_CAMEL (BONUS_BOUNDARY + SCORE_GAP_EXTENSION)
+#define BONUS_CONSECUTIVE (-(SCORE_GAP_START + SCORE_GAP_EXTENSION))
+#define BONUS_FIRST_CHAR_MULTIPLIER 2
+
+#define NONE (INT_MIN / 2)
+
+enum char_class {
+    CHAR_WHITE,
+    CHAR_NON_WORD,
+    CHAR_DELIMITER,
+    CHAR_LOWER,
+    CHAR_UPPER,
+    CHAR_NUMBER,
+};
+
+static enum char_class class_of(unsigned char c)
+{
+    if ((c >= 'a') && (c <= 'z'))
+        return CHAR_LOWER;
+    if ((c >= 'A') && (c <= 'Z'))
+        return CHAR_UPPER;
+    if ((c >= '0') && (c <= '9'))
+        return CHAR_NUMBER;
+    if ((c == ' ') || (c == '\t'))
+        return CHAR_WHITE;
+    if ((c == '/') || (c == ',') || (c == ':') || (c == ';') || (c == '|'))
+        return CHAR_DELIMITER;
+    if (c >= 0x80)
+        return CHAR_LOWER; /* part of a UTF-8 sequence, treat as a letter */
+    return CHAR_NON_WORD;
+}
+
+static int bonus_for(enum char_class prev, enum char_class cur)
+{
+    if (cur >= CHAR_LOWER)
+    {
+        if (prev == CHAR_WHITE)
+            return BONUS_BOUNDARY_WHITE;
+        if (prev == CHAR_DELIMITER)
+            return BONUS_BOUNDARY_DELIMITER;
+        if (prev == CHAR_NON_WORD)
+            return BONUS_BOUNDARY;
+        if ((prev == CHAR_LOWER) && (cur == CHAR_UPPER))
+            return BONUS_CAMEL;
+        if ((prev != CHAR_NUMBER) && (cur == CHAR_NUMBER))
+            return BONUS_CAMEL;
+        return 0;
+    }
+
+    if (cur == CHAR_WHITE)
+        return BONUS_BOUNDARY_WHITE;
+
+    return BONUS_NON_WORD;
+}
+
+static inline unsigned char fold(unsigned char c)
+{
+    return ((c >= 'A') && (c <= 'Z')) ? (c | 0x20) : c;
+}
+
+static inline int char_equal(unsigned char text, unsigned char pattern, int case_sensitive)
+{
+    return case_sensitive ? (text == pattern) : (fold(text) == pattern);
+}
+
+static inline int max2(int a, int b)
+{
+    return (a > b) ? a : b;
+}
+
+/**
+ * Score of the best placement of pattern in text, or FUZZY_NO_MATCH.
+ * Without case_sensitive the pattern has to be lowercase already.
+ */
+int fuzzy_match(const char *pattern, const char *text, int case_sensitive)
+{
+    size_t m = strlen(pattern);
+    if (m == 0)
+        return 0;
+
+    /* quick rejection, and the range of the text where a match can be */
+    size_t first = 0;
+    size_t i = 0;
+    size_t j = 0;
+
+    for (; text[j] && (i < m); j++)
+    {
+        if (char_equal(text[j], pattern[i], case_sensitive))
+        {
+            if (i == 0)
+                first = j;
+            i++;
+        }
+    }
+
+    if (i < m)
+        return FUZZY_NO_MATCH;
+
+    size_t n = j + strlen(&text[j]);
+    size_t last = n - 1;
+    while (!char_equal(text[last], pattern[m - 1], case_sensitive))
+        last--;
+
+    size_t w = last - first + 1;
+
+    int stack_buffer[5 * 128];
+    int *buffer = (w <= 128) ? stack_buffer : malloc(5 * w * sizeof(int));
+    if (buffer == NULL)
+        return FUZZY_NO_MATCH;
+
+    int *bonus = buffer;
+    int *score = buffer + w; /* best score with the current pattern character at this position */
+    int *chunk = buffer + 2 * w; /* bonus of the first character of a run of consecutive matches */
+    int *prev_score = buffer + 3 * w;
+    int *prev_chunk = buffer + 4 * w;
+
+    enum char_class prev_class = (first > 0) ? class_of(text[first - 1]) : CHAR_WHITE;
+    for (size_t k = 0; k < w; k++)
+    {
+        enum char_class cur_class = class_of(text[first + k]);
+        bonus[k] = bonus_for(prev_class, cur_class);
+        prev_class = cur_class;
+    }
+
+    for (size_t k = 0; k < w; k++)
+    {
+        if (char_equal(text[first + k], pattern[0], case_sensitive))
+        {
+            score[k] = SCORE_MATCH + bonus[k] * BONUS_FIRST_CHAR_MULTIPLIER;
+            chunk[k] = bonus[k];
+        }
+        else
+        {
+            score[k] = NONE;
+        }
+    }
+
+    for (size_t p = 1; p < m; p++)
+    {
+        int *tmp = prev_score;
+        prev_score = score;
+        score = tmp;
+        tmp = prev_chunk;
+        prev_chunk = chunk;
+        chunk = tmp;
+
+        /* best score of the previous character followed by a gap up to here */
+        int gap = NONE;
+
+        score[0] = NONE;
+        for (size_t k = 1; k < w; k++)
+        {
+            if (k >= 2)
+                gap = max2(gap + SCORE_GAP_EXTENSION, prev_score[k - 2] + SCORE_GAP_START);
+
+            score[k] = NONE;
+            if (!char_equal(text[first + k], pattern[p], case_sensitive))
+                continue;
+
+            int after_gap = (gap > NONE / 2) ? gap + SCORE_MATCH + bonus[k] : NONE;
+            int consecutive = NONE;
+            int consecutive_chunk = 0;
+
+            if (prev_score[k - 1] > NONE / 2)
+            {
+                int b = bonus[k];
+                consecutive_chunk = prev_chunk[k - 1];
+
+                /* a new word in the middle of a run starts a new chunk */
+                if ((b >= BONUS_BOUNDARY) && (b > consecutive_chunk))
+                    consecutive_chunk = b;
+                else
+                    b = max2(b, max2(consecutive_chunk, BONUS_CONSECUTIVE));
+
+                consecutive = prev_score[k - 1] + SCORE_MATCH + b;
+            }
+
+            if (consecutive >= after_gap)
+            {
+                score[k] = consecutive;
+                chunk[k] = consecutive_chunk;
+            }
+            else
+            {
+                score[k] = after_gap;
+                chunk[k] = bonus[k];
+            }
+        }
+    }
+
+    int best = NONE;
+    for (size_t k = 0; k < w; k++)
+        best = max2(best, score[k]);
+
+    if (buffer != stack_buffer)
+        free(buffer);
+
+    return (best > NONE / 2) ? best : FUZZY_NO_MATCH;
+}
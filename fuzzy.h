@@ -0,0 +1,10 @@
+#ifndef __FUZZY_H__
+#define __FUZZY_H__
+
+#include <limits.h>
+
+#define FUZZY_NO_MATCH INT_MIN
+
+int fuzzy_match(const char *pattern, const char *text, int case_sensitive);
+
+#endif // __FUZZY_H__
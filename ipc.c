@@ -0,0 +1,282 @@
+/*
+ * ipc.c
+ *
+ * communication between a resident mangl (started with --daemon) and
+ * later invocations over a Unix domain socket
+ *
+ * The socket is $XDG_RUNTIME_DIR/mangl.socket, or socket in the mangl cache
+ * directory if XDG_RUNTIME_DIR isn't set. A request consists of lines
+ * "key value", terminated by an empty line, and is answered with "ok" and
+ * an empty line.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "manindex.h"
+#include "ipc.h"
+
+#define IPC_PROTOCOL_VERSION 1
+#define IPC_MAX_REQUEST_SIZE 4096
+#define IPC_TIMEOUT 2 /* seconds a peer may take to connect, send or take a message */
+#define IPC_ACCEPT_RETRY_DELAY 100000 /* microseconds to wait after accept() failed, e.g. for lack of descriptors */
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 /* SO_NOSIGPIPE is set instead */
+#endif
+
+int ipc_socket_filename(char *out, size_t out_len)
+{
+    const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+    if (runtime_dir && (runtime_dir[0] == '/'))
+    {
+        if (snprintf(out, out_len, "%s/mangl.socket", runtime_dir) >= out_len)
+            return -1;
+        return 0;
+    }
+
+    return manindex_cache_filename("socket", out, out_len);
+}
+
+static int make_address(struct sockaddr_un *addr)
+{
+    char filename[1024];
+    if (ipc_socket_filename(filename, sizeof(filename)) != 0)
+        return -1;
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+
+    if (strlen(filename) >= sizeof(addr->sun_path))
+        return -1;
+
+    strcpy(addr->sun_path, filename);
+    return 0;
+}
+
+/* a peer which doesn't go on or went away fails the exchange instead of blocking or killing us */
+static void set_socket_options(int fd)
+{
+    struct timeval timeout = { IPC_TIMEOUT, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+}
+
+static int write_all(int fd, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        data += written;
+        size -= written;
+    }
+
+    return 0;
+}
+
+/* read until the terminating empty line, returns the length or -1 */
+static ssize_t read_message(int fd, char *buffer, size_t size)
+{
+    size_t len = 0;
+
+    while (len + 1 < size)
+    {
+        ssize_t n = read(fd, buffer + len, size - 1 - len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        if (n == 0)
+            break;
+
+        len += n;
+        buffer[len] = '\0';
+
+        if ((len >= 2) && (strcmp(&buffer[len - 2], "\n\n") == 0))
+            return len;
+    }
+
+    return -1;
+}
+
+static int connect_to_server(void)
+{
+    struct sockaddr_un addr;
+    if (make_address(&addr) != 0)
+        return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        return -1;
+
+    set_socket_options(fd);
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * Hand the request over to a running mangl --daemon.
+ * Returns 0 if the request was accepted, -1 if there is no server or it
+ * didn't answer within IPC_TIMEOUT.
+ */
+int ipc_send_request(const struct ipc_request *req)
+{
+    int fd = connect_to_server();
+    if (fd == -1)
+        return -1;
+
+    char message[IPC_MAX_REQUEST_SIZE];
+    int len = snprintf(message, sizeof(message), "mangl %d\nfilename %s\npwd %s\n\n",
+            IPC_PROTOCOL_VERSION, req->filename, req->pwd);
+
+    char reply[64];
+    int ret = -1;
+
+    if ((len < sizeof(message)) && (write_all(fd, message, len) == 0) &&
+            (read_message(fd, reply, sizeof(reply)) > 0) && (strcmp(reply, "ok\n\n") == 0))
+    {
+        ret = 0;
+    }
+
+    close(fd);
+    return ret;
+}
+
+/**
+ * Create the listening socket of the resident instance. Fails if another
+ * instance is already listening.
+ */
+int ipc_listen(void)
+{
+    struct sockaddr_un addr;
+    if (make_address(&addr) != 0)
+    {
+        fprintf(stderr, "Can't determine the socket filename\n");
+        return -1;
+    }
+
+    int existing = connect_to_server();
+    if (existing != -1)
+    {
+        close(existing);
+        fprintf(stderr, "mangl is already running (%s)\n", addr.sun_path);
+        return -1;
+    }
+
+    unlink(addr.sun_path); /* left over from an instance which didn't exit cleanly */
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+    {
+        fprintf(stderr, "Failed to create socket (%s)\n", strerror(errno));
+        return -1;
+    }
+
+    mode_t old_mask = umask(0077); /* only for this user */
+    int bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+
+    if ((bound != 0) || (listen(fd, 8) != 0))
+    {
+        fprintf(stderr, "Failed to listen on %s (%s)\n", addr.sun_path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void parse_value(const char *message, const char *key, char *out, size_t out_len)
+{
+    size_t key_len = strlen(key);
+    const char *line = message;
+
+    out[0] = '\0';
+
+    while (line && *line)
+    {
+        if ((strncmp(line, key, key_len) == 0) && (line[key_len] == ' '))
+        {
+            const char *value = line + key_len + 1;
+            const char *end = strchr(value, '\n');
+            size_t len = end ? (size_t)(end - value) : strlen(value);
+
+            if (len >= out_len)
+                len = out_len - 1;
+
+            memcpy(out, value, len);
+            out[len] = '\0';
+            return;
+        }
+
+        line = strchr(line, '\n');
+        if (line)
+            line++;
+    }
+}
+
+/**
+ * Wait for the next client and read its request (blocking until a client
+ * connects, a client gets IPC_TIMEOUT to send it). Returns 0 on success,
+ * -1 if the connection didn't deliver a valid request.
+ */
+int ipc_receive_request(int listen_fd, struct ipc_request *req)
+{
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd == -1)
+    {
+        /* the error persists (EMFILE, ENFILE, ENOBUFS...) while the client waits, don't spin on it */
+        if ((errno != EINTR) && (errno != ECONNABORTED))
+            usleep(IPC_ACCEPT_RETRY_DELAY);
+        return -1;
+    }
+
+    set_socket_options(fd);
+
+    char message[IPC_MAX_REQUEST_SIZE];
+    char version[16];
+    int ret = -1;
+
+    if (read_message(fd, message, sizeof(message)) > 0)
+    {
+        parse_value(message, "mangl", version, sizeof(version));
+        if (atoi(version) == IPC_PROTOCOL_VERSION)
+        {
+            parse_value(message, "filename", req->filename, sizeof(req->filename));
+            parse_value(message, "pwd", req->pwd, sizeof(req->pwd));
+            ret = write_all(fd, "ok\n\n", 4);
+        }
+    }
+
+    close(fd);
+    return ret;
+}
@@ -0,0 +1,19 @@
+#ifndef __IPC_H__
+#define __IPC_H__
+
+#include <stddef.h>
+
+/* what a mangl invocation asks the resident instance to do */
+struct ipc_request {
+    char filename[1024]; /* page to open, empty for the search screen */
+    char pwd[1024];
+};
+
+int ipc_socket_filename(char *out, size_t out_len);
+
+int ipc_send_request(const struct ipc_request *req);
+
+int ipc_listen(void);
+int ipc_receive_request(int listen_fd, struct ipc_request *req);
+
+#endif // __IPC_H__
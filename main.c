@@ -13,6 +13,7 @@
 #include <dirent.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <errno.h>
 #include <string.h>
 #include <math.h>
@@ -22,6 +23,13 @@
 #include <err.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <pthread.h>
+#include <regex.h>
+#include <limits.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 #ifndef __APPLE__
 #include <GL/gl.h>
 #endif
@@ -36,6 +44,17 @@
 #include "stretchy_buffer.h"
 #include "hashmap.h"
 #include "manpath.h"
+#include "manindex.h"
+#include "ipc.h"
+#include "trigram.h"
+#include "strsearch.h"
+#include "fuzzy.h"
+#include "descindex.h"
+#include "whatis.h"
+#include "fulltext.h"
+#include "document.h"
+#include "doccache.h"
+#include "atlas.h"
 #include "icon.h"
 
 #include "mandoc/mandoc.h"
@@ -45,6 +64,7 @@
 #include "mandoc/out.h"
 #include "mandoc/mandoc_aux.h"
 #include "mandoc/term.h"
+#include "mandoc/dbm.h"
 
 #define MANGL_VERSION_MAJOR 1
 #define MANGL_VERSION_MINOR 1
@@ -57,6 +77,7 @@
 
 static const struct option longopts[] =
 {
+    {"daemon",          no_argument,    NULL,   'd'},
     {"no-fork",         no_argument,    NULL,   'f'},
     {"help",            no_argument,    NULL,   'h'},
     {"local-file",      no_argument,    NULL,   'l'},
@@ -144,12 +165,17 @@ typedef struct FontData_
     uint8_t *bitmap;
     int bitmap_width;
     int bitmap_height;
-    CharDescription chars[128];
+    CharDescription chars[128]; /* builtin font only */
     int character_width;
     int character_height;
+    int character_advance; /* of every character */
     int line_height;
     double font_size;
     GLuint texture_id;
+
+    /* loaded font, its glyphs are rasterised into the texture when they are first drawn */
+    FT_Face face;
+    struct glyph_atlas atlas;
 } FontData;
 
 FontData builtinFont = {
@@ -158,6 +184,7 @@ FontData builtinFont = {
     .bitmap_height = 0,
     .character_width = 6, // actual width and height
     .character_height = 9,
+    .character_advance = FONT_CHAR_WIDTH,
     .line_height = FONT_CHAR_HEIGHT,
     .font_size = 10.0,
     .texture_id = 0
@@ -174,12 +201,23 @@ struct {
     double line_spacing;
     int line_length;
     int current_line_length;
+    int page_cache_size; /* MiB of formatted pages kept after they were left */
+    int fit_to_window; /* start with pages fitted to the window */
 } settings = { .font_size = 10, .gui_scale = 1.0, .line_spacing = 1.0, .line_length = 78,
-  .current_line_length = 78};
+  .current_line_length = 78, .page_cache_size = 64, .fit_to_window = 0};
 
 int display_mode = D_SEARCH;
 char search_term[512];
 
+enum SEARCH_MODES {
+    SEARCH_NAMES = 0,
+    SEARCH_DESCRIPTIONS, /* the one-line descriptions */
+    SEARCH_FULLTEXT, /* the text of the pages */
+    N_SEARCH_MODES
+};
+
+int search_mode = SEARCH_NAMES; /* switched with Tab */
+
 char **manpage_names;
 char **manpage_names_lower;
 
@@ -188,12 +226,22 @@ int results_selected_index = 0;
 int results_shown_lines = N_SHOWN_RESULTS;
 int results_view_offset = 0;
 
-struct {
+struct match {
     int idx;
     int goodness;
-} matches[100];
+    int doc; /* page in manpage_fulltext of a full-text hit, -1 otherwise */
+    int position; /* word of the hit within that page */
+};
 
-int matches_count = 0;
+/*
+ * All results of the current search. Only as many as are looked at are
+ * ordered (matches_ordered), the rest wait in a heap with the best one
+ * on top - see get_match().
+ */
+struct match *matches_ordered;
+struct match *matches_heap;
+
+int matches_count = 0; /* exact number of results */
 
 int scrollbar_thumb_position;
 int scrollbar_thumb_size;
@@ -205,7 +253,16 @@ int scrollbar_thumb_mouse_down_thumb_position = 0;
 
 int initial_window_rows = 40;
 
-int line_length_toggle;
+/*
+ * Pages are laid out at the window width instead of settings.line_length,
+ * toggled with '='. They are laid out again when the width changes, once it
+ * stayed the same for REFLOW_DELAY, as resizing sends a stream of changes.
+ */
+int fit_to_window;
+double reflow_time; /* when to fit the page to the window again, 0 for never */
+
+#define REFLOW_DELAY 0.2 /* seconds */
+#define MIN_LINE_LENGTH 20 /* of pages fitted to the window */
 
 GLFWwindow *window;
 
@@ -216,9 +273,15 @@ double mouse_x = 0.0;
 double mouse_y = 0.0;
 
 bool redisplay_needed = false;
+bool daemon_mode = false;
 
 map_t manpage_database;
 map_t manpage_database_pwd;
+map_t manpage_database_desc;
+struct trigram_index *manpage_trigrams; /* over manpage_names_lower, built by the first exact search, NULL until then */
+struct desc_index *manpage_desc_index; /* over the descriptions of manpage_names, NULL while not built */
+struct fulltext manpage_fulltext; /* not mapped until it has been built */
+bool manpage_database_ready = false;
 
 FT_Library library;
 
@@ -235,6 +298,15 @@ void exit_program(int code)
     exit(code);
 }
 
+/* quit on user request, a resident instance only hides its window */
+void close_window(void)
+{
+    if (!daemon_mode)
+        exit_program(EXIT_SUCCESS);
+
+    glfwHideWindow(window);
+}
+
 double clamp(double val, double min, double max)
 {
     if (val > max) return max;
@@ -384,7 +456,7 @@ int init_freetype(void)
     return 0;
 }
 
-int render_font_texture(const char *font_file, int font_size_px)
+int load_font(const char *font_file, int font_size_px)
 {
     FT_Face face;
 
@@ -425,6 +497,7 @@ int render_font_texture(const char *font_file, int font_size_px)
 
     int font_width = 0;
     int font_height = 0;
+    int font_advance = 0;
 
     /* get character size of X, H */
     const char *str = "XH";
@@ -445,6 +518,7 @@ int render_font_texture(const char *font_file, int font_size_px)
 
             font_width = MAX(font_width, bmp->width);
             font_height = MAX(font_height, bmp->rows);
+            font_advance = MAX(font_advance, face->glyph->advance.x / 64);
         }
     }
 
@@ -454,88 +528,23 @@ int render_font_texture(const char *font_file, int font_size_px)
         return -1;
     }
 
-    /* now allocate a texture of a good size */
-
     FontData *font = ZMALLOC(FontData, 1);
 
     font->font_size = font_size_px;
     font->character_width = font_width;
     font->character_height = font_height;
+    font->character_advance = font_advance;
     font->line_height = face->size->metrics.height / 64 + 1; /* add 1 px of line height to make text more breathy */
 
-    font->bitmap_width = round_to_power_of_2(16 * (font_width + 2));
-    font->bitmap_height = round_to_power_of_2(6 * (font_height * 2));
+    /* room for about 512 glyphs, they are rasterised as they are drawn */
+    font->bitmap_width = round_to_power_of_2(32 * (font_width + 2));
+    font->bitmap_height = round_to_power_of_2(16 * (font->line_height + 2));
     font->bitmap_width = MAX(font->bitmap_width, font->bitmap_height);
     font->bitmap_height = MAX(font->bitmap_width, font->bitmap_height);
 
-    font->bitmap = ZMALLOC(uint8_t, font->bitmap_width * font->bitmap_height);
-
-    for (int i = 32; i < 128; i++)
-    {
-        int glyph_index = FT_Get_Char_Index(face, i);
-        if (glyph_index > 0)
-        {
-            FT_Load_Glyph(face, glyph_index, FT_LOAD_DEFAULT);
-
-            error = FT_Render_Glyph(face->glyph, FT_RENDER_MODE_NORMAL);
-            if (error)
-            {
-                fprintf(stderr, "FT_Render_Glyph: Glyph render error: %d\n", error);
-                continue;
-            }
-
-            FT_Bitmap *bmp = &face->glyph->bitmap;
-
-            int w = bmp->width;
-            int h = bmp->rows;
-            int pitch = bmp->pitch;
-            int left = face->glyph->bitmap_left;
-            int top = face->glyph->bitmap_top;
-
-            //printf("w %d h %d pitch %d left %d top %d\n", w, h, pitch, left, top);
-
-            int col = i % 16;
-            int row = i / 16;
-            int dst_x = col * (font_width + 2) + left + 1;
-            int dst_y = row * (font_height * 2) - top;
-
-
-            font->chars[i].available = 1;
-            font->chars[i].top = top;
-            font->chars[i].left = left;
-            font->chars[i].width = w;
-            font->chars[i].height = h;
-            font->chars[i].advance = face->glyph->advance.x / 64;
-
-            const float pixel_x = 1.0f / font->bitmap_width;
-            const float pixel_y = 1.0f / font->bitmap_height;
-
-            font->chars[i].tex_coord0_x = pixel_x * dst_x;
-            font->chars[i].tex_coord0_y = pixel_y * dst_y;
-            font->chars[i].tex_coord1_x = pixel_x * (dst_x + w);
-            font->chars[i].tex_coord1_y = pixel_y * (dst_y + h);
-
-            if (bmp->pixel_mode == FT_PIXEL_MODE_GRAY)
-                copy_bitmap(font->bitmap, font->bitmap_width, font->bitmap_height, dst_x, dst_y, bmp->buffer, w, h, pitch);
-            else if (bmp->pixel_mode == FT_PIXEL_MODE_MONO)
-            {
-                // monochrome
-                copy_bitmap_1bit(font->bitmap, font->bitmap_width, font->bitmap_height, dst_x, dst_y, bmp->buffer, w, h, pitch);
-            }
-            else
-            {
-                fprintf(stderr, "Unsupported pixel mode (not 8 bit or 1 bit)\n");
-            }
-
-        }
-        else
-        {
-            //printf("no glyph for %d\n", i);
-            continue;
-        }
-    }
+    font->face = face;
+    atlas_init(&font->atlas, font->bitmap_width, font->bitmap_height);
 
-    FT_Done_Face(face);
     loadedFont = font;
 
     return 0;
@@ -547,6 +556,8 @@ void print_usage(const char *exe)
     fprintf(stderr, "Display the manpage PAGE in section SECTION in a graphical application\n");
     fprintf(stderr, "or open the application with the search screen.\n");
     fprintf(stderr, "\n");
+    fprintf(stderr, "  -d, --daemon              keep running in the background, later invocations\n");
+    fprintf(stderr, "                            open their pages in this instance\n");
     fprintf(stderr, "  -f, --no-fork             don't fork the GUI\n");
     fprintf(stderr, "  -h, --help                print usage\n");
     fprintf(stderr, "  -V, --version             print version and quit\n");
@@ -557,22 +568,19 @@ void print_usage(const char *exe)
     exit(1);
 }
 
-enum SPAN_TYPE
-{
-    SPAN_TITLE = 1,
-    SPAN_TEXT = 2,
-    SPAN_SECTION = 3,
-    SPAN_LINK = 4,
-    SPAN_URL = 5,
-};
-
-struct span {
-    char *buffer;
-    int buffer_size;
-    int length;
-    int type;
+#define MAX_PAGE_SEARCHES 100
 
-    struct span *next;
+/*
+ * Parsed document of a page file, shared by the pages formatted from it,
+ * so the page is laid out at another line length without reading and
+ * parsing the file again (see layout_manpage()).
+ */
+struct page_source {
+    struct mparse *parse;
+    struct roff_meta *meta; /* the syntax tree, owned by parse */
+    pthread_mutex_t lock; /* held while it's formatted, the formatter marks the nodes */
+    int refs;
+    struct doc_source stamp; /* of the file before it was read */
 };
 
 struct manpage
@@ -582,11 +590,13 @@ struct manpage
     char filename[1024];
     char pwd[1024];
 
-    struct {
-        struct span **lines;
-        int n_lines;
-        int lines_allocated;
-    } document;
+    struct document document;
+
+    int line_length; /* formatted for */
+    struct doc_source stamp; /* of filename before it was read, the caches check it */
+    struct doc_cache cache; /* mapped from the cache directory, the lines point into it */
+    struct page_source *source; /* NULL if it came from the cache directory or the page cache */
+    struct page_load *load; /* still laid out from there, the lines are borrowed until it's done */
 
     int scroll_position;
 
@@ -597,13 +607,46 @@ struct manpage
     char search_string[256];
     int search_visible;
 
-    search_t searches[100];
+    search_t searches[MAX_PAGE_SEARCHES];
     int search_num;
     int search_index;
+    bool search_extended; /* searched again for more lines, the selected hit and the view stay */
 };
 
 struct manpage *page;
-struct manpage *formatting_page; // used when formatting page
+
+/*
+ * Pages are formatted on several threads at once, the formatter keeps its
+ * state in the parser and in the termp. Only the current directory, which
+ * relative .so paths are resolved against, is shared, so a page is parsed
+ * with parse_lock held.
+ */
+pthread_mutex_t parse_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Lines of a page being laid out on the loader thread, handed over in
+ * chunks so the top of a long page is shown before the rest is laid out.
+ * The page shown from them only borrows the lines, they belong to the page
+ * of the load until it's done (see poll_page_streams()).
+ */
+struct page_stream {
+    pthread_mutex_t lock;
+    struct doc_line *lines; /* stretchy buffer, lines not taken yet */
+    bool abandoned; /* nobody takes them */
+};
+
+#define STREAM_FIRST_CHUNK 128 /* lines, more than the window shows */
+#define STREAM_MAX_CHUNK 4096
+
+/* where the formatter callbacks put the text, see mangl_formatter() */
+struct format_output {
+    struct manpage *page;
+    bool quiet; /* no messages about the page being formatted */
+    struct page_stream *stream; /* gets the lines as they are done, NULL for none */
+    int n_streamed; /* lines of page handed over */
+    int chunk; /* lines to hand over next time */
+    bool overstrike; /* the next letter goes over the last one */
+};
 
 struct page_description {
     char filename[256];
@@ -614,51 +657,95 @@ struct page_description {
 struct page_description *page_stack;
 size_t stack_pos; // index of displayed page + 1
 
-void open_new_page(const char *filename, const char *pwd);
-void page_back(void);
-void page_forward(void);
+/*
+ * Formatted pages which are no longer on the page stack, so opening one
+ * of them again doesn't read and format the file again. A page is found
+ * by its file, modification time and line length, the least recently
+ * used pages are dropped when the cache grows over settings.page_cache_size.
+ */
+struct cached_page {
+    struct manpage *page;
+    int64_t sec; /* modification time of the file */
+    int64_t nsec;
+    int line_length;
+    size_t size;
+    unsigned last_use;
+    bool links_stale; /* the catalogue changed since the links were found */
+};
 
-void add_line(struct manpage *p)
-{
-#define STARTING_LINES 256
-    if (p->document.n_lines == 0)
-    {
-        p->document.lines = ZMALLOC(struct span *, STARTING_LINES);
-        p->document.lines_allocated = STARTING_LINES;
-    }
-    else if (p->document.n_lines >= p->document.lines_allocated)
-    {
-        int new_n_lines = p->document.lines_allocated * 2;
-        struct span **old_lines = p->document.lines;
-        p->document.lines = ZMALLOC(struct span *, new_n_lines);
-        memcpy(p->document.lines, old_lines, sizeof(struct span *) * p->document.n_lines);
-        free(old_lines);
-        p->document.lines_allocated = new_n_lines;
-    }
+struct {
+    struct cached_page *pages; /* stretchy buffer */
+    size_t size;
+    unsigned clock;
+} page_cache;
 
-    p->document.n_lines++;
-    p->document.lines[p->document.n_lines - 1] = ZMALLOC(struct span, 1);
-}
+/*
+ * Pages are read and formatted on a few loader threads, which take the
+ * requests from a queue, while the displayed page stays usable. Only the
+ * page requested last is shown when it's done. Opening another one, going
+ * back or to the search screen drops the one being loaded: it's not laid
+ * out if that hasn't started yet, otherwise it still goes to the page cache.
+ */
+enum PAGE_LOAD_ACTIONS {LOAD_OPEN, LOAD_RELOAD};
 
-struct span* get_last_span(struct manpage *p)
-{
-    if (p->document.n_lines == 0) return NULL;
+struct page_load {
+    char filename[1024];
+    char pwd[1024];
+    char dir[1024]; /* for included files */
+    int line_length;
+    int action;
+    unsigned generation;
+    char search_word[80]; /* to search for once it's open, empty for none */
+    int search_line; /* to scroll to */
+    struct page_source *source; /* laid out again from this if set, instead of reading the file */
+    struct page_stream *stream; /* lines handed over while it's laid out, NULL if they aren't */
+    struct manpage *page; /* NULL if it failed */
+    int error; /* errno then */
+    struct manpage *shown; /* main thread only: page shown from the stream */
+};
 
-    struct span *s = p->document.lines[p->document.n_lines - 1];
-    while (s && s->next)
-    {
-        s = s->next;
-    }
+#define PAGE_LOADER_THREADS 2
 
-    return s;
-}
+struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond; /* a request was queued */
+    struct page_load **queue; /* stretchy buffer, requests no loader has taken yet */
+    struct page_load **done; /* stretchy buffer */
+    unsigned generation; /* of the load waited for, only changed by the main thread */
+
+    /* main thread only */
+    int n_loaders;
+    struct page_load **streaming; /* stretchy buffer, loads handing over lines */
+    int action; /* of the load waited for */
+    bool loading;
+    double start_time;
+    char title[512]; /* of the page being loaded */
+    char error[1024]; /* why the last one failed, shown until the next one is opened */
+} page_load_state = { .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER };
+
+#define PAGE_LOAD_INDICATOR_DELAY 0.15 /* seconds before "Loading" is shown */
+#define PAGE_LOAD_INDICATOR_INTERVAL 0.1
 
-void add_to_span(struct span *s, int letter)
-{
-#define STARTING_SPAN_SIZE 32
-    char letter_2 = 0;
+void open_new_page(const char *filename, const char *pwd);
+void request_page(const char *filename, const char *pwd, int line_length, int action, const char *search_word, int search_line);
+void cancel_page_load(void);
+void prefetch_links(const struct manpage *p);
+void open_search_result(int i);
+void page_back(void);
+void page_forward(void);
+static bool forget_page_search(struct manpage *p);
 
-    switch (letter)
+/**
+ * One byte standing for the code point c in the text of a page (searched,
+ * indexed and scanned for links) and drawn for it if the font doesn't
+ * have it: ASCII look-alikes for dashes, quotes, spaces and box drawing,
+ * Latin-1 as it is, LETTER_UNKNOWN for the rest.
+ */
+#define LETTER_UNKNOWN 0x1a /* ASCII SUB, never typed */
+
+static int fold_letter(int c)
+{
+    switch (c)
     {
         case 0x2010: /* Hyphen */
         case 0x2013: /* En dash */
@@ -667,100 +754,157 @@ void add_to_span(struct span *s, int letter)
         case 0x2212: /* Minus sign */
         case 0x2500: /* Box drawings light horizontal */
         case 0x2501: /* Box drawings heavy horizontal */
-            letter = '-';
-            break;
+            return '-';
         case 0x2217: /* Asterisk Operator */
-            letter = '*';
-            break;
+            return '*';
         case 0x2502: /* Box drawings light vertical */
         case 0x2503: /* Box drawings heavy vertical */
-            letter = '|';
-            break;
+            return '|';
         case 0x2265: /* Greater than or equal */
-            {
-                letter = '>';
-                letter_2 = '=';
-            }
-            break;
+        case 0x27e9:
+            return '>';
         case 0x2264: /* Less than or equal */
-            {
-                letter = '<';
-                letter_2 = '=';
-            }
-            break;
+        case 0x27e8:
+            return '<';
         case 160: /* Non-breaking space */
         case 0x2002: /* En space */
-            letter = ' ';
-            break;
+            return ' ';
         case 0x201c:
         case 0x201d: /* Left and right double quotation mark */
-            letter = '"';
-            break;
+            return '"';
         case 0x2018:
         case 0x2019: /* Left and right single quotation mark */
-            letter = '\'';
-            break;
-        case 0x27e8:
-            letter = '<';
-            break;
-        case 0x27e9:
-            letter = '>';
-            break;
+            return '\'';
     }
 
-    if ((letter >= 0x250c) && (letter <= 0x254b))
-    {
-        letter = '+';	 /* various cross symbols */
-    }
+    if ((c >= 0x250c) && (c <= 0x254b))
+        return '+';	 /* various cross symbols */
+
+    return (c < 256) ? c : LETTER_UNKNOWN;
+}
+
+/**
+ * Add a letter to the last line of d. A letter after a backspace goes over
+ * the last one like on a terminal (see encode1() in term.c): the same one
+ * again is bold, one over '_' is italic and other ones are dim.
+ */
+static void add_letter(struct document *d, int letter, bool overstrike)
+{
+    int attr = 0;
+    int length;
+    cell_t *line = doc_last_line(d, &length);
 
-    if (letter < 256)
+    if (overstrike && (length > 0))
     {
-        int chars = (letter_2 > 0) ? 2 : 1;
-        if (s->buffer_size == 0)
+        if (CELL_CHAR(line[length - 1]) == letter)
         {
-            s->buffer = ZMALLOC(char, STARTING_SPAN_SIZE);
-            s->buffer_size = STARTING_SPAN_SIZE;
-            s->length = 0;
+            line[length - 1] |= MAKE_CELL(0, CELL_BOLD);
+            return;
         }
-        else if ((s->length + chars) >= s->buffer_size)
-        {
-            int new_buffer_size = s->buffer_size * 2;
 
-            char *old_buffer = s->buffer;
-            s->buffer = ZMALLOC(char, new_buffer_size);
-            memcpy(s->buffer, old_buffer, s->length);
-            free(old_buffer);
-            s->buffer_size = new_buffer_size;
-        }
+        attr = (CELL_CHAR(line[length - 1]) == '_') ? CELL_ITALIC : CELL_DIM;
+        doc_truncate_last_line(d, length - 1);
+    }
+
+    doc_add_cell(d, MAKE_CELL(letter, attr));
+}
 
-        s->buffer[s->length++] = letter;
-        if (letter_2 > 0)
-            s->buffer[s->length++] = letter_2;
+static struct page_source *hold_page_source(struct page_source *src)
+{
+    if (src)
+        __atomic_add_fetch(&src->refs, 1, __ATOMIC_RELAXED);
 
-    }
-    else
+    return src;
+}
+
+/* the parsed document goes with the last page formatted from it */
+static void drop_page_source(struct page_source *src)
+{
+    if (src && (__atomic_sub_fetch(&src->refs, 1, __ATOMIC_ACQ_REL) == 0))
     {
-        fprintf(stderr, "Letter %d, 0x%x\n", letter, letter);
+        mparse_free(src->parse);
+        pthread_mutex_destroy(&src->lock);
+        free(src);
     }
 }
 
-void free_span(struct span *s)
+void free_manpage(struct manpage *p)
 {
-    while (s)
+    forget_page_search(p);
+    drop_page_source(p->source);
+
+    if (p->load)
     {
-        if (s->buffer)
-            free(s->buffer);
+        /* the rest of the lines isn't wanted */
+        pthread_mutex_lock(&p->load->stream->lock);
+        p->load->stream->abandoned = true;
+        pthread_mutex_unlock(&p->load->stream->lock);
 
-        struct span *tmp = s;
-        s = s->next;
-        free(tmp);
+        p->load->shown = NULL;
     }
+
+    doc_free(&p->document);
+    sb_free(p->links);
+    doc_cache_close(&p->cache);
+    free(p);
 }
 
-void free_manpage(struct manpage *p)
+/* text of line i of p (see fold_letter()), at most line_len - 1 characters. Returns its length. */
+static int get_line_text(const struct manpage *p, int i, char *line, size_t line_len)
+{
+    const struct doc_line *l = &p->document.lines[i];
+    int length = MIN(l->length, line_len - 1);
+
+    for (int k = 0; k < length; k++)
+        line[k] = fold_letter(CELL_CHAR(l->cells[k]));
+
+    line[length] = 0;
+    return length;
+}
+
+/* number of non-blank characters in line i of p */
+static int count_line_text(const struct manpage *p, int i)
+{
+    const struct doc_line *l = &p->document.lines[i];
+    int count = 0;
+
+    for (uint32_t k = 0; k < l->length; k++)
+    {
+        if (!isspace(fold_letter(CELL_CHAR(l->cells[k]))))
+            count++;
+    }
+
+    return count;
+}
+
+/*
+ * Where line i starts in the text of p, as the number of non-blank
+ * characters before it, which doesn't depend on the line length.
+ */
+static long get_text_offset(const struct manpage *p, int i)
+{
+    long offset = 0;
+
+    for (int k = 0; (k < i) && (k < p->document.n_lines); k++)
+        offset += count_line_text(p, k);
+
+    return offset;
+}
+
+/* line of p with the character at offset (see get_text_offset()) */
+static int find_text_offset(const struct manpage *p, long offset)
 {
+    long line_start = 0;
+
     for (int i = 0; i < p->document.n_lines; i++)
-        free_span(p->document.lines[i]);
+    {
+        line_start += count_line_text(p, i);
+
+        if (line_start > offset)
+            return i;
+    }
+
+    return MAX(p->document.n_lines - 1, 0);
 }
 
 static void format_headf(struct termp *p, const struct roff_meta *meta)
@@ -775,8 +919,16 @@ static void format_footf(struct termp *p, const struct roff_meta *meta)
 
 static void format_letter(struct termp *p, int letter)
 {
-    struct span *s = get_last_span(formatting_page);
-    add_to_span(s, letter);
+    struct format_output *out = p->userdata;
+
+    if (letter == '\b')
+    {
+        out->overstrike = true;
+        return;
+    }
+
+    add_letter(&out->page->document, letter, out->overstrike);
+    out->overstrike = false;
 }
 
 static void format_begin(struct termp *p)
@@ -791,6 +943,32 @@ static void format_end(struct termp *p)
     (*p->footf)(p, p->argf);
 }
 
+/* hand the lines of out before the one being laid out over to its stream */
+static void stream_lines(struct format_output *out)
+{
+    int n_lines = out->page->document.n_lines - 1;
+
+    pthread_mutex_lock(&out->stream->lock);
+
+    bool abandoned = out->stream->abandoned;
+    if (!abandoned)
+        memcpy(sb_add(out->stream->lines, n_lines - out->n_streamed), &out->page->document.lines[out->n_streamed],
+                (n_lines - out->n_streamed) * sizeof(struct doc_line));
+
+    pthread_mutex_unlock(&out->stream->lock);
+
+    if (abandoned)
+    {
+        out->stream = NULL;
+        return;
+    }
+
+    out->n_streamed = n_lines;
+    out->chunk = MIN(out->chunk * 2, STREAM_MAX_CHUNK);
+
+    glfwPostEmptyEvent();
+}
+
 static void format_endline(struct termp *p)
 {
     //printf("%s\n", __func__);
@@ -798,19 +976,22 @@ static void format_endline(struct termp *p)
     p->tcol->offset -= p->ti;
     p->ti = 0;
 
-    add_line(formatting_page);
+    struct format_output *out = p->userdata;
+    doc_add_line(&out->page->document);
+
+    if (out->stream && ((out->page->document.n_lines - 1 - out->n_streamed) >= out->chunk))
+        stream_lines(out);
 }
 
 static void format_advance(struct termp *p, size_t len)
 {
     //printf("%s %zu\n", __func__, len);
+    struct format_output *out = p->userdata;
 
     for (int i = 0; i < len; i++)
     {
         //printf(" ");
-
-        struct span *s = get_last_span(formatting_page);
-        add_to_span(s, ' ');
+        doc_add_cell(&out->page->document, MAKE_CELL(' ', 0));
     }
 }
 
@@ -866,7 +1047,7 @@ static int format_hspan(const struct termp *p, const struct roffsu *su)
     return (r > 0.0) ? (r + 0.01) : (r - 0.01);
 }
 
-void *mangl_formatter(int width, int indent)
+void *mangl_formatter(int width, int indent, struct format_output *out)
 {
     struct termp *p = mandoc_calloc(1, sizeof(struct termp));
 
@@ -905,6 +1086,7 @@ void *mangl_formatter(int width, int indent)
     p->hspan = &format_hspan;
 
     p->ps = NULL;
+    p->userdata = out;
 
     return p;
 }
@@ -920,14 +1102,9 @@ void display_manpage_stdout(struct manpage *p)
     printf("Manpage to stdout:\n");
     for (int i = 0; i < p->document.n_lines; i++)
     {
-        struct span *s = p->document.lines[i];
-
-        while (s)
-        {
-            if (s->length > 0)
-                printf("%s", s->buffer);
-            s = s->next;
-        }
+        char line[2048];
+        get_line_text(p, i, line, sizeof(line));
+        printf("%s", line);
 
         //printf(" .END OF LINE\n");
         printf("\n");
@@ -954,7 +1131,7 @@ int get_line_height(void)
 int get_character_width(void)
 {
     if (mainFont)
-        return mainFont->chars['X'].advance;
+        return mainFont->character_advance;
 
     return FONT_CHAR_WIDTH;
 }
@@ -970,114 +1147,101 @@ int line_length_from_window_width(int window_width)
         get_character_width() - 2;
 }
 
+/* line length pages are opened at */
+int get_page_line_length(void)
+{
+    if (fit_to_window)
+        return MAX(line_length_from_window_width(window_width), MIN_LINE_LENGTH);
+
+    return settings.line_length;
+}
+
+/* fit the displayed page to the window after delay seconds */
+void want_reflow(double delay)
+{
+    if (fit_to_window)
+        reflow_time = glfwGetTime() + delay;
+}
+
 int document_height(void)
 {
     return page->document.n_lines * get_line_advance() + 2 * get_dimension(DIM_DOCUMENT_MARGIN);
 }
 
-void find_links(struct manpage *p)
+/* add the links in the lines of p from first_line on to its links */
+void find_links(struct manpage *p, int first_line)
 {
-    for (int i = 0; i < p->document.n_lines; i++)
+    for (int i = first_line; i < p->document.n_lines; i++)
     {
-        struct span *s = p->document.lines[i];
-
         char line[2048];
-        line[0] = 0;
-
-        while (s)
-        {
-            if (s->length > 0)
-            {
-                int pos = 0;
-
-                char *in = s->buffer;
+        get_line_text(p, i, line, sizeof(line));
 
-                while (*in && (pos < (ARRAY_SIZE(line) - 1)))
-                {
-                    if (*in == '\b')
-                    {
-                        if (pos > 0) pos--;
-                    }
-                    else
-                    {
-                        line[pos++] = *in;
-                    }
+        // search links
 
-                    in++;
-                }
+        char current_word[256];
+        int word_pos = 0;
+        int opening_paren = 0;
 
-                line[pos] = 0;
+        /* custom parser */
+        char *str = line;
 
-                // search links
+        while (*str)
+        {
+            if ((*str == ' ') || (*str == ',') || (*str == '\t') || (*str == '\n') || (*str == '\r'))
+            {
+                word_pos = 0;
+                opening_paren = 0;
+                str++;
+                continue;
+            }
 
-                char current_word[256];
-                int word_pos = 0;
-                int opening_paren = 0;
+            /* can't start the word with parenthesis */
+            if ((word_pos == 0) && ((*str == '(') || (*str == ')') || (*str == '|')))
+            {
+                opening_paren = 0;
+                str++;
+                continue;
+            }
 
-                /* custom parser */
-                char *str = line;
+            current_word[word_pos++] = *str;
 
-                while (*str)
+            if (*str == '(')
+                opening_paren = 1;
+            else if (*str == ')')
+            {
+                if (opening_paren)
                 {
-                    if ((*str == ' ') || (*str == ',') || (*str == '\t') || (*str == '\n') || (*str == '\r'))
-                    {
-                        word_pos = 0;
-                        opening_paren = 0;
-                        str++;
-                        continue;
-                    }
-
-                    /* can't start the word with parenthesis */
-                    if ((word_pos == 0) && ((*str == '(') || (*str == ')') || (*str == '|')))
-                    {
-                        opening_paren = 0;
-                        str++;
-                        continue;
-                    }
-
-                    current_word[word_pos++] = *str;
-
-                    if (*str == '(')
-                        opening_paren = 1;
-                    else if (*str == ')')
+                    /* word is complete */
+                    current_word[word_pos] = 0;
+                    char *man_file;
+                    if (hashmap_get(manpage_database, current_word, strlen(current_word), (void **)&man_file) == MAP_OK)
                     {
-                        if (opening_paren)
-                        {
-                            /* word is complete */
-                            current_word[word_pos] = 0;
-                            char *man_file;
-                            if (hashmap_get(manpage_database, current_word, strlen(current_word), (void **)&man_file) == MAP_OK)
-                            {
-                                char *pwd = NULL;
-                                hashmap_get(manpage_database_pwd, current_word, strlen(current_word), (void **)&pwd);
+                        char *pwd = NULL;
+                        hashmap_get(manpage_database_pwd, current_word, strlen(current_word), (void **)&pwd);
 
-                                /* we have a link */
-                                link_t l;
-                                l.document_rectangle.x = ((intptr_t)str - (intptr_t)line + 1 - strlen(current_word)) * get_character_width();
-                                l.document_rectangle.y = i * get_line_advance();
-                                l.document_rectangle.x2 = l.document_rectangle.x + strlen(current_word) * get_character_width();
-                                l.document_rectangle.y2 = l.document_rectangle.y + get_line_height();
+                        /* we have a link */
+                        link_t l;
+                        l.document_rectangle.x = ((intptr_t)str - (intptr_t)line + 1 - strlen(current_word)) * get_character_width();
+                        l.document_rectangle.y = i * get_line_advance();
+                        l.document_rectangle.x2 = l.document_rectangle.x + strlen(current_word) * get_character_width();
+                        l.document_rectangle.y2 = l.document_rectangle.y + get_line_height();
 
-                                strcpy(l.link, man_file);
-                                strcpy(l.pwd, pwd ? pwd : "");
+                        strcpy(l.link, man_file);
+                        strcpy(l.pwd, pwd ? pwd : "");
 
-                                l.highlight = 0;
-
-                                sb_push(p->links, l);
-                            }
+                        l.highlight = 0;
 
-                            word_pos = 0;
-                            opening_paren = 0;
-                            str++;
-                            continue;
-                        }
+                        sb_push(p->links, l);
                     }
 
+                    word_pos = 0;
+                    opening_paren = 0;
                     str++;
+                    continue;
                 }
-
             }
-            s = s->next;
+
+            str++;
         }
     }
 }
@@ -1095,107 +1259,192 @@ bool contains_uppercase(const char *str)
     return false;
 }
 
-void update_page_search(struct manpage *p)
+/*
+ * Both searches run on a worker thread, so typing never waits for them.
+ * Every query gets the next generation number. A search which notices a
+ * newer generation gives up, finished results of an older one are dropped
+ * by poll_search_results(). Until then the previous results stay visible.
+ */
+struct page_search_hit {
+    int line;
+    int column;
+};
+
+struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool started;
+
+    /* page name search, the search levels belong to the worker */
+    unsigned name_generation; /* also read without the lock by running searches */
+    bool name_pending;
+    bool name_running;
+    bool name_paused; /* while the catalogue changes */
+    bool name_reset_levels;
+    char name_term[512];
+    int name_mode;
+    struct match *name_results; /* stretchy buffer, a heap like matches_heap */
+    unsigned name_results_generation;
+    bool name_results_ready;
+
+    /* search within a page */
+    unsigned page_generation;
+    bool page_pending;
+    struct manpage *page_target;
+    struct manpage *page_running; /* page being searched right now */
+    char page_term[256];
+    struct page_search_hit page_hits[MAX_PAGE_SEARCHES];
+    int page_n_hits;
+    struct manpage *page_results_target;
+    unsigned page_results_generation;
+    bool page_results_ready;
+
+    /* chunks of a long name search, shared with the chunk workers */
+    int n_chunk_workers;
+    struct search_chunk *chunks; /* NULL while there is no such search */
+    int n_chunks;
+    int next_chunk;
+    int chunks_done;
+} search_worker = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static bool search_cancelled(unsigned *generation, unsigned search_generation)
 {
-    p->search_num = 0;
-    p->search_index = 0;
-    int search_index_set = 0;
+    return __atomic_load_n(generation, __ATOMIC_RELAXED) != search_generation;
+}
 
-    if (strlen(p->search_string) == 0)
-        return;
+static void run_pending_searches(void);
 
-    int search_len = strlen(p->search_string);
+/* matches of term in the lines of p, false if a newer search cancelled it */
+static bool find_page_search_hits(struct manpage *p, const char *term, unsigned generation,
+        struct page_search_hit *hits, int *n_hits)
+{
+    int search_len = strlen(term);
+    int ignore_case = !contains_uppercase(term);
 
-    int ignore_case = 1;
+    *n_hits = 0;
 
-    if (contains_uppercase(p->search_string))
+    for (int i = 0; i < p->document.n_lines; i++)
     {
-        ignore_case = 0;
-    }
-
-    for (int i = 0; i < p->document.n_lines; i++)
-    {
-        struct span *s = p->document.lines[i];
+        if (((i % 64) == 0) && search_cancelled(&search_worker.page_generation, generation))
+            return false;
 
         char line[2048];
-        int pos = 0;
-        line[0] = 0;
+        int pos = get_line_text(p, i, line, sizeof(line));
+
+        /* search the current line */
+        char *str = line;
 
-        while (s)
+        for (;;)
         {
-            if (s->length > 0)
-            {
-                char *in = s->buffer;
+            long found = strsearch_find(str, &line[pos] - str, term, search_len, ignore_case);
+            if (found < 0)
+                break;
 
-                while (*in && (pos < (ARRAY_SIZE(line) - 1)))
-                {
-                    if (*in == '\b')
-                    {
-                        if (pos > 0) pos--;
-                    }
-                    else
-                    {
-                        line[pos++] = *in;
-                    }
+            /* we have a match */
+            str += found;
 
-                    in++;
-                }
+            hits[*n_hits].line = i;
+            hits[*n_hits].column = str - line;
+            (*n_hits)++;
 
-            }
-            s = s->next;
+            if (*n_hits >= MAX_PAGE_SEARCHES)
+                return true;
+
+            str += search_len;
         }
+    }
 
-        line[pos] = 0;
+    return true;
+}
 
-        {
-            /* search the current line */
-            char *str = line;
+/**
+ * Start searching the page for its search string. The results are taken
+ * over by poll_search_results().
+ */
+void update_page_search(struct manpage *p)
+{
+    p->search_extended = false;
 
-            while (*str)
-            {
-                if ((ignore_case && (strncasecmp(str, p->search_string, search_len) == 0)) ||
-                        (strncmp(str, p->search_string, search_len) == 0))
-                {
-                    /* we have a match */
-                    search_t *s = &p->searches[p->search_num];
+    pthread_mutex_lock(&search_worker.lock);
 
-                    s->document_rectangle.x = ((intptr_t)str - (intptr_t)line) * get_character_width();
-                    s->document_rectangle.y = i * get_line_advance();
-                    s->document_rectangle.x2 = s->document_rectangle.x + strlen(p->search_string) * get_character_width();
-                    s->document_rectangle.y2 = s->document_rectangle.y + get_line_height();
+    __atomic_add_fetch(&search_worker.page_generation, 1, __ATOMIC_RELAXED);
+    search_worker.page_results_ready = false;
+    search_worker.page_pending = strlen(p->search_string) > 0;
 
-                    if ((s->document_rectangle.y + get_dimension(DIM_DOCUMENT_MARGIN)) >= p->search_start_scroll_position)
-                    {
-                        if (search_index_set == 0)
-                            p->search_index = p->search_num;
-                        search_index_set = 1;
-                    }
+    if (search_worker.page_pending)
+    {
+        search_worker.page_target = p;
+        snprintf(search_worker.page_term, sizeof(search_worker.page_term), "%s", p->search_string);
+        pthread_cond_broadcast(&search_worker.cond);
+    }
 
-                    p->search_num++;
+    pthread_mutex_unlock(&search_worker.lock);
 
-                    if (p->search_num >= ARRAY_SIZE(p->searches))
-                    {
-                        if (search_index_set == 0)
-                            p->search_index = 0;
-                        return;
-                    }
+    if (strlen(p->search_string) == 0)
+    {
+        p->search_num = 0;
+        p->search_index = 0;
+    }
 
-                    str += strlen(p->search_string);
-                }
-                else
-                {
-                    str++;
-                }
-            }
+    run_pending_searches();
+}
 
-            if (p->search_num >= ARRAY_SIZE(p->searches))
-            {
-                if (search_index_set == 0)
-                    p->search_index = 0;
-                return;
-            }
-        }
+/**
+ * p got more lines, search them too. dropped says if a search of p was
+ * dropped for that (see forget_page_search()), which is started again.
+ */
+static void extend_page_search(struct manpage *p, bool dropped)
+{
+    bool extended = dropped && p->search_extended; /* the dropped one was such a search */
+
+    if ((dropped && !extended) || ((p == page) && p->search_input_active))
+    {
+        update_page_search(p);
+    }
+    else if (extended || ((p == page) && p->search_visible && p->search_string[0] && (p->search_num < MAX_PAGE_SEARCHES)))
+    {
+        update_page_search(p);
+        p->search_extended = true;
+    }
+}
+
+/**
+ * The page is about to be freed or its lines change, make sure no search
+ * is looking at it. Returns true if a search of it was dropped.
+ */
+static bool forget_page_search(struct manpage *p)
+{
+    bool dropped = false;
+
+    pthread_mutex_lock(&search_worker.lock);
+
+    if (search_worker.page_target == p)
+    {
+        dropped = search_worker.page_pending;
+        search_worker.page_pending = false;
+        search_worker.page_target = NULL;
+    }
+
+    if (search_worker.page_results_target == p)
+    {
+        dropped = dropped || search_worker.page_results_ready;
+        search_worker.page_results_ready = false;
+    }
+
+    if (search_worker.page_running == p)
+    {
+        __atomic_add_fetch(&search_worker.page_generation, 1, __ATOMIC_RELAXED);
+        while (search_worker.page_running == p)
+            pthread_cond_wait(&search_worker.cond, &search_worker.lock);
+        dropped = true;
     }
+
+    pthread_mutex_unlock(&search_worker.lock);
+
+    return dropped;
 }
 
 void update_scrollbar(void)
@@ -1237,6 +1486,10 @@ void window_refresh_func(GLFWwindow *window)
 
 void framebuffer_size_func(GLFWwindow *window, int w, int h)
 {
+    /* not when it's minimized */
+    if ((w != window_width) && (w > 0))
+        want_reflow(REFLOW_DELAY);
+
     window_width = w;
     window_height = h;
 
@@ -1341,75 +1594,145 @@ PQRSTUVWXYZ[\]^_
 pqrstuvwxyz{|}~
 */
 
-int put_char_gl(int x, int y, char c)
+/* glyph of code point c in a loaded font, rasterised into its texture if it isn't there */
+static const struct atlas_glyph *get_glyph(FontData *font, int c)
+{
+    struct atlas_glyph *g = atlas_find(&font->atlas, c);
+    if (g && (g->missing || (g->shelf >= 0) || (g->width == 0) || (g->height == 0)))
+        return g;
+
+    if (g == NULL)
+        g = atlas_add(&font->atlas, c);
+
+    int glyph_index = FT_Get_Char_Index(font->face, c);
+    if ((glyph_index == 0) || FT_Load_Glyph(font->face, glyph_index, FT_LOAD_DEFAULT) ||
+            FT_Render_Glyph(font->face->glyph, FT_RENDER_MODE_NORMAL))
+    {
+        g->missing = true;
+        return g;
+    }
+
+    FT_Bitmap *bmp = &font->face->glyph->bitmap;
+
+    g->width = bmp->width;
+    g->height = bmp->rows;
+    g->left = font->face->glyph->bitmap_left;
+    g->top = font->face->glyph->bitmap_top;
+    g->advance = font->face->glyph->advance.x / 64;
+
+    if ((g->width == 0) || (g->height == 0) || !atlas_place(&font->atlas, g))
+        return g;
+
+    /* with the empty pixels around it, which may still hold parts of a glyph removed from the atlas */
+    int w = g->width + 2 * ATLAS_PADDING;
+    int h = g->height + 2 * ATLAS_PADDING;
+    uint8_t *pixels = ZMALLOC(uint8_t, w * h);
+
+    if (bmp->pixel_mode == FT_PIXEL_MODE_GRAY)
+        copy_bitmap(pixels, w, h, ATLAS_PADDING, ATLAS_PADDING, bmp->buffer, g->width, g->height, bmp->pitch);
+    else if (bmp->pixel_mode == FT_PIXEL_MODE_MONO)
+        copy_bitmap_1bit(pixels, w, h, ATLAS_PADDING, ATLAS_PADDING, bmp->buffer, g->width, g->height, bmp->pitch);
+    else
+        fprintf(stderr, "Unsupported pixel mode (not 8 bit or 1 bit)\n");
+
+    glBindTexture(GL_TEXTURE_2D, font->texture_id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, g->x - ATLAS_PADDING, g->y - ATLAS_PADDING, w, h, GL_ALPHA, GL_UNSIGNED_BYTE, pixels);
+    free(pixels);
+
+    return g;
+}
+
+/* where code point c is in the texture of font, false if it can't be drawn */
+static bool get_char_description(FontData *font, int c, CharDescription *cd)
+{
+    if (font->face == NULL)
+    {
+        if ((c < 32) || (c >= 128) || !font->chars[c].available)
+            return false;
+
+        *cd = font->chars[c];
+        return true;
+    }
+
+    if (c < 32)
+        return false;
+
+    const struct atlas_glyph *g = get_glyph(font, c);
+    if (g->missing || ((g->shelf < 0) && (g->width > 0) && (g->height > 0)))
+        return false;
+
+    const float pixel_x = 1.0f / font->bitmap_width;
+    const float pixel_y = 1.0f / font->bitmap_height;
+
+    cd->available = 1;
+    cd->width = g->width;
+    cd->height = g->height;
+    cd->top = g->top;
+    cd->left = g->left;
+    cd->advance = g->advance;
+    cd->tex_coord0_x = pixel_x * g->x;
+    cd->tex_coord0_y = pixel_y * g->y;
+    cd->tex_coord1_x = pixel_x * (g->x + g->width);
+    cd->tex_coord1_y = pixel_y * (g->y + g->height);
+
+    if (g->shelf >= 0)
+        atlas_use(&font->atlas, g);
+
+    return true;
+}
+
+/* draw code point c, a look-alike (see fold_letter()) or a box if the font doesn't have it */
+int put_char_gl(int x, int y, int c)
 {
     int ret = 0;
     int w = FONT_CHAR_WIDTH;
     int h = FONT_CHAR_HEIGHT;
 
+    CharDescription cd;
+    bool available = get_char_description(mainFont, c, &cd);
+    bool folded = false;
+
+    if (!available && (fold_letter(c) != c))
+        available = folded = get_char_description(mainFont, fold_letter(c), &cd);
+
     glBindTexture(GL_TEXTURE_2D, mainFont->texture_id);
     glEnable(GL_BLEND);
     glEnable(GL_TEXTURE_2D);
 
-    if (c < 32)
-    {
-        // unknown character
-        glDisable(GL_BLEND);
-        draw_rectangle_outline(x + 1, y + 1, w - 2, h - 2);
-        glEnable(GL_BLEND);
-    }
-    else
+    if (available)
     {
-#if 0
-        static const float pixel = 1.0f / FONT_TEXTURE_SIZE;
-
-        c -= 32;
-
-        char c_line = c / 16;
-        char c_pos = c % 16;
+        int x_start = x + cd.left;
+        int y_start = y - cd.top + mainFont->character_height + 2;
 
         glBegin(GL_QUADS);
-        glTexCoord2f(c_pos * pixel * w, c_line * h * pixel); glVertex2f(x, y);
-        glTexCoord2f(c_pos * pixel * w, (c_line + 1) * h * pixel); glVertex2f(x, y + h);
-        glTexCoord2f((c_pos + 1) * pixel * w, (c_line + 1) * h * pixel); glVertex2f(x + w, y + h);
-        glTexCoord2f((c_pos + 1) * pixel * w, c_line * h * pixel); glVertex2f(x + w, y);
+        glTexCoord2f(cd.tex_coord0_x, cd.tex_coord0_y);
+        glVertex2f(x_start, y_start);
+        glTexCoord2f(cd.tex_coord0_x, cd.tex_coord1_y);
+        glVertex2f(x_start, y_start + cd.height);
+        glTexCoord2f(cd.tex_coord1_x, cd.tex_coord1_y);
+        glVertex2f(x_start + cd.width, y_start + cd.height);
+        glTexCoord2f(cd.tex_coord1_x, cd.tex_coord0_y);
+        glVertex2f(x_start + cd.width, y_start);
         glEnd();
 
-        ret = w;
-#else
-        int idx = (int)c;
-        if (mainFont->chars[idx].available)
-        {
-            int w = mainFont->chars[idx].width;
-            int h = mainFont->chars[idx].height;
-            int x_start = x + mainFont->chars[idx].left;
-            int y_start = y - mainFont->chars[idx].top + mainFont->character_height + 2;
-
-            glBegin(GL_QUADS);
-            glTexCoord2f(mainFont->chars[idx].tex_coord0_x, mainFont->chars[idx].tex_coord0_y);
-            glVertex2f(x_start, y_start);
-            glTexCoord2f(mainFont->chars[idx].tex_coord0_x, mainFont->chars[idx].tex_coord1_y);
-            glVertex2f(x_start, y_start + h);
-            glTexCoord2f(mainFont->chars[idx].tex_coord1_x, mainFont->chars[idx].tex_coord1_y);
-            glVertex2f(x_start + w, y_start + h);
-            glTexCoord2f(mainFont->chars[idx].tex_coord1_x, mainFont->chars[idx].tex_coord0_y);
-            glVertex2f(x_start + w, y_start);
-            glEnd();
-
-            ret = mainFont->chars[idx].advance;
-        }
-        else
-        {
-            glDisable(GL_BLEND);
-            draw_rectangle_outline(x + 1, y + 1, w - 2, h - 2);
-            glEnable(GL_BLEND);
-            ret = mainFont->character_width;
-        }
-#endif
+        ret = cd.advance;
+    }
+    else
+    {
+        // unknown character
+        glDisable(GL_BLEND);
+        draw_rectangle_outline(x + 1, y + 1, w - 2, h - 2);
+        glEnable(GL_BLEND);
+        ret = (c < 32) ? 0 : mainFont->character_width;
     }
 
     glDisable(GL_BLEND);
 
+    /* without less or greater than or equal, draw < or > over _ */
+    if (folded && ((c == 0x2264) || (c == 0x2265)))
+        put_char_gl(x, y, '_');
+
     return ret;
 }
 
@@ -1422,45 +1745,35 @@ void print_text_gl(int x, int y, const char *str)
     }
 }
 
-size_t draw_string_manpage(const char *str, int x, int y)
+/* draw a line of a page, in the color of the attributes of each cell */
+void draw_line_manpage(const struct doc_line *line, int x, int y)
 {
-    set_color(COLOR_INDEX_FOREGROUND);
-    size_t count = 0;
-    while (*str)
-    {
-        int color_set = 0;
-        if (str[1] == '\b') /* next character is backspace */
-        {
-            if (str[2] == str[0])
-            {
-                set_color(COLOR_INDEX_BOLD);
-            }
-            else if (str[0] == '_')
-            {
-                set_color(COLOR_INDEX_ITALIC);
-            }
-            else
-            {
-                set_color(COLOR_INDEX_DIM);
-            }
+    int color = COLOR_INDEX_FOREGROUND;
+    set_color(color);
 
-            str += 2;
-            color_set = 1;
-            if (*str == '\0')
-                break;
-        }
+    for (uint32_t k = 0; k < line->length; k++)
+    {
+        int attr = CELL_ATTR(line->cells[k]);
+        int cell_color = COLOR_INDEX_FOREGROUND;
 
-        count++;
-        x += put_char_gl(x, y, *str);
+        if (attr & CELL_ITALIC)
+            cell_color = COLOR_INDEX_ITALIC;
+        else if (attr & CELL_BOLD)
+            cell_color = COLOR_INDEX_BOLD;
+        else if (attr & CELL_DIM)
+            cell_color = COLOR_INDEX_DIM;
 
-        if (color_set)
+        if (cell_color != color)
         {
-            set_color(COLOR_INDEX_FOREGROUND);
+            color = cell_color;
+            set_color(color);
         }
-        str++;
+
+        put_char_gl(x, y, CELL_CHAR(line->cells[k]));
+        x += get_character_width();
     }
 
-    return count;
+    set_color(COLOR_INDEX_FOREGROUND);
 }
 
 size_t draw_string(const char *str, int x, int y)
@@ -1525,32 +1838,26 @@ void upload_font_textures(void)
 
     if (loadedFont)
     {
-        add_gl_texture_monochrome(&loadedFont->texture_id, loadedFont->bitmap_width, loadedFont->bitmap_height, loadedFont->bitmap);
+        /* empty, the glyphs are put there as they are drawn */
+        uint8_t *empty = ZMALLOC(uint8_t, loadedFont->bitmap_width * loadedFont->bitmap_height);
+        add_gl_texture_monochrome(&loadedFont->texture_id, loadedFont->bitmap_width, loadedFont->bitmap_height, empty);
+        free(empty);
     }
 }
 
 void render_manpage(struct manpage *p)
 {
-    int vertical_position = 0;
+    /* the lines all have the same height, start at the first visible one */
+    int first_line = MAX((page->scroll_position - get_dimension(DIM_DOCUMENT_MARGIN)) / get_line_advance() - 1, 0);
+    int vertical_position = first_line * get_line_advance();
 
-    for (int i = 0; i < p->document.n_lines; i++)
+    for (int i = first_line; i < p->document.n_lines; i++)
     {
-        struct span *s = p->document.lines[i];
-
         if ((vertical_position >= (page->scroll_position - get_line_advance() - get_dimension(DIM_DOCUMENT_MARGIN))) &&
                 ((vertical_position - get_line_advance()) < (page->scroll_position + window_height)))
         {
-            int num_chars = 0;
-            while (s)
-            {
-                if (s->length > 0)
-                {
-                    num_chars += draw_string_manpage(s->buffer,
-                            get_dimension(DIM_DOCUMENT_MARGIN) + num_chars * get_character_width(),
-                            get_dimension(DIM_DOCUMENT_MARGIN) + vertical_position - page->scroll_position);
-                }
-                s = s->next;
-            }
+            draw_line_manpage(&p->document.lines[i], get_dimension(DIM_DOCUMENT_MARGIN),
+                    get_dimension(DIM_DOCUMENT_MARGIN) + vertical_position - page->scroll_position);
         }
 
         vertical_position += get_line_advance();
@@ -1562,167 +1869,810 @@ void render_manpage(struct manpage *p)
 
 int find_string(const char *search_term, const char *text)
 {
-    int search_len = strlen(search_term);
-    int text_len = strlen(text);
+    return strsearch_find(text, strlen(text), search_term, strlen(search_term), 0);
+}
+
+/* ties go to the later name, as they always did */
+static bool match_is_better(const struct match *a, const struct match *b)
+{
+    return (a->goodness > b->goodness) || ((a->goodness == b->goodness) && (a->idx > b->idx));
+}
 
-    for (int i = 0; i < (text_len - search_len); i++)
+static void sift_down_match(struct match *heap, int count, int i)
+{
+    for (;;)
     {
-        bool match = true;
-        for (int j = 0; j < search_len; j++)
-        {
-            if (search_term[j] != text[i + j])
-            {
-                match = false;
-                break;
-            }
-        }
+        int best = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
 
-        if (match)
-            return i;
-    }
+        if ((left < count) && match_is_better(&heap[left], &heap[best]))
+            best = left;
+        if ((right < count) && match_is_better(&heap[right], &heap[best]))
+            best = right;
 
-    return -1;
-}
+        if (best == i)
+            return;
 
-int compar_match_rev(const void *a, const void *b)
-{
-    return ((const int *)b)[1] - ((const int *)a)[1];
+        struct match tmp = heap[i];
+        heap[i] = heap[best];
+        heap[best] = tmp;
+        i = best;
+    }
 }
 
-int binary_search_first(const void *key, const void *data, size_t nmemb, size_t size, int (*compar)(const void *, const void *))
+/**
+ * Result at position i (0 is the best one), i must be less than matches_count.
+ * Results are moved from the heap into the ordered list as they are needed,
+ * so only the part of the list which is displayed gets sorted.
+ */
+const struct match *get_match(int i)
 {
-    /* ordering is assumed ascending - so compar(el_0, el_1) <= 0 for any two subsequent elements */
-    if (nmemb <= 0)
-        return 0;
+    while (sb_count(matches_ordered) <= i)
+    {
+        int count = sb_count(matches_heap);
 
-    int start = 0;
-    int end = nmemb - 1;
+        sb_push(matches_ordered, matches_heap[0]);
 
-    const unsigned char *u8_data = (const unsigned char *)data;
+        matches_heap[0] = matches_heap[count - 1];
+        stb__sbn(matches_heap)--;
+        sift_down_match(matches_heap, count - 1, 0);
+    }
 
-    int c_start = compar(key, &u8_data[0]);
-    int c_end = compar(key, &u8_data[(nmemb - 1) * size]);
+    return &matches_ordered[i];
+}
 
-    if (c_start <= 0)
-        return 0;
+/* man(1) looks the sections up in this order, earlier ones win ties */
+static int section_rank(const char *name)
+{
+    static const char order[] = "1nl830254967";
 
-    if (c_end > 0)
-        return nmemb;
+    const char *section = strrchr(name, '(');
+    if ((section == NULL) || (section[1] == '\0'))
+        return 2 * (sizeof(order) - 1);
 
-    while (end > (start + 1))
-    {
-        int mid = (end + start) / 2;
-        int c = compar(key, &u8_data[mid * size]);
-        //printf("start %d mid %d end %d, mid comp = %d\n", start, mid, end, c);
+    const char *found = strchr(order, section[1]);
+    if (found == NULL)
+        return 2 * (sizeof(order) - 1);
 
-        if (c <= 0) /* end will contain the matching field */
-        {
-            end = mid;
-        }
-        else if (c > 0)
-        {
-            start = mid;
-        }
-    }
-    //printf("start %d end %d \n", start, end);
+    /* 3p, 1ssl, ... after the plain section */
+    int subsection = (section[2] != ')') ? 1 : 0;
 
-    return end;
+    return 2 * (found - order) + subsection;
 }
 
-void insert_array(const void *key, int index, void *data, size_t nmemb, size_t size)
+/* fuzzy score first, then the shorter name, then the section */
+static int fuzzy_goodness(int score, const char *name)
 {
-    if (index < 0)
-        return;
+    const char *section = strrchr(name, '(');
+    size_t len = section ? (size_t)(section - name) : strlen(name);
 
-    if (index >= nmemb)
-        return;
+    return score * 4096 - (int)MIN(len, 127) * 32 - section_rank(name);
+}
+
+/*
+ * A search term starting with ' looks for the rest of the term as a
+ * substring, like in fzf. Otherwise the term is matched fuzzily.
+ */
+static bool is_exact_search(const char *term)
+{
+    return term[0] == '\'';
+}
+
+/**
+ * All names matching each prefix of the search term typed so far. Extending
+ * the term only has to filter the names of the previous one (the match is
+ * case insensitive for lowercase terms, so a longer term or one with
+ * uppercase characters matches a subset), deleting characters goes back
+ * to a stored level.
+ */
+struct search_level {
+    char term[512];
+    int32_t *names; /* stretchy buffer of name indices */
+    int32_t *goodness; /* how well the term matches each name */
+};
 
-    unsigned char *u8_data = (unsigned char *)data;
+struct search_level *search_levels;
 
-    for (int i = (nmemb - 2); i >= index; i--)
+void clear_search_levels(void)
+{
+    for (int i = 0; i < sb_count(search_levels); i++)
     {
-        memcpy(&u8_data[(i + 1) * size], &u8_data[i * size], size);
+        sb_free(search_levels[i].names);
+        sb_free(search_levels[i].goodness);
     }
 
-    memcpy(&u8_data[index * size], key, size); /* copy element */
+    sb_free(search_levels);
+    search_levels = NULL;
 }
 
-void update_search(void)
+static bool term_has_uppercase(const char *term)
 {
-    int search_term_len = strlen(search_term);
+    for (const char *c = term; *c; c++)
+    {
+        if (isupper(*c))
+            return true;
+    }
 
-    memset(matches, 0, sizeof(matches));
-    matches_count = 0;
+    return false;
+}
 
-    results_view_offset = 0;
-    results_selected_index = 0;
+#define MAX_SEARCH_THREADS 8
+#define PARALLEL_SEARCH_MIN_COUNT 8192
+
+struct search_chunk {
+    const char *term;
+    unsigned generation;
+    const int32_t *candidates; /* name indices, NULL for all names */
+    int begin;
+    int end;
+    int32_t *names; /* stretchy buffers of the matches */
+    int32_t *goodness;
+    bool cancelled;
+};
 
-    if (search_term_len == 0)
+#define SEARCH_CANCEL_CHECK_INTERVAL 1024
+
+static bool search_chunk_cancelled(struct search_chunk *chunk, int k)
+{
+    if ((((k - chunk->begin) % SEARCH_CANCEL_CHECK_INTERVAL) == 0) &&
+            search_cancelled(&search_worker.name_generation, chunk->generation))
     {
-        return;
+        chunk->cancelled = true;
     }
-    else
-    {
-        int search_uppercase_characters = 0;
 
-        for (const char *c = search_term; *c; c++)
-        {
-            if (isupper(*c))
-            {
-                search_uppercase_characters = 1;
-                break;
-            }
-        }
+    return chunk->cancelled;
+}
 
-        char **manpage_names_chosen = search_uppercase_characters ? manpage_names : manpage_names_lower;
+static void match_search_chunk(struct search_chunk *chunk)
+{
+    bool case_sensitive = term_has_uppercase(chunk->term);
 
-        int count = sb_count(manpage_names_chosen);
+    if (is_exact_search(chunk->term))
+    {
+        const char *term = &chunk->term[1];
+        int term_len = strlen(term);
+        char **manpage_names_chosen = case_sensitive ? manpage_names : manpage_names_lower;
 
-        for (int i = 0; i < count; i++)
+        for (int k = chunk->begin; k < chunk->end; k++)
         {
-            int position = find_string(search_term, manpage_names_chosen[i]);
+            if (search_chunk_cancelled(chunk, k))
+                break;
 
+            int i = chunk->candidates ? chunk->candidates[k] : k;
+            int position = find_string(term, manpage_names_chosen[i]);
             if (position >= 0)
             {
-                int goodness = -position * 100 - (strlen(manpage_names_chosen[i]) - search_term_len);
+                sb_push(chunk->names, i);
+                sb_push(chunk->goodness, -position * 100 - ((int)strlen(manpage_names_chosen[i]) - term_len));
+            }
+        }
+    }
+    else
+    {
+        for (int k = chunk->begin; k < chunk->end; k++)
+        {
+            if (search_chunk_cancelled(chunk, k))
+                break;
 
-                int key[2] = {i, goodness};
+            int i = chunk->candidates ? chunk->candidates[k] : k;
+            int score = fuzzy_match(chunk->term, manpage_names[i], case_sensitive);
+            if (score != FUZZY_NO_MATCH)
+            {
+                sb_push(chunk->names, i);
+                sb_push(chunk->goodness, fuzzy_goodness(score, manpage_names[i]));
+            }
+        }
+    }
+}
 
-                int index = binary_search_first(key, matches, matches_count, sizeof(matches[0]), &compar_match_rev);
+/* match the chunks of the current search until none is left, called with the lock held */
+static void take_search_chunks(void)
+{
+    while (search_worker.chunks && (search_worker.next_chunk < search_worker.n_chunks))
+    {
+        struct search_chunk *chunk = &search_worker.chunks[search_worker.next_chunk++];
+        pthread_mutex_unlock(&search_worker.lock);
 
-                if (index < ARRAY_SIZE(matches))
-                {
-                    insert_array(key, index, matches,  ARRAY_SIZE(matches), sizeof(matches[0]));
+        match_search_chunk(chunk);
 
-                    if (matches_count < ARRAY_SIZE(matches))
-                        matches_count++;
-                }
-            }
-        }
+        pthread_mutex_lock(&search_worker.lock);
+        if (++search_worker.chunks_done == search_worker.n_chunks)
+            pthread_cond_broadcast(&search_worker.cond);
     }
 }
 
-int get_left_margin()
+/* helps the search worker with long name searches, started once next to it */
+static void *search_chunk_worker(void *arg)
 {
-    return (window_width > fitting_window_width()) ? (window_width - fitting_window_width()) / 2 : 0;
+    pthread_mutex_lock(&search_worker.lock);
+
+    for (;;)
+    {
+        take_search_chunks();
+        pthread_cond_wait(&search_worker.cond, &search_worker.lock);
+    }
+
+    return NULL;
 }
 
-void render(void)
+/**
+ * Match the term against count names (candidates[0..count) or the first
+ * count names). Long lists are split into chunks which the chunk workers
+ * match along with the calling thread, the results are joined in the
+ * order of the chunks. Returns false if a newer search cancelled this one.
+ */
+static bool search_names(struct search_level *level, unsigned generation, const int32_t *candidates, int count)
 {
-    glClearColor(color_table[COLOR_INDEX_BACKGROUND][0], color_table[COLOR_INDEX_BACKGROUND][1], color_table[COLOR_INDEX_BACKGROUND][2], 1.0);
-    glClear(GL_COLOR_BUFFER_BIT);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glBlendEquation(GL_FUNC_ADD);
+    int n_chunks = (count >= PARALLEL_SEARCH_MIN_COUNT) ? search_worker.n_chunk_workers + 1 : 1;
 
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-    glDisable(GL_BLEND);
+    struct search_chunk chunks[MAX_SEARCH_THREADS];
+    int chunk_size = (count + n_chunks - 1) / n_chunks;
 
-    switch (display_mode)
+    for (int i = 0; i < n_chunks; i++)
     {
-        case D_MANPAGE:
-            {
-                /* draw manpage (text etc.) centered if window wider than necessary */
+        chunks[i].term = level->term;
+        chunks[i].generation = generation;
+        chunks[i].candidates = candidates;
+        chunks[i].begin = MIN(i * chunk_size, count);
+        chunks[i].end = MIN(chunks[i].begin + chunk_size, count);
+        chunks[i].names = NULL;
+        chunks[i].goodness = NULL;
+        chunks[i].cancelled = false;
+    }
+
+    if (n_chunks == 1)
+    {
+        match_search_chunk(&chunks[0]);
+    }
+    else
+    {
+        pthread_mutex_lock(&search_worker.lock);
+
+        search_worker.chunks = chunks;
+        search_worker.n_chunks = n_chunks;
+        search_worker.next_chunk = 0;
+        search_worker.chunks_done = 0;
+        pthread_cond_broadcast(&search_worker.cond);
+
+        take_search_chunks();
+
+        while (search_worker.chunks_done < n_chunks)
+            pthread_cond_wait(&search_worker.cond, &search_worker.lock);
+
+        search_worker.chunks = NULL;
+
+        pthread_mutex_unlock(&search_worker.lock);
+    }
+
+    bool cancelled = false;
+
+    for (int i = 0; i < n_chunks; i++)
+    {
+        cancelled = cancelled || chunks[i].cancelled;
+
+        int n = sb_count(chunks[i].names);
+        if (!cancelled && (n > 0))
+        {
+            memcpy(sb_add(level->names, n), chunks[i].names, n * sizeof(int32_t));
+            memcpy(sb_add(level->goodness, n), chunks[i].goodness, n * sizeof(int32_t));
+        }
+
+        sb_free(chunks[i].names);
+        sb_free(chunks[i].goodness);
+    }
+
+    return !cancelled;
+}
+
+/* names matching term, computed from the longest stored prefix, NULL if cancelled */
+/**
+ * Trigram index of the names, built the first time an exact search needs
+ * it (by the search worker, the main thread only replaces it while name
+ * searches are paused).
+ */
+static const struct trigram_index *get_manpage_trigrams(void)
+{
+    if ((manpage_trigrams == NULL) && (sb_count(manpage_names) > 0))
+        manpage_trigrams = trigram_index_build(manpage_names_lower, sb_count(manpage_names));
+
+    return manpage_trigrams;
+}
+
+static const struct search_level *get_search_level(const char *term, unsigned generation)
+{
+    while (sb_count(search_levels) > 0)
+    {
+        const char *prefix = sb_last(search_levels).term;
+        if (strncmp(term, prefix, strlen(prefix)) == 0)
+            break;
+
+        sb_free(sb_last(search_levels).names);
+        sb_free(sb_last(search_levels).goodness);
+        stb__sbn(search_levels)--;
+    }
+
+    if ((sb_count(search_levels) > 0) && (strcmp(sb_last(search_levels).term, term) == 0))
+        return &sb_last(search_levels);
+
+    struct search_level level;
+    snprintf(level.term, sizeof(level.term), "%s", term);
+    level.names = NULL;
+    level.goodness = NULL;
+
+    bool done;
+
+    if (sb_count(search_levels) > 0)
+    {
+        const struct search_level *prev = &sb_last(search_levels);
+        done = search_names(&level, generation, prev->names, sb_count(prev->names));
+    }
+    else if (is_exact_search(term) && get_manpage_trigrams())
+    {
+        /* only names with all trigrams of the term can contain it, the index is case insensitive */
+        char term_lower[512];
+        snprintf(term_lower, sizeof(term_lower), "%s", &term[1]);
+        for (char *c = term_lower; *c; c++)
+            *c = tolower(*c);
+
+        int32_t *candidates = NULL;
+        int count = trigram_index_query(manpage_trigrams, term_lower, &candidates);
+
+        if (count >= 0)
+            done = search_names(&level, generation, candidates, count);
+        else
+            done = search_names(&level, generation, NULL, sb_count(manpage_names));
+
+        free(candidates);
+    }
+    else
+    {
+        done = search_names(&level, generation, NULL, sb_count(manpage_names));
+    }
+
+    if (!done)
+    {
+        sb_free(level.names);
+        sb_free(level.goodness);
+        return NULL;
+    }
+
+    sb_push(search_levels, level);
+    return &sb_last(search_levels);
+}
+
+/* name index of every page of manpage_fulltext, built by the search worker when needed */
+int32_t *fulltext_doc_names;
+
+static void clear_fulltext_doc_names(void)
+{
+    sb_free(fulltext_doc_names);
+    fulltext_doc_names = NULL;
+}
+
+static void map_fulltext_doc_names(void)
+{
+    int n_docs = fulltext_doc_count(&manpage_fulltext);
+    map_t files = hashmap_new(); /* file -> name index + 1, the first name of a file wins */
+
+    for (int i = sb_count(manpage_names) - 1; i >= 0; i--)
+    {
+        const char *key = manpage_names[i];
+        char *file = NULL;
+        if (hashmap_get(manpage_database, key, strlen(key), (void **)&file) == MAP_OK)
+            hashmap_put(files, file, strlen(file), (void *)(intptr_t)(i + 1));
+    }
+
+    int32_t *names = sb_add(fulltext_doc_names, n_docs + 1);
+
+    for (int d = 0; d < n_docs; d++)
+    {
+        const char *file = fulltext_doc_file(&manpage_fulltext, d);
+        void *value = NULL;
+
+        if (hashmap_get(files, file, strlen(file), &value) == MAP_OK)
+            names[d] = (intptr_t)value - 1;
+        else
+            names[d] = -1; /* no longer in the catalogue */
+    }
+
+    hashmap_free(files);
+}
+
+/* runs on the search worker: pages containing the words of term as a heap */
+static bool find_fulltext_matches(const char *term, struct match **heap_out)
+{
+    *heap_out = NULL;
+
+    if (manpage_fulltext.map == NULL)
+        return true;
+
+    if (fulltext_doc_names == NULL)
+        map_fulltext_doc_names();
+
+    struct fulltext_hit *hits = NULL;
+    int count = fulltext_query(&manpage_fulltext, term, &hits);
+
+    struct match *heap = NULL;
+
+    for (int k = 0; k < count; k++)
+    {
+        int idx = fulltext_doc_names[hits[k].doc];
+        if (idx < 0)
+            continue;
+
+        struct match m = { idx, hits[k].score, hits[k].doc, hits[k].position };
+        sb_push(heap, m);
+    }
+
+    free(hits);
+
+    count = sb_count(heap);
+    for (int k = count / 2 - 1; k >= 0; k--)
+        sift_down_match(heap, count, k);
+
+    *heap_out = heap;
+    return true;
+}
+
+/* runs on the search worker: all matches of term as a heap, false if cancelled */
+static bool find_matches(const char *term, int mode, unsigned generation, struct match **heap_out)
+{
+    *heap_out = NULL;
+
+    if (mode == SEARCH_FULLTEXT)
+        return find_fulltext_matches(term, heap_out);
+
+    const int32_t *names = NULL;
+    const int32_t *goodness = NULL;
+    int32_t *desc_names = NULL;
+    int32_t *desc_goodness = NULL;
+    int count = 0;
+
+    if (mode == SEARCH_DESCRIPTIONS)
+    {
+        /* the index answers right away, there is nothing to narrow */
+        if (manpage_desc_index)
+            count = desc_index_query(manpage_desc_index, term, &desc_names, &desc_goodness);
+
+        names = desc_names;
+        goodness = desc_goodness;
+    }
+    else
+    {
+        const struct search_level *level = get_search_level(term, generation);
+        if (level == NULL)
+            return false;
+
+        names = level->names;
+        goodness = level->goodness;
+        count = sb_count(level->names);
+    }
+
+    if (count <= 0)
+    {
+        free(desc_names);
+        free(desc_goodness);
+        return true;
+    }
+
+    struct match *heap = NULL;
+    struct match *m = sb_add(heap, count);
+
+    for (int k = 0; k < count; k++)
+    {
+        m[k].idx = names[k];
+        m[k].goodness = goodness[k];
+        m[k].doc = -1;
+        m[k].position = -1;
+    }
+
+    free(desc_names);
+    free(desc_goodness);
+
+    for (int k = count / 2 - 1; k >= 0; k--)
+        sift_down_match(heap, count, k);
+
+    *heap_out = heap;
+    return true;
+}
+
+/*
+ * Page to select when the results of the running search arrive
+ * (see refresh_search()), and its distance from the top of the list.
+ */
+char search_selected_name[577];
+int search_selected_view_position;
+
+/* replace the displayed results, heap is a stretchy buffer */
+static void set_search_results(struct match *heap)
+{
+    sb_free(matches_ordered);
+    sb_free(matches_heap);
+    matches_ordered = NULL;
+    matches_heap = heap;
+    matches_count = sb_count(heap);
+
+    results_view_offset = 0;
+    results_selected_index = 0;
+}
+
+/**
+ * Start searching the page names for search_term. The results are taken
+ * over by poll_search_results(), the previous ones are shown until then.
+ */
+void update_search(void)
+{
+    int search_term_len = strlen(search_term);
+
+    search_selected_name[0] = 0;
+
+    pthread_mutex_lock(&search_worker.lock);
+
+    __atomic_add_fetch(&search_worker.name_generation, 1, __ATOMIC_RELAXED);
+    sb_free(search_worker.name_results);
+    search_worker.name_results = NULL;
+    search_worker.name_results_ready = false;
+
+    /* a lone ' is an empty exact search */
+    search_worker.name_pending = (search_term_len > 0) &&
+        ((search_mode != SEARCH_NAMES) || !(is_exact_search(search_term) && (search_term_len == 1)));
+
+    if (search_term_len == 0)
+        search_worker.name_reset_levels = true;
+
+    if (search_worker.name_pending)
+    {
+        snprintf(search_worker.name_term, sizeof(search_worker.name_term), "%s", search_term);
+        search_worker.name_mode = search_mode;
+        pthread_cond_broadcast(&search_worker.cond);
+    }
+
+    bool pending = search_worker.name_pending;
+    pthread_mutex_unlock(&search_worker.lock);
+
+    if (!pending)
+        set_search_results(NULL);
+
+    run_pending_searches();
+}
+
+/* keep the search worker away from the catalogue while it changes */
+static void pause_name_search(void)
+{
+    pthread_mutex_lock(&search_worker.lock);
+
+    search_worker.name_paused = true;
+    while (search_worker.name_running)
+        pthread_cond_wait(&search_worker.cond, &search_worker.lock);
+
+    pthread_mutex_unlock(&search_worker.lock);
+}
+
+static void resume_name_search(bool catalogue_changed)
+{
+    pthread_mutex_lock(&search_worker.lock);
+
+    search_worker.name_paused = false;
+    if (catalogue_changed)
+        search_worker.name_reset_levels = true; /* stored name indices refer to the old catalogue */
+
+    pthread_cond_broadcast(&search_worker.cond);
+    pthread_mutex_unlock(&search_worker.lock);
+}
+
+/**
+ * Run one pending search, called with the lock held, which is released
+ * while searching. Returns false if there was nothing to do.
+ */
+static bool run_search_job(void)
+{
+    if (search_worker.page_pending)
+    {
+        struct manpage *p = search_worker.page_target;
+        unsigned generation = search_worker.page_generation;
+        char term[sizeof(search_worker.page_term)];
+        snprintf(term, sizeof(term), "%s", search_worker.page_term);
+
+        search_worker.page_pending = false;
+        search_worker.page_running = p;
+        pthread_mutex_unlock(&search_worker.lock);
+
+        struct page_search_hit hits[MAX_PAGE_SEARCHES];
+        int n_hits = 0;
+        bool done = find_page_search_hits(p, term, generation, hits, &n_hits);
+
+        pthread_mutex_lock(&search_worker.lock);
+        search_worker.page_running = NULL;
+
+        if (done && (generation == search_worker.page_generation))
+        {
+            memcpy(search_worker.page_hits, hits, n_hits * sizeof(struct page_search_hit));
+            search_worker.page_n_hits = n_hits;
+            search_worker.page_results_target = p;
+            search_worker.page_results_generation = generation;
+            search_worker.page_results_ready = true;
+        }
+    }
+    else if (search_worker.name_pending && !search_worker.name_paused)
+    {
+        unsigned generation = search_worker.name_generation;
+        int mode = search_worker.name_mode;
+        bool reset_levels = search_worker.name_reset_levels;
+        char term[sizeof(search_worker.name_term)];
+        snprintf(term, sizeof(term), "%s", search_worker.name_term);
+
+        search_worker.name_pending = false;
+        search_worker.name_reset_levels = false;
+        search_worker.name_running = true;
+        pthread_mutex_unlock(&search_worker.lock);
+
+        if (reset_levels)
+        {
+            clear_search_levels();
+            clear_fulltext_doc_names();
+        }
+
+        struct match *heap = NULL;
+        bool done = find_matches(term, mode, generation, &heap);
+
+        pthread_mutex_lock(&search_worker.lock);
+        search_worker.name_running = false;
+
+        if (done && (generation == search_worker.name_generation))
+        {
+            sb_free(search_worker.name_results);
+            search_worker.name_results = heap;
+            search_worker.name_results_generation = generation;
+            search_worker.name_results_ready = true;
+        }
+        else
+        {
+            sb_free(heap);
+        }
+    }
+    else
+    {
+        return false;
+    }
+
+    pthread_cond_broadcast(&search_worker.cond);
+    glfwPostEmptyEvent();
+
+    return true;
+}
+
+static void *search_worker_thread(void *arg)
+{
+    pthread_mutex_lock(&search_worker.lock);
+
+    for (;;)
+    {
+        if (!run_search_job())
+            pthread_cond_wait(&search_worker.cond, &search_worker.lock);
+    }
+
+    return NULL;
+}
+
+void start_search_worker(void)
+{
+    pthread_t thread;
+
+    /* long name searches are split among these and the search worker, set before it starts */
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int n_workers = (int)clamp(cpus, 1, MAX_SEARCH_THREADS) - 1;
+
+    for (int i = 0; i < n_workers; i++)
+    {
+        if (pthread_create(&thread, NULL, &search_chunk_worker, NULL) != 0)
+            break;
+
+        pthread_detach(thread);
+        search_worker.n_chunk_workers++;
+    }
+
+    /* without the thread, searches run right when they are started */
+    if (pthread_create(&thread, NULL, &search_worker_thread, NULL) != 0)
+        return;
+
+    pthread_detach(thread);
+    search_worker.started = true;
+}
+
+static void run_pending_searches(void)
+{
+    if (search_worker.started)
+        return;
+
+    pthread_mutex_lock(&search_worker.lock);
+    while (run_search_job())
+        ;
+    pthread_mutex_unlock(&search_worker.lock);
+}
+
+/*
+ * The full-text index is built by its own thread from the files of the
+ * catalogue. Only pages which changed since the last run are formatted,
+ * the rest is copied from the previous index.
+ */
+struct {
+    pthread_mutex_t lock;
+    bool wanted; /* keep the index up to date, only used by the main thread */
+    bool running;
+    char **files; /* stretchy buffer, files for the next run */
+    bool updated; /* a new index file has been written */
+    int n_done; /* progress of the running update, also read without the lock */
+    int n_total;
+} fulltext_state = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/* line of a full-text hit as shown in the results, found in the compressed page text */
+struct fulltext_snippet {
+    bool valid;
+    int doc;
+    int position;
+    int line_number;
+    char line[256];
+    char word[80];
+};
+
+#define N_FULLTEXT_SNIPPETS 32
+struct fulltext_snippet fulltext_snippets[N_FULLTEXT_SNIPPETS]; /* the last ones looked up */
+int fulltext_snippets_next;
+
+static const struct fulltext_snippet *get_fulltext_snippet(const struct match *m)
+{
+    for (int i = 0; i < N_FULLTEXT_SNIPPETS; i++)
+    {
+        const struct fulltext_snippet *s = &fulltext_snippets[i];
+        if (s->valid && (s->doc == m->doc) && (s->position == m->position))
+            return s;
+    }
+
+    struct fulltext_snippet *s = &fulltext_snippets[fulltext_snippets_next];
+    fulltext_snippets_next = (fulltext_snippets_next + 1) % N_FULLTEXT_SNIPPETS;
+
+    s->valid = true;
+    s->doc = m->doc;
+    s->position = m->position;
+    s->line_number = fulltext_hit_line(&manpage_fulltext, m->doc, m->position, s->line, sizeof(s->line), s->word, sizeof(s->word));
+
+    if (s->line_number < 0)
+    {
+        s->line[0] = 0;
+        s->word[0] = 0;
+    }
+
+    return s;
+}
+
+static void clear_fulltext_snippets(void)
+{
+    for (int i = 0; i < N_FULLTEXT_SNIPPETS; i++)
+        fulltext_snippets[i].valid = false;
+}
+
+int get_left_margin()
+{
+    return (window_width > fitting_window_width()) ? (window_width - fitting_window_width()) / 2 : 0;
+}
+
+void render(void)
+{
+    glClearColor(color_table[COLOR_INDEX_BACKGROUND][0], color_table[COLOR_INDEX_BACKGROUND][1], color_table[COLOR_INDEX_BACKGROUND][2], 1.0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glBlendEquation(GL_FUNC_ADD);
+
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glDisable(GL_BLEND);
+
+    switch (display_mode)
+    {
+        case D_MANPAGE:
+            {
+                /* draw manpage (text etc.) centered if window wider than necessary */
                 glPushMatrix();
                 int left_margin = get_left_margin();
                 if (left_margin > 0)
@@ -1844,7 +2794,9 @@ void render(void)
                         get_dimension(DIM_SEARCH_WIDTH), results_shown_lines * input_height);
 
                 set_color(COLOR_INDEX_FOREGROUND);
-                const char *text = "Type to search...";
+                static const char * const placeholders[N_SEARCH_MODES] = {
+                    "Type to search...", "Type to search descriptions...", "Type to search the text of all pages..." };
+                const char *text = placeholders[search_mode];
                 if (strlen(search_term) != 0)
                 {
                     text = search_term;
@@ -1859,8 +2811,36 @@ void render(void)
 
                     if (real_index < matches_count)
                     {
-                        draw_string(manpage_names[matches[real_index].idx],
-                                window_width / 2 - get_dimension(DIM_SEARCH_WIDTH) / 2 + get_dimension(DIM_TEXT_HORIZONTAL_MARGIN), top_result_box + i * input_height + text_vertical_offset);
+                        const char *name = manpage_names[get_match(real_index)->idx];
+                        int x = window_width / 2 - get_dimension(DIM_SEARCH_WIDTH) / 2 + get_dimension(DIM_TEXT_HORIZONTAL_MARGIN);
+                        int y = top_result_box + i * input_height + text_vertical_offset;
+
+                        const struct match *m = get_match(real_index);
+                        size_t name_len = draw_string(name, x, y);
+
+                        /* one-line description from the database or the line of a full-text hit, cut to the box width */
+                        const char *desc = NULL;
+                        if (m->doc >= 0)
+                            desc = get_fulltext_snippet(m)->line;
+                        else
+                            hashmap_get(manpage_database_desc, name, strlen(name), (void **)&desc);
+
+                        int columns = (get_dimension(DIM_SEARCH_WIDTH) - 2 * get_dimension(DIM_TEXT_HORIZONTAL_MARGIN)) / get_character_width();
+                        int desc_columns = columns - (int)name_len - 3;
+
+                        if (desc && (desc_columns > 3))
+                        {
+                            char tmp[512];
+                            snprintf(tmp, sizeof(tmp), "%s", desc);
+                            desc_columns = MIN(desc_columns, (int)sizeof(tmp) - 1);
+
+                            if (strlen(tmp) > desc_columns)
+                                snprintf(tmp + desc_columns - 3, sizeof(tmp) - (desc_columns - 3), "...");
+
+                            set_color(COLOR_INDEX_DIM);
+                            draw_string(tmp, x + (name_len + 3) * get_character_width(), y);
+                            set_color(COLOR_INDEX_FOREGROUND);
+                        }
                     }
                 }
 
@@ -1883,13 +2863,64 @@ void render(void)
                         snprintf(tmp, sizeof(tmp), "%d matches", matches_count);
                     }
 
-                    set_color(COLOR_INDEX_DIM);
-                    draw_string(tmp, window_width / 2 - strlen(tmp) * get_character_width() / 2, top_result_box + results_shown_lines * input_height + text_vertical_offset);
+                    static const char * const scopes[N_SEARCH_MODES] = { "", " in descriptions", " in page text" };
+                    size_t len = strlen(tmp);
+                    snprintf(tmp + len, sizeof(tmp) - len, "%s", scopes[search_mode]);
+
+                    int fulltext_done = __atomic_load_n(&fulltext_state.n_done, __ATOMIC_RELAXED);
+                    int fulltext_total = __atomic_load_n(&fulltext_state.n_total, __ATOMIC_RELAXED);
+
+                    if (!manpage_database_ready)
+                    {
+                        len = strlen(tmp);
+                        snprintf(tmp + len, sizeof(tmp) - len, " (indexing...)");
+                    }
+                    else if ((search_mode == SEARCH_FULLTEXT) && (fulltext_done < fulltext_total))
+                    {
+                        len = strlen(tmp);
+                        snprintf(tmp + len, sizeof(tmp) - len, " (indexing %d/%d pages...)", fulltext_done, fulltext_total);
+                    }
+
+                    set_color(COLOR_INDEX_DIM);
+                    draw_string(tmp, window_width / 2 - strlen(tmp) * get_character_width() / 2, top_result_box + results_shown_lines * input_height + text_vertical_offset);
                 }
             }
             break;
     }
 
+    /* page being loaded, or why the last one couldn't be */
+    {
+        char status[1024];
+        status[0] = 0;
+
+        double loading_time = glfwGetTime() - page_load_state.start_time;
+        bool error = !page_load_state.loading && page_load_state.error[0];
+
+        if (page_load_state.loading && (loading_time >= PAGE_LOAD_INDICATOR_DELAY))
+        {
+            static const char spinner[] = "|/-\\";
+            snprintf(status, sizeof(status), "Loading %s %c", page_load_state.title,
+                    spinner[(int)(loading_time / PAGE_LOAD_INDICATOR_INTERVAL) % 4]);
+        }
+        else if (error)
+        {
+            snprintf(status, sizeof(status), "%s", page_load_state.error);
+        }
+
+        if (status[0])
+        {
+            int input_height = get_line_height() * 3 / 2;
+            int input_width = strlen(status) * get_character_width() + 2 * get_dimension(DIM_TEXT_HORIZONTAL_MARGIN);
+            int x = window_width - get_dimension(DIM_SCROLLBAR_WIDTH) - input_width;
+
+            set_color(COLOR_INDEX_BACKGROUND);
+            draw_rectangle(x, window_height - input_height, input_width, input_height);
+            set_color(error ? COLOR_INDEX_ERROR : COLOR_INDEX_GUI_1);
+            draw_rectangle_outline(x, window_height - input_height, input_width, input_height);
+            set_color(error ? COLOR_INDEX_ERROR : COLOR_INDEX_FOREGROUND);
+            draw_string(status, x + get_dimension(DIM_TEXT_HORIZONTAL_MARGIN), window_height - input_height + get_dimension(DIM_TEXT_HORIZONTAL_MARGIN));
+        }
+    }
 
 #if 0
     if (loadedFont && (loadedFont->texture_id > 0))
@@ -2110,15 +3141,7 @@ void mouse_button_func(GLFWwindow *window, int button, int action, int mods)
                             if (actual_index < matches_count)
                             {
                                 results_selected_index = actual_index;
-                                const char *key = manpage_names[matches[results_selected_index].idx];
-                                char *man_file;
-                                if (hashmap_get(manpage_database, key, strlen(key), (void **)&man_file) == MAP_OK)
-                                {
-                                    char *pwd = NULL;
-                                    hashmap_get(manpage_database_pwd, key, strlen(key), (void **)&pwd);
-
-                                    open_new_page(man_file, pwd);
-                                }
+                                open_search_result(results_selected_index);
                             }
                         }
                     }
@@ -2287,7 +3310,9 @@ void mouse_scroll_func(GLFWwindow *window, double xoffset, double yoffset)
     }
 }
 
-void reload_current_page(void);
+void reload_current_page(int line_length);
+void update_fulltext_index(void);
+static void want_fulltext_index(void);
 
 void key_func(GLFWwindow *window, int key, int scancode, int action, int mods)
 {
@@ -2321,10 +3346,6 @@ void key_func(GLFWwindow *window, int key, int scancode, int action, int mods)
                             {
                                 page->search_string[len - 1] = 0;
                                 update_page_search(page);
-                                if (page->search_num > 0)
-                                {
-                                    scroll_in_view(to_document_coordinates(page->searches[page->search_index].document_rectangle), page->search_start_scroll_position);
-                                }
                                 post_redisplay();
                             }
                         }
@@ -2411,10 +3432,11 @@ void key_func(GLFWwindow *window, int key, int scancode, int action, int mods)
                         if (!strcmp(k, "c") || !strcmp(k, "d"))
                         {
                             if (mods & GLFW_MOD_CONTROL)
-                                exit_program(EXIT_SUCCESS);
+                                close_window();
                         }
                         else if (!strcmp(k, "f") && mods & GLFW_MOD_CONTROL)
                         {
+                            cancel_page_load();
                             display_mode = D_SEARCH;
                             search_term[0] = 0;
                             update_search();
@@ -2436,13 +3458,9 @@ void key_func(GLFWwindow *window, int key, int scancode, int action, int mods)
                         }
                         else if (!strcmp(k, "="))
                         {
-                          line_length_toggle = !line_length_toggle;
-
-                          /* toggle between current window width and original line length */
-                          settings.current_line_length = line_length_toggle ?
-                            line_length_from_window_width(window_width) : settings.line_length;
-
-                          reload_current_page();
+                          /* toggle between fitting the pages to the window and the original line length */
+                          fit_to_window = !fit_to_window;
+                          reload_current_page(get_page_line_length());
                         }
 
                         break;
@@ -2481,7 +3499,7 @@ void key_func(GLFWwindow *window, int key, int scancode, int action, int mods)
                 case GLFW_KEY_C: /* ctrl-c */
                 case GLFW_KEY_D: /* ctrl-d */
                     if (mods & GLFW_MOD_CONTROL)
-                        exit_program(EXIT_SUCCESS);
+                        close_window();
                     break;
                 case GLFW_KEY_V: /* ctrl-v */
                     if (mods & GLFW_MOD_CONTROL)
@@ -2495,21 +3513,19 @@ void key_func(GLFWwindow *window, int key, int scancode, int action, int mods)
                       }
                     }
                     break;
+                case GLFW_KEY_TAB:
+                    /* switch between searching names, descriptions and the text of the pages */
+                    search_mode = (search_mode + 1) % N_SEARCH_MODES;
+                    if (search_mode == SEARCH_FULLTEXT)
+                        want_fulltext_index();
+                    update_search();
+                    post_redisplay();
+                    break;
                 case GLFW_KEY_ENTER:
                 case GLFW_KEY_KP_ENTER:
                     /* open selected manpage */
                     if (results_selected_index < matches_count)
-                    {
-                        const char *key = manpage_names[matches[results_selected_index].idx];
-                        char *test;
-                        if (hashmap_get(manpage_database, key, strlen(key), (void **)&test) == MAP_OK)
-                        {
-                            char *pwd = NULL;
-                            hashmap_get(manpage_database_pwd, key, strlen(key), (void **)&pwd);
-
-                            open_new_page(test, pwd);
-                        }
-                    }
+                        open_search_result(results_selected_index);
                     break;
                 case GLFW_KEY_BACKSPACE:
                     {
@@ -2554,10 +3570,6 @@ void char_func(GLFWwindow *window, unsigned int codepoint)
                 {
                     strcat(page->search_string, (char[]){(codepoint & 0xff), 0});
                     update_page_search(page);
-                    if (page->search_num > 0)
-                    {
-                        scroll_in_view(to_document_coordinates(page->searches[page->search_index].document_rectangle), page->search_start_scroll_position);
-                    }
                     post_redisplay();
                 }
             }
@@ -2593,7 +3605,8 @@ void char_func(GLFWwindow *window, unsigned int codepoint)
         {
             case 'q':
             case 'Q':
-                exit_program(EXIT_SUCCESS);
+                close_window();
+                break;
             case 'b':
                 page_back();
                 break;
@@ -2729,7 +3742,7 @@ static size_t get_man_paths(const char * const *paths[])
 {
     size_t number_of_paths;
 
-    number_of_paths = get_man_paths_from_manpath_executable(paths);
+    number_of_paths = get_man_paths_from_configuration(paths);
     if(number_of_paths)
         return number_of_paths;
 
@@ -2833,337 +3846,3162 @@ int get_page_name_and_section(const char *pathname, char *name, size_t name_len,
     return -1;
 }
 
-int cmp_manpage_name_idx(const void *a, const void *b)
+static const char * const manpage_sections[] = {"1", "8", "6", "2", "3", "5", "7", "4", "9", "3p"};
+
+struct manpage_catalogue {
+    char **names;
+    char **names_lower;
+    map_t database;
+    map_t database_pwd;
+    map_t database_desc;
+    struct manindex index; /* mapped index the strings point into, if loaded from one */
+    struct desc_index *desc_index;
+};
+
+struct manindex manpage_index; /* index of the current catalogue */
+
+/**
+ * List of all directories which are scanned for man pages (every section
+ * of every man path). Index i belongs to the man path i / ARRAY_SIZE(manpage_sections).
+ * The mandoc.db file of each man path follows after all directories.
+ */
+static char **get_manpage_directories(const char * const *paths, size_t number_of_paths)
 {
-    return strcmp(manpage_names_lower[*(const int *)a], manpage_names_lower[*(const int *)b]);
+    char **dirs = NULL;
+
+    for (size_t ipath = 0; ipath < number_of_paths; ipath++)
+    {
+        for (size_t isec = 0; isec < ARRAY_SIZE(manpage_sections); isec++)
+        {
+            char dir[1024];
+            snprintf(dir, sizeof(dir), "%s/man%s", paths[ipath], manpage_sections[isec]);
+            sb_push(dirs, strdup(dir));
+        }
+    }
+
+    for (size_t ipath = 0; ipath < number_of_paths; ipath++)
+    {
+        char db[1024];
+        snprintf(db, sizeof(db), "%s/mandoc.db", paths[ipath]);
+        sb_push(dirs, strdup(db));
+    }
+
+    return dirs;
 }
 
-static int make_manpage_database(void)
+static void free_manpage_directories(char **dirs)
 {
-    const char * const sections[] = {"1", "8", "6", "2", "3", "5", "7", "4", "9", "3p"};
+    for (int i = 0; i < sb_count(dirs); i++)
+        free(dirs[i]);
 
-    const char * const *paths;
+    sb_free(dirs);
+}
+
+static void init_manpage_catalogue(struct manpage_catalogue *c)
+{
+    memset(c, 0, sizeof(*c));
+    c->database = hashmap_new();
+    c->database_pwd = hashmap_new();
+    c->database_desc = hashmap_new();
+}
 
-    size_t ipath, isec, number_of_paths;
+static void free_manpage_catalogue(struct manpage_catalogue *c)
+{
+    for (int i = 0; (c->index.map == NULL) && (i < sb_count(c->names)); i++)
+    {
+        const char *key = c->names[i];
+        char *file = NULL;
+        char *pwd = NULL;
+        char *desc = NULL;
+        hashmap_get(c->database, key, strlen(key), (void **)&file);
+        hashmap_get(c->database_pwd, key, strlen(key), (void **)&pwd);
+        hashmap_get(c->database_desc, key, strlen(key), (void **)&desc);
+        free(file);
+        free(pwd);
+        free(desc);
+        free(c->names[i]);
+        free(c->names_lower[i]);
+    }
 
-    number_of_paths = get_man_paths(&paths);
+    sb_free(c->names);
+    sb_free(c->names_lower);
+    hashmap_free(c->database);
+    hashmap_free(c->database_pwd);
+    hashmap_free(c->database_desc);
+    manindex_close(&c->index);
+    desc_index_free(c->desc_index);
+    memset(c, 0, sizeof(*c));
+}
 
-    for (ipath = 0; ipath < number_of_paths; ipath++)
+/* copy of the pages of src without its search indexes, which can be changed */
+static void copy_manpage_catalogue(struct manpage_catalogue *dst, const struct manpage_catalogue *src)
+{
+    init_manpage_catalogue(dst);
+
+    for (int i = 0; i < sb_count(src->names); i++)
     {
-        for (isec = 0; isec < ARRAY_SIZE(sections); isec++)
+        const char *key = src->names[i];
+        map_t from[] = { src->database, src->database_pwd, src->database_desc };
+        map_t to[] = { dst->database, dst->database_pwd, dst->database_desc };
+
+        for (int j = 0; j < ARRAY_SIZE(from); j++)
         {
-            const char *path = paths[ipath];
-            const char *section = sections[isec];
+            char *value;
+            if (hashmap_get(from[j], key, strlen(key), (void **)&value) == MAP_OK)
+                hashmap_put(to[j], key, strlen(key), strdup(value));
+        }
 
-            glob_t globinfo;
-            char file[1024];
+        sb_push(dst->names, strdup(key));
+        sb_push(dst->names_lower, strdup(src->names_lower[i]));
+    }
+}
 
-            snprintf(file, sizeof(file), "%s/man%s/*.[01-9]*", path, section);
-            snprintf(file, sizeof(file), "%s/man%s/*", path, section);
-            int globres = glob(file, 0, NULL, &globinfo);
-            if (globres != 0 && globres != GLOB_NOMATCH)
-                warn("%s: glob", file);
+/* takes ownership of file, pwd and desc (which may be NULL) */
+static void add_manpage_to_database(struct manpage_catalogue *c, const char *key, char *file, char *pwd, char *desc)
+{
+    char *test;
+    if (hashmap_get(c->database, key, strlen(key), (void **)&test) == MAP_OK)
+    {
+        /* later paths override earlier ones, the name is already listed */
+        char *old_pwd = NULL;
+        char *old_desc = NULL;
+        hashmap_get(c->database_pwd, key, strlen(key), (void **)&old_pwd);
+        hashmap_get(c->database_desc, key, strlen(key), (void **)&old_desc);
+
+        hashmap_remove(c->database, key, strlen(key));
+        hashmap_remove(c->database_pwd, key, strlen(key));
+        hashmap_remove(c->database_desc, key, strlen(key));
+        free(test);
+        free(old_pwd);
+        free(old_desc);
+
+        hashmap_put(c->database, key, strlen(key), file);
+        hashmap_put(c->database_pwd, key, strlen(key), pwd);
+        if (desc)
+            hashmap_put(c->database_desc, key, strlen(key), desc);
+        return;
+    }
 
-            if (globres == 0)
-            {
-                // there are matches
-                for (int i = 0; i < globinfo.gl_pathc; i++)
-                {
-                    //printf("%s [all %ld]\n", globinfo.gl_pathv[i], globinfo.gl_pathc);
+    hashmap_put(c->database, key, strlen(key), file);
+    hashmap_put(c->database_pwd, key, strlen(key), pwd);
+    if (desc)
+        hashmap_put(c->database_desc, key, strlen(key), desc);
+    sb_push(c->names, strdup(key));
+    char *lowercase = strdup(key);
+    for (char *ch = lowercase; *ch; ch++)
+        *ch = tolower(*ch);
 
-                    char page_name[512];
-                    char section_name[64];
-                    if (get_page_name_and_section(globinfo.gl_pathv[i], page_name, sizeof(page_name), section_name, sizeof(section_name)) == 0)
-                    {
-                        // successful parse
-                        char key[577];
-                        snprintf(key, sizeof(key), "%s(%s)", page_name, section_name);
+    sb_push(c->names_lower, lowercase);
+}
 
-                        char *test;
-                        if (hashmap_get(manpage_database, key, strlen(key), (void **)&test) == MAP_OK)
-                        {
-                            //printf("Key present, removing\n");
-                            hashmap_remove(manpage_database, key, strlen(key));
-                            hashmap_remove(manpage_database_pwd, key, strlen(key));
-                            free(test);
-                        }
-                        char *file = strdup(globinfo.gl_pathv[i]);
-                        size_t path_len = strlen(path) + 1;
-                        char *pwd = malloc(path_len);
-                        memcpy(pwd, path, path_len);
-                        hashmap_put(manpage_database, key, strlen(key), file);
-                        hashmap_put(manpage_database_pwd, key, strlen(key), pwd);
-                        sb_push(manpage_names, strdup(key));
-                        char *lowercase = strdup(key);
-                        for (char *c = lowercase; *c; c++)
-                            *c = tolower(*c);
-
-                        sb_push(manpage_names_lower, lowercase);
-                    }
-                }
-            }
+#define MAX_SCAN_THREADS 32
+#define MAX_SORT_THREADS 8
+#define PARALLEL_SORT_MIN_COUNT 4096
 
-            globfree(&globinfo);
-#if 0
-            snprintf(file, sizeof(file), "%s/man%s/%s.%s", path, sec, name, sec);
-            if (stat(file, &sb) != -1)
-                goto found;
+struct scanned_page {
+    char *key;
+    char *file;
+    char *desc;
+};
 
-            snprintf(file, sizeof(file), "%s/cat%s/%s.0", path, sec, name);
-            if (stat(file, &sb) != -1)
-                goto found;
+/* one manN directory or the mandoc.db of a man path, read by whichever worker picks it up first */
+struct scan_job {
+    const char *dir;
+    const char *path;
+    int is_db;
+    struct scanned_page *pages;
+};
 
-#if 0
-            if (arch != NULL) {
-                snprintf(file, sizeof(file), "%s/man%s/%s/%s.%s", path, sec, arch, name, sec);
-                if (stat(file, &sb) != -1)
-                    goto found;
+struct scan_queue {
+    struct scan_job *jobs;
+    int n_jobs;
+    int next_job;
+};
+
+/* pages of one scanned directory, handed over to the main thread while the index is built */
+struct scan_batch {
+    struct scanned_page *pages;
+    const char *path;
+};
+
+/* a page added to (file set) or removed from one of the watched directories */
+struct index_change {
+    char *key;
+    char *file;
+    const char *path;
+    bool removed;
+};
+
+/* communication between the index thread and the main thread */
+struct {
+    pthread_mutex_t lock;
+    struct scan_batch *batches;
+    struct manpage_catalogue *complete;
+    bool pages_changed; /* not only descriptions, since complete was last taken */
+    struct manpage_catalogue **retired; /* replaced on the main thread, freed by the index thread */
+} index_state = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/* last catalogue published by the index thread, the watcher changes copies of it */
+static struct manpage_catalogue *latest_catalogue;
+
+static void post_index_update(void)
+{
+    glfwPostEmptyEvent(); /* wake up the main loop */
+}
+
+int cmp_scanned_page_file(const void *a, const void *b)
+{
+    return strcmp(((const struct scanned_page *)a)->file, ((const struct scanned_page *)b)->file);
+}
+
+static void publish_scan_job(const struct scan_job *job)
+{
+    struct scan_batch batch = { NULL, job->path };
+
+    for (int i = 0; i < sb_count(job->pages); i++)
+    {
+        struct scanned_page sp = { strdup(job->pages[i].key), strdup(job->pages[i].file),
+            job->pages[i].desc ? strdup(job->pages[i].desc) : NULL };
+        sb_push(batch.pages, sp);
+    }
+
+    pthread_mutex_lock(&index_state.lock);
+    sb_push(index_state.batches, batch);
+    pthread_mutex_unlock(&index_state.lock);
+
+    post_index_update();
+}
+
+static void add_scanned_page(struct scan_job *job, const char *file, const char *desc)
+{
+    char page_name[512];
+    char section_name[64];
+    if (get_page_name_and_section(file, page_name, sizeof(page_name), section_name, sizeof(section_name)) == 0)
+    {
+        // successful parse
+        char key[577];
+        snprintf(key, sizeof(key), "%s(%s)", page_name, section_name);
+
+        struct scanned_page sp = { strdup(key), strdup(file), desc ? strdup(desc) : NULL };
+        sb_push(job->pages, sp);
+    }
+}
+
+static void read_manpage_directory(struct scan_job *job, const char *dir)
+{
+    DIR *d = opendir(dir);
+    if (d == NULL)
+    {
+        if (errno != ENOENT)
+            warn("%s: opendir", dir);
+        return;
+    }
+
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL)
+    {
+        if (de->d_name[0] == '.')
+            continue; /* hidden files, . and .. */
+
+        char file[1024];
+        snprintf(file, sizeof(file), "%s/%s", dir, de->d_name);
+        add_scanned_page(job, file, NULL);
+    }
+
+    closedir(d);
+}
+
+pthread_mutex_t dbm_lock = PTHREAD_MUTEX_INITIALIZER; /* dbm_* functions keep global state */
+
+/* is the file (relative to the man path) in one of the directories we'd otherwise scan */
+static bool in_scanned_section(const char *file)
+{
+    if (strncmp(file, "man", 3) != 0)
+        return false;
+
+    for (size_t isec = 0; isec < ARRAY_SIZE(manpage_sections); isec++)
+    {
+        size_t len = strlen(manpage_sections[isec]);
+        if ((strncmp(file + 3, manpage_sections[isec], len) == 0) && (file[3 + len] == '/'))
+            return strchr(file + 3 + len + 1, '/') == NULL;
+    }
+
+    return false;
+}
+
+/**
+ * Read the page list of a man path from its mandoc.db (see mandoc.db(5)).
+ * Every file name of a page gets its own entry, as if it was found
+ * in the directory, and all of them share the one-line description.
+ */
+static int read_mandoc_db(struct scan_job *job)
+{
+    pthread_mutex_lock(&dbm_lock);
+
+    if (dbm_open(job->dir) == -1)
+    {
+        pthread_mutex_unlock(&dbm_lock);
+        return -1;
+    }
+
+    int32_t n_pages = dbm_page_count();
+    for (int32_t ip = 0; ip < n_pages; ip++)
+    {
+        struct dbm_page *dp = dbm_page_get(ip);
+
+        /* list of file names, the first one is preceded by a byte with the file format */
+        const char *f = dp->file + 1;
+        while (*f)
+        {
+            if (in_scanned_section(f))
+            {
+                char file[1024];
+                snprintf(file, sizeof(file), "%s/%s", job->path, f);
+                add_scanned_page(job, file, dp->desc);
             }
-#endif
 
-            snprintf(file, sizeof(file), "%s/man%s/%s.[01-9]*", path, sec, name);
-            int globres = glob(file, 0, NULL, &globinfo);
-            if (globres != 0 && globres != GLOB_NOMATCH)
-                warn("%s: glob", file);
+            f += strlen(f) + 1;
+        }
+    }
+
+    dbm_close();
+    pthread_mutex_unlock(&dbm_lock);
 
-            if (globres == 0)
-                strcpy(file, *globinfo.gl_pathv);
-            globfree(&globinfo);
+    return 0;
+}
 
-            if (globres == 0) {
-                if (stat(file, &sb) != -1)
-                    goto found;
+static void scan_manpage_directory(struct scan_job *job)
+{
+    if (job->is_db)
+    {
+        if (read_mandoc_db(job) != 0)
+        {
+            /* unusable database, read all directories of the man path instead */
+            for (size_t isec = 0; isec < ARRAY_SIZE(manpage_sections); isec++)
+            {
+                char dir[1024];
+                snprintf(dir, sizeof(dir), "%s/man%s", job->path, manpage_sections[isec]);
+                read_manpage_directory(job, dir);
             }
-#endif
+        }
+    }
+    else
+    {
+        read_manpage_directory(job, job->dir);
+    }
+
+    /* same order as glob() would return, later files override earlier ones with the same key */
+    if (sb_count(job->pages) > 1)
+        qsort(job->pages, sb_count(job->pages), sizeof(struct scanned_page), &cmp_scanned_page_file);
+
+    if (sb_count(job->pages) > 0)
+        publish_scan_job(job);
+}
+
+static void *scan_worker(void *arg)
+{
+    struct scan_queue *queue = (struct scan_queue *)arg;
+
+    for (;;)
+    {
+        int i = __atomic_fetch_add(&queue->next_job, 1, __ATOMIC_RELAXED);
+        if (i >= queue->n_jobs)
+            break;
+
+        scan_manpage_directory(&queue->jobs[i]);
+    }
+
+    return NULL;
+}
+
+/**
+ * Read all directories at once - every worker takes the next unscanned
+ * directory from the queue, so a slow (network) directory only holds up
+ * a single worker.
+ */
+static void scan_manpage_directories(struct scan_job *jobs, int n_jobs)
+{
+    struct scan_queue queue = { jobs, n_jobs, 0 };
+    pthread_t threads[MAX_SCAN_THREADS];
+    int n_threads = MIN(n_jobs, MAX_SCAN_THREADS);
+    int started = 0;
+
+    for (int i = 1; i < n_threads; i++)
+    {
+        if (pthread_create(&threads[started], NULL, &scan_worker, &queue) == 0)
+            started++;
+    }
+
+    scan_worker(&queue); /* work on the calling thread as well */
+
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+}
+
+struct name_pair {
+    char *name;
+    char *name_lower;
+};
+
+int cmp_name_pair(const void *a, const void *b)
+{
+    return strcmp(((const struct name_pair *)a)->name_lower, ((const struct name_pair *)b)->name_lower);
+}
 
+struct sort_chunk {
+    struct name_pair *pairs;
+    struct name_pair *tmp;
+    int count;
+};
+
+static void *sort_chunk_worker(void *arg)
+{
+    struct sort_chunk *chunk = (struct sort_chunk *)arg;
+    qsort(chunk->pairs, chunk->count, sizeof(struct name_pair), &cmp_name_pair);
+    return NULL;
+}
+
+static void *merge_chunks_worker(void *arg)
+{
+    struct sort_chunk *chunks = (struct sort_chunk *)arg;
+    const struct name_pair *a = chunks[0].pairs;
+    const struct name_pair *b = chunks[1].pairs;
+    int n_a = chunks[0].count;
+    int n_b = chunks[1].count;
+    struct name_pair *out = chunks[0].tmp;
+    int i = 0, j = 0, k = 0;
+
+    while ((i < n_a) && (j < n_b))
+    {
+        /* take from the left run on equality to keep the sort stable */
+        if (cmp_name_pair(&b[j], &a[i]) < 0)
+            out[k++] = b[j++];
+        else
+            out[k++] = a[i++];
+    }
+
+    while (i < n_a)
+        out[k++] = a[i++];
+    while (j < n_b)
+        out[k++] = b[j++];
+
+    memcpy(chunks[0].pairs, out, sizeof(struct name_pair) * k);
+    chunks[0].count = k;
+
+    return NULL;
+}
+
+/**
+ * Sort chunks of the array on separate threads, then merge pairs of
+ * neighbouring chunks (also in parallel) until one sorted run is left.
+ */
+static void parallel_sort_names(struct name_pair *pairs, int count)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int n_chunks = (int)clamp(cpus, 1, MAX_SORT_THREADS);
+    struct name_pair *tmp = NULL;
+
+    if ((count >= PARALLEL_SORT_MIN_COUNT) && (n_chunks > 1))
+        tmp = (struct name_pair *)malloc(sizeof(struct name_pair) * count);
+
+    if (tmp == NULL)
+    {
+        qsort(pairs, count, sizeof(struct name_pair), &cmp_name_pair);
+        return;
+    }
+
+    struct sort_chunk chunks[MAX_SORT_THREADS];
+    pthread_t threads[MAX_SORT_THREADS];
+    int started[MAX_SORT_THREADS] = {0};
+    int chunk_size = (count + n_chunks - 1) / n_chunks;
+
+    for (int i = 0; i < n_chunks; i++)
+    {
+        int begin = MIN(i * chunk_size, count);
+        chunks[i].pairs = &pairs[begin];
+        chunks[i].tmp = &tmp[begin];
+        chunks[i].count = MIN(chunk_size, count - begin);
+    }
+
+    for (int i = 1; i < n_chunks; i++)
+        started[i] = pthread_create(&threads[i], NULL, &sort_chunk_worker, &chunks[i]) == 0;
+
+    sort_chunk_worker(&chunks[0]);
+
+    for (int i = 1; i < n_chunks; i++)
+    {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+        else
+            sort_chunk_worker(&chunks[i]);
+    }
+
+    /* merge rounds: chunk i absorbs chunk i + step */
+    for (int step = 1; step < n_chunks; step *= 2)
+    {
+        int n_merges = 0;
+        int merged[MAX_SORT_THREADS];
+        struct sort_chunk merge_pairs[MAX_SORT_THREADS][2];
 
+        for (int i = 0; i + step < n_chunks; i += 2 * step)
+        {
+            merge_pairs[n_merges][0] = chunks[i];
+            merge_pairs[n_merges][1] = chunks[i + step];
+            merged[n_merges] = i;
+            started[n_merges] = pthread_create(&threads[n_merges], NULL, &merge_chunks_worker, merge_pairs[n_merges]) == 0;
+            if (!started[n_merges])
+                merge_chunks_worker(merge_pairs[n_merges]);
+            n_merges++;
+        }
+
+        for (int i = 0; i < n_merges; i++)
+        {
+            if (started[i])
+                pthread_join(threads[i], NULL);
+            chunks[merged[i]] = merge_pairs[i][0];
         }
     }
 
-    /**
-     * Sort both arrays: manpage_names and manpage_names_lower with the same order
-     */
+    free(tmp);
+}
 
-    int count = sb_count(manpage_names);
+/**
+ * Sort both arrays: names and names_lower with the same order
+ */
+static void sort_manpage_names(struct manpage_catalogue *c)
+{
+    int count = sb_count(c->names);
 
     if (count > 0)
     {
-        int *indices = (int *)malloc(sizeof(int) * count);
-        char **tmp = (char **)malloc(sizeof(char *) * count);
-        if (indices && tmp)
+        struct name_pair *pairs = (struct name_pair *)malloc(sizeof(struct name_pair) * count);
+        if (pairs)
         {
             for (int i = 0; i < count; i++)
-                indices[i] = i;
+            {
+                pairs[i].name = c->names[i];
+                pairs[i].name_lower = c->names_lower[i];
+            }
 
-            qsort(indices, count, sizeof(int), &cmp_manpage_name_idx);
+            parallel_sort_names(pairs, count);
 
-            memcpy(tmp, manpage_names, sizeof(char *) * count);
             for (int i = 0; i < count; i++)
-                manpage_names[i] = tmp[indices[i]];
+            {
+                c->names[i] = pairs[i].name;
+                c->names_lower[i] = pairs[i].name_lower;
+            }
 
-            memcpy(tmp, manpage_names_lower, sizeof(char *) * count);
-            for (int i = 0; i < count; i++)
-                manpage_names_lower[i] = tmp[indices[i]];
+            free(pairs);
+        }
+    }
+}
+
+static void load_manpage_database_from_index(struct manpage_catalogue *c, const struct manindex *idx)
+{
+    for (size_t i = 0; i < idx->count; i++)
+    {
+        struct manindex_page p = manindex_get(idx, i);
+
+        hashmap_put(c->database, p.name, strlen(p.name), (char *)p.file);
+        hashmap_put(c->database_pwd, p.name, strlen(p.name), (char *)p.pwd);
+        if (p.desc[0])
+            hashmap_put(c->database_desc, p.name, strlen(p.name), (char *)p.desc);
+        sb_push(c->names, (char *)p.name);
+        sb_push(c->names_lower, (char *)p.name_lower);
+    }
+}
+
+static void write_manpage_index(const struct manpage_catalogue *c, const char *filename, char **dirs, const struct manindex_stamp *stamps)
+{
+    int count = sb_count(c->names);
+    char **files = ZMALLOC(char *, count + 1);
+    char **pwds = ZMALLOC(char *, count + 1);
+    char **descs = ZMALLOC(char *, count + 1);
+
+    if (files && pwds && descs)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            const char *key = c->names[i];
+            hashmap_get(c->database, key, strlen(key), (void **)&files[i]);
+            hashmap_get(c->database_pwd, key, strlen(key), (void **)&pwds[i]);
+            hashmap_get(c->database_desc, key, strlen(key), (void **)&descs[i]);
         }
 
-        if (tmp) free(tmp);
-        if (indices) free(indices);
-    }
+        if (manindex_write(filename, (const char * const *)dirs, stamps, sb_count(dirs),
+                    c->names, c->names_lower, files, pwds, descs, count) != 0)
+        {
+            fprintf(stderr, "Failed to write man page index \"%s\"\n", filename);
+        }
+    }
+
+    free(files);
+    free(pwds);
+    free(descs);
+}
+
+/**
+ * The database is used instead of reading the directories if it was
+ * written after the last change of all directories of the man path.
+ */
+static bool mandoc_db_is_fresh(const struct manindex_stamp *db, const struct manindex_stamp *dirs, size_t n_dirs)
+{
+    if (db->sec == 0 && db->nsec == 0)
+        return false; /* no database */
+
+    for (size_t i = 0; i < n_dirs; i++)
+    {
+        if ((dirs[i].sec > db->sec) || ((dirs[i].sec == db->sec) && (dirs[i].nsec > db->nsec)))
+            return false;
+    }
+
+    return true;
+}
+
+/* what's needed to write the index of a scanned catalogue once it's complete */
+struct pending_index {
+    char filename[1024]; /* empty without a cache directory */
+    char **dirs;
+    struct manindex_stamp *stamps;
+};
+
+/**
+ * Load the catalogue from the index or scan the man paths. Returns true
+ * if they were scanned, the index is then left to be written from pending.
+ */
+static bool make_manpage_database(struct manpage_catalogue *c, struct pending_index *pending)
+{
+    const char * const *paths;
+    size_t number_of_paths = get_man_paths(&paths);
+
+    char **dirs = get_manpage_directories(paths, number_of_paths);
+    int n_dirs = sb_count(dirs);
+
+    char index_filename[1024];
+    int use_index = manindex_cache_filename("index", index_filename, sizeof(index_filename)) == 0;
+
+    if (use_index && (manindex_open(index_filename, (const char * const *)dirs, n_dirs, &c->index) == 0))
+    {
+        load_manpage_database_from_index(c, &c->index);
+        free_manpage_directories(dirs);
+        return false;
+    }
+
+    /* take the timestamps before scanning, so changes made during the scan invalidate the index */
+    struct manindex_stamp *stamps = ZMALLOC(struct manindex_stamp, n_dirs + 1);
+    manindex_stat_dirs((const char * const *)dirs, n_dirs, stamps);
+
+    struct scan_job *jobs = ZMALLOC(struct scan_job, n_dirs + 1);
+    int n_jobs = 0;
+
+    for (size_t ipath = 0; ipath < number_of_paths; ipath++)
+    {
+        size_t first_dir = ipath * ARRAY_SIZE(manpage_sections);
+        const struct manindex_stamp *db_stamp = &stamps[number_of_paths * ARRAY_SIZE(manpage_sections) + ipath];
+
+        if (mandoc_db_is_fresh(db_stamp, &stamps[first_dir], ARRAY_SIZE(manpage_sections)))
+        {
+            /* a single job reads the whole man path from the database */
+            jobs[n_jobs].dir = dirs[number_of_paths * ARRAY_SIZE(manpage_sections) + ipath];
+            jobs[n_jobs].path = paths[ipath];
+            jobs[n_jobs].is_db = 1;
+            n_jobs++;
+            continue;
+        }
+
+        for (size_t i = first_dir; i < first_dir + ARRAY_SIZE(manpage_sections); i++)
+        {
+            if (stamps[i].sec == 0 && stamps[i].nsec == 0)
+                continue; /* missing directory */
+
+            jobs[n_jobs].dir = dirs[i];
+            jobs[n_jobs].path = paths[ipath];
+            n_jobs++;
+        }
+    }
+
+    scan_manpage_directories(jobs, n_jobs);
+
+    /* merge in the original path and section order, later paths override earlier ones */
+    for (int j = 0; j < n_jobs; j++)
+    {
+        for (int k = 0; k < sb_count(jobs[j].pages); k++)
+        {
+            add_manpage_to_database(c, jobs[j].pages[k].key, jobs[j].pages[k].file, strdup(jobs[j].path), jobs[j].pages[k].desc);
+            free(jobs[j].pages[k].key);
+        }
+
+        sb_free(jobs[j].pages);
+    }
+
+    free(jobs);
+
+    sort_manpage_names(c);
+
+    snprintf(pending->filename, sizeof(pending->filename), "%s", use_index ? index_filename : "");
+    pending->dirs = dirs;
+    pending->stamps = stamps;
+
+    return true;
+}
+
+/* (re)build the indexes used by the search over the current names, the trigram index is built by the search */
+static void build_search_indexes(struct manpage_catalogue *c)
+{
+    int count = sb_count(c->names);
+
+    const char **descs = ZMALLOC(const char *, count + 1);
+    for (int i = 0; i < count; i++)
+        hashmap_get(c->database_desc, c->names[i], strlen(c->names[i]), (void **)&descs[i]);
+
+    desc_index_free(c->desc_index);
+    c->desc_index = desc_index_build(descs, count);
+    free(descs);
+}
+
+/* hand a catalogue with its search indexes over to the main thread */
+static void publish_manpage_catalogue(struct manpage_catalogue *c, bool pages_changed)
+{
+    pthread_mutex_lock(&index_state.lock);
+    if (index_state.complete)
+    {
+        /* never taken over by the main thread */
+        free_manpage_catalogue(index_state.complete);
+        free(index_state.complete);
+    }
+    index_state.complete = c;
+    index_state.pages_changed |= pages_changed;
+    struct manpage_catalogue **retired = index_state.retired;
+    index_state.retired = NULL;
+    pthread_mutex_unlock(&index_state.lock);
+
+    latest_catalogue = c;
+
+    post_index_update();
+
+    for (int i = 0; i < sb_count(retired); i++)
+    {
+        free_manpage_catalogue(retired[i]);
+        free(retired[i]);
+    }
+
+    sb_free(retired);
+}
+
+#define DESC_ROUND_PAGES 1024
+#define DESC_PUBLISH_INTERVAL 1.0 /* s */
+
+/* pages without a description, read from the pages themselves by the workers */
+struct desc_queue {
+    char **keys;
+    char **files;
+    char **descs;
+    int end; /* of the current round */
+    int next;
+};
+
+static void *desc_worker(void *arg)
+{
+    struct desc_queue *queue = (struct desc_queue *)arg;
+
+    for (;;)
+    {
+        int i = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED);
+        if (i >= queue->end)
+            break;
+
+        char desc[512];
+        if (whatis_extract(queue->files[i], desc, sizeof(desc)) == 0)
+            queue->descs[i] = strdup(desc);
+    }
+
+    return NULL;
+}
+
+/* publish a copy of the latest catalogue with the descriptions found in [from, to) */
+static void publish_page_descriptions(struct desc_queue *queue, int from, int to)
+{
+    struct manpage_catalogue *c = ZMALLOC(struct manpage_catalogue, 1);
+    copy_manpage_catalogue(c, latest_catalogue);
+
+    for (int i = from; i < to; i++)
+    {
+        if (queue->descs[i])
+            hashmap_put(c->database_desc, queue->keys[i], strlen(queue->keys[i]), queue->descs[i]);
+        queue->descs[i] = NULL;
+    }
+
+    build_search_indexes(c);
+    publish_manpage_catalogue(c, false);
+}
+
+/**
+ * Pages found in directories (rather than in mandoc.db) have no description
+ * yet. Read them after the catalogue is shown, in rounds on all workers, and
+ * publish the ones found so far every DESC_PUBLISH_INTERVAL.
+ */
+static void read_page_descriptions(void)
+{
+    const struct manpage_catalogue *latest = latest_catalogue;
+    struct desc_queue queue = { NULL, NULL, NULL, 0, 0 };
+
+    for (int i = 0; i < sb_count(latest->names); i++)
+    {
+        const char *key = latest->names[i];
+        char *file;
+        char *desc;
+        if ((hashmap_get(latest->database_desc, key, strlen(key), (void **)&desc) != MAP_OK) &&
+                (hashmap_get(latest->database, key, strlen(key), (void **)&file) == MAP_OK))
+        {
+            sb_push(queue.keys, strdup(key));
+            sb_push(queue.files, strdup(file));
+            sb_push(queue.descs, NULL);
+        }
+    }
+
+    int count = sb_count(queue.keys);
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int n_threads = (int)clamp(cpus, 1, MAX_SCAN_THREADS);
+    int published = 0;
+    double publish_time = glfwGetTime() + DESC_PUBLISH_INTERVAL;
+
+    while (queue.next < count)
+    {
+        queue.end = MIN(queue.next + DESC_ROUND_PAGES, count);
+
+        pthread_t threads[MAX_SCAN_THREADS];
+        int started = 0;
+        for (int i = 1; i < n_threads; i++)
+        {
+            if (pthread_create(&threads[started], NULL, &desc_worker, &queue) == 0)
+                started++;
+        }
+
+        desc_worker(&queue);
+
+        for (int i = 0; i < started; i++)
+            pthread_join(threads[i], NULL);
+
+        queue.next = queue.end;
+
+        if ((queue.end == count) || (glfwGetTime() >= publish_time))
+        {
+            publish_page_descriptions(&queue, published, queue.end);
+            published = queue.end;
+            publish_time = glfwGetTime() + DESC_PUBLISH_INTERVAL;
+        }
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        free(queue.keys[i]);
+        free(queue.files[i]);
+    }
+
+    sb_free(queue.keys);
+    sb_free(queue.files);
+    sb_free(queue.descs);
+}
+
+static void publish_complete_database(void)
+{
+    struct manpage_catalogue *c = ZMALLOC(struct manpage_catalogue, 1);
+    init_manpage_catalogue(c);
+
+    struct pending_index pending;
+    bool scanned = make_manpage_database(c, &pending);
+    build_search_indexes(c);
+
+    publish_manpage_catalogue(c, true);
+
+    if (!scanned)
+        return;
+
+    /* the names are shown, the index is written once the descriptions are there */
+    read_page_descriptions();
+
+    if (pending.filename[0])
+        write_manpage_index(latest_catalogue, pending.filename, pending.dirs, pending.stamps);
+
+    free(pending.stamps);
+    free_manpage_directories(pending.dirs);
+}
+
+#ifdef __linux__
+
+/* position of a man path in the search order, later paths override earlier ones */
+static int man_path_priority(const char *path)
+{
+    const char * const *paths;
+    size_t number_of_paths = get_man_paths(&paths);
+
+    for (size_t ipath = 0; ipath < number_of_paths; ipath++)
+    {
+        if (strcmp(paths[ipath], path) == 0)
+            return ipath;
+    }
+
+    return -1;
+}
+
+/* first name which doesn't sort before name_lower */
+static int lower_bound_manpage_name(const struct manpage_catalogue *c, const char *name_lower)
+{
+    int lo = 0;
+    int hi = sb_count(c->names_lower);
+
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (strcmp(c->names_lower[mid], name_lower) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+static int find_manpage_name(const struct manpage_catalogue *c, const char *key, const char *key_lower)
+{
+    for (int i = lower_bound_manpage_name(c, key_lower);
+            (i < sb_count(c->names)) && (strcmp(c->names_lower[i], key_lower) == 0); i++)
+    {
+        if (strcmp(c->names[i], key) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+/* pages of dir, read once per batch of changes and kept in listings */
+static const struct scan_job *get_directory_listing(struct scan_job **listings, const char *dir, const char *path)
+{
+    for (int i = 0; i < sb_count(*listings); i++)
+    {
+        if (strcmp((*listings)[i].dir, dir) == 0)
+            return &(*listings)[i];
+    }
+
+    struct scan_job job = { strdup(dir), path, 0, NULL };
+    read_manpage_directory(&job, dir);
+
+    if (sb_count(job.pages) > 1)
+        qsort(job.pages, sb_count(job.pages), sizeof(struct scanned_page), &cmp_scanned_page_file);
+
+    sb_push(*listings, job);
+
+    return &sb_last(*listings);
+}
+
+static void free_directory_listings(struct scan_job *listings)
+{
+    for (int i = 0; i < sb_count(listings); i++)
+    {
+        for (int j = 0; j < sb_count(listings[i].pages); j++)
+        {
+            free(listings[i].pages[j].key);
+            free(listings[i].pages[j].file);
+            free(listings[i].pages[j].desc);
+        }
+
+        sb_free(listings[i].pages);
+        free((char *)listings[i].dir);
+    }
+
+    sb_free(listings);
+}
+
+/**
+ * A removed page may still be installed in another man path, or under
+ * another file name in the same one. Find the file which is used now that
+ * the removed one is gone: later paths override earlier ones, so they are
+ * searched first, and within a directory the last file in glob() order wins.
+ */
+static const struct scanned_page *find_replacement_page(struct scan_job **listings, const struct index_change *ch, const char **path)
+{
+    /* ch->file is <man path>/manN/<name> */
+    const char *name = strrchr(ch->file, '/');
+    const char *mandir = name;
+    while ((mandir > ch->file) && (mandir[-1] != '/'))
+        mandir--;
+
+    if ((name == NULL) || (mandir == ch->file))
+        return NULL;
+
+    const char * const *paths;
+    size_t number_of_paths = get_man_paths(&paths);
+
+    for (size_t ipath = number_of_paths; ipath-- > 0;)
+    {
+        char dir[1024];
+        snprintf(dir, sizeof(dir), "%s/%.*s", paths[ipath], (int)(name - mandir), mandir);
+
+        const struct scan_job *job = get_directory_listing(listings, dir, paths[ipath]);
+        const struct scanned_page *found = NULL;
+
+        for (int i = 0; i < sb_count(job->pages); i++)
+        {
+            if ((strcmp(job->pages[i].key, ch->key) == 0) && (strcmp(job->pages[i].file, ch->file) != 0))
+                found = &job->pages[i];
+        }
+
+        if (found)
+        {
+            *path = paths[ipath];
+            return found;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Apply one change reported by the watcher, keeping the name arrays sorted.
+ * Directories read to find replacements of removed pages are kept in
+ * listings. Returns true if the catalogue changed.
+ */
+static bool apply_index_change(struct manpage_catalogue *c, struct index_change *ch, struct scan_job **listings)
+{
+    char *file = NULL;
+    char *pwd = NULL;
+    hashmap_get(c->database, ch->key, strlen(ch->key), (void **)&file);
+    hashmap_get(c->database_pwd, ch->key, strlen(ch->key), (void **)&pwd);
+
+    char key_lower[577];
+    snprintf(key_lower, sizeof(key_lower), "%s", ch->key);
+    for (char *p = key_lower; *p; p++)
+        *p = tolower(*p);
+
+    if (ch->removed)
+    {
+        /* only if it's the file we know, otherwise a page of another man path was removed */
+        if ((file == NULL) || (strcmp(file, ch->file) != 0))
+            return false;
+
+        const char *path;
+        const struct scanned_page *replacement = find_replacement_page(listings, ch, &path);
+        if (replacement)
+        {
+            /* the name stays, with the file which is next in line */
+            char desc[512];
+            bool has_desc = whatis_extract(replacement->file, desc, sizeof(desc)) == 0;
+            add_manpage_to_database(c, ch->key, strdup(replacement->file), strdup(path), has_desc ? strdup(desc) : NULL);
+            return true;
+        }
+
+        char *desc = NULL;
+        hashmap_get(c->database_desc, ch->key, strlen(ch->key), (void **)&desc);
+        hashmap_remove(c->database, ch->key, strlen(ch->key));
+        hashmap_remove(c->database_pwd, ch->key, strlen(ch->key));
+        hashmap_remove(c->database_desc, ch->key, strlen(ch->key));
+        free(file);
+        free(pwd);
+        free(desc);
+
+        int i = find_manpage_name(c, ch->key, key_lower);
+        if (i >= 0)
+        {
+            int count = sb_count(c->names);
+            free(c->names[i]);
+            free(c->names_lower[i]);
+            memmove(&c->names[i], &c->names[i + 1], (count - i - 1) * sizeof(char *));
+            memmove(&c->names_lower[i], &c->names_lower[i + 1], (count - i - 1) * sizeof(char *));
+            stb__sbn(c->names)--;
+            stb__sbn(c->names_lower)--;
+        }
+
+        return true;
+    }
+
+    if (file && (strcmp(file, ch->file) != 0) && (man_path_priority(pwd) > man_path_priority(ch->path)))
+        return false; /* overridden by a later man path */
+
+    char desc[512];
+    bool has_desc = whatis_extract(ch->file, desc, sizeof(desc)) == 0;
+
+    if (file && (strcmp(file, ch->file) == 0))
+    {
+        /* already known, the page was written after it was created */
+        char *old_desc = NULL;
+        hashmap_get(c->database_desc, ch->key, strlen(ch->key), (void **)&old_desc);
+        if (!has_desc || (old_desc && (strcmp(old_desc, desc) == 0)))
+            return false;
+    }
+
+    int count = sb_count(c->names);
+    add_manpage_to_database(c, ch->key, strdup(ch->file), strdup(ch->path), has_desc ? strdup(desc) : NULL);
+
+    if (sb_count(c->names) > count)
+    {
+        /* new name was appended, move it to its place */
+        char *name = c->names[count];
+        char *name_lower = c->names_lower[count];
+        int i = lower_bound_manpage_name(c, name_lower);
+        if (i > count)
+            i = count;
+
+        memmove(&c->names[i + 1], &c->names[i], (count - i) * sizeof(char *));
+        memmove(&c->names_lower[i + 1], &c->names_lower[i], (count - i) * sizeof(char *));
+        c->names[i] = name;
+        c->names_lower[i] = name_lower;
+    }
+
+    return true;
+}
+
+#define MANPATH_WATCH_MASK (IN_CREATE | IN_MOVED_TO | IN_ONLYDIR)
+#define MANDIR_WATCH_MASK (IN_CREATE | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR)
+
+struct watched_dir {
+    int wd;
+    const char *path;
+    const char *section; /* NULL for the man path itself */
+};
+
+/* inotify watches on all man paths and their manN directories, used by the watcher thread only */
+struct {
+    int fd;
+    const char * const *paths;
+    size_t number_of_paths;
+    struct watched_dir *dirs;
+} manpage_watcher = { .fd = -1 };
+
+static void watch_directory(const char *path, const char *section)
+{
+    char dir[1024];
+    if (section)
+        snprintf(dir, sizeof(dir), "%s/man%s", path, section);
+    else
+        snprintf(dir, sizeof(dir), "%s", path);
+
+    int wd = inotify_add_watch(manpage_watcher.fd, dir, section ? MANDIR_WATCH_MASK : MANPATH_WATCH_MASK);
+    if (wd == -1)
+    {
+        if ((errno != ENOENT) && (errno != ENOTDIR))
+            warn("%s: inotify_add_watch", dir);
+        return;
+    }
+
+    for (int i = 0; i < sb_count(manpage_watcher.dirs); i++)
+    {
+        if (manpage_watcher.dirs[i].wd == wd)
+            return; /* same directory reached through another path */
+    }
+
+    struct watched_dir w = { wd, path, section };
+    sb_push(manpage_watcher.dirs, w);
+}
+
+/**
+ * Start watching before the directories are scanned, so no change
+ * can fall between the scan and the watch.
+ */
+static int watch_manpage_directories(void)
+{
+    manpage_watcher.fd = inotify_init1(IN_CLOEXEC);
+    if (manpage_watcher.fd == -1)
+    {
+        warn("inotify_init1");
+        return -1;
+    }
+
+    manpage_watcher.number_of_paths = get_man_paths(&manpage_watcher.paths);
+
+    for (size_t ipath = 0; ipath < manpage_watcher.number_of_paths; ipath++)
+    {
+        watch_directory(manpage_watcher.paths[ipath], NULL);
+
+        for (size_t isec = 0; isec < ARRAY_SIZE(manpage_sections); isec++)
+            watch_directory(manpage_watcher.paths[ipath], manpage_sections[isec]);
+    }
+
+    return 0;
+}
+
+static void add_index_change(struct index_change **changes, const char *key, const char *file, const char *path, bool removed)
+{
+    struct index_change ch = { strdup(key), strdup(file), path, removed };
+    sb_push(*changes, ch);
+}
+
+static void handle_watch_event(const struct inotify_event *ev, struct index_change **changes)
+{
+    const struct watched_dir *w = NULL;
+    for (int i = 0; i < sb_count(manpage_watcher.dirs); i++)
+    {
+        if (manpage_watcher.dirs[i].wd == ev->wd)
+        {
+            w = &manpage_watcher.dirs[i];
+            break;
+        }
+    }
+
+    if ((w == NULL) || (ev->len == 0) || (ev->name[0] == '.'))
+        return;
+
+    if (w->section == NULL)
+    {
+        /* a new manN directory in a man path */
+        for (size_t isec = 0; isec < ARRAY_SIZE(manpage_sections); isec++)
+        {
+            if ((strncmp(ev->name, "man", 3) != 0) || (strcmp(ev->name + 3, manpage_sections[isec]) != 0))
+                continue;
+
+            const char *path = w->path;
+            watch_directory(path, manpage_sections[isec]); /* may move w */
+
+            char dir[1024];
+            snprintf(dir, sizeof(dir), "%s/%s", path, ev->name);
+
+            struct scan_job job = { dir, path, 0, NULL };
+            read_manpage_directory(&job, dir);
+
+            for (int i = 0; i < sb_count(job.pages); i++)
+            {
+                struct index_change ch = { job.pages[i].key, job.pages[i].file, path, false };
+                sb_push(*changes, ch);
+                free(job.pages[i].desc);
+            }
+
+            sb_free(job.pages);
+        }
+        return;
+    }
+
+    if (ev->mask & IN_ISDIR)
+        return;
+
+    char file[1024];
+    snprintf(file, sizeof(file), "%s/man%s/%s", w->path, w->section, ev->name);
+
+    char page_name[512];
+    char section_name[64];
+    if (get_page_name_and_section(file, page_name, sizeof(page_name), section_name, sizeof(section_name)) != 0)
+        return;
+
+    char key[577];
+    snprintf(key, sizeof(key), "%s(%s)", page_name, section_name);
+
+    if (ev->mask & (IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO))
+    {
+        add_index_change(changes, key, file, w->path, false);
+    }
+    else if (ev->mask & (IN_DELETE | IN_MOVED_FROM))
+    {
+        add_index_change(changes, key, file, w->path, true);
+    }
+}
+
+/**
+ * Apply the changes of one batch of events to a copy of the latest
+ * catalogue and publish it, so the main thread only has to swap it in.
+ */
+static void apply_index_changes(struct index_change *changes)
+{
+    struct manpage_catalogue *c = ZMALLOC(struct manpage_catalogue, 1);
+    copy_manpage_catalogue(c, latest_catalogue);
+
+    struct scan_job *listings = NULL;
+    bool changed = false;
+    for (int i = 0; i < sb_count(changes); i++)
+    {
+        if (apply_index_change(c, &changes[i], &listings))
+            changed = true;
+
+        free(changes[i].key);
+        free(changes[i].file);
+    }
+
+    sb_free(changes);
+    free_directory_listings(listings);
+
+    if (!changed)
+    {
+        free_manpage_catalogue(c);
+        free(c);
+        return;
+    }
+
+    /* name indices have moved */
+    build_search_indexes(c);
+
+    publish_manpage_catalogue(c, true);
+}
+
+static void *manpage_watcher_thread(void *arg)
+{
+    char buffer[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    for (;;)
+    {
+        ssize_t len = read(manpage_watcher.fd, buffer, sizeof(buffer));
+        if (len <= 0)
+        {
+            if ((len < 0) && (errno == EINTR))
+                continue;
+
+            warn("inotify read");
+            break;
+        }
+
+        struct index_change *changes = NULL;
+        bool overflow = false;
+
+        for (char *ptr = buffer; ptr < buffer + len;)
+        {
+            const struct inotify_event *ev = (const struct inotify_event *)ptr;
+
+            if (ev->mask & IN_Q_OVERFLOW)
+                overflow = true;
+            else
+                handle_watch_event(ev, &changes);
+
+            ptr += sizeof(struct inotify_event) + ev->len;
+        }
+
+        if (changes)
+            apply_index_changes(changes);
+
+        if (overflow)
+        {
+            /* events were lost, start over */
+            publish_complete_database();
+        }
+    }
+
+    return NULL;
+}
+
+#endif
+
+static void *manpage_database_thread(void *arg)
+{
+#ifdef __linux__
+    bool watching = watch_manpage_directories() == 0;
+#endif
+
+    publish_complete_database();
+
+#ifdef __linux__
+    if (watching)
+        manpage_watcher_thread(NULL); /* keep applying changes for the rest of the session */
+#endif
+
+    return NULL;
+}
+
+/**
+ * Build the database on a background thread. Until it is complete, the main
+ * thread fills a preliminary catalogue with pages from already scanned
+ * directories (see poll_manpage_database).
+ */
+void start_manpage_database(void)
+{
+    pthread_t thread;
+
+    if (pthread_create(&thread, NULL, &manpage_database_thread, NULL) != 0)
+    {
+        /* build it right here then */
+        manpage_database_thread(NULL);
+        return;
+    }
+
+    pthread_detach(thread);
+}
+
+/* published by the index thread and shared with it, never changed once taken over */
+static struct manpage_catalogue *complete_catalogue;
+
+static struct manpage_catalogue current_manpage_catalogue(void)
+{
+    struct manpage_catalogue c = { manpage_names, manpage_names_lower, manpage_database, manpage_database_pwd,
+        manpage_database_desc, manpage_index, manpage_desc_index };
+    return c;
+}
+
+static void set_manpage_catalogue(const struct manpage_catalogue *c)
+{
+    manpage_names = c->names;
+    manpage_names_lower = c->names_lower;
+    manpage_database = c->database;
+    manpage_database_pwd = c->database_pwd;
+    manpage_database_desc = c->database_desc;
+    manpage_index = c->index;
+    manpage_desc_index = c->desc_index;
+}
+
+void refresh_links(void)
+{
+    for (int i = 0; i < sb_count(page_stack); i++)
+    {
+        struct manpage *p = page_stack[i].ptr;
+        if (p)
+        {
+            sb_free(p->links);
+            p->links = NULL;
+            find_links(p, 0);
+        }
+    }
+
+    /* cached pages get theirs when they are used again */
+    for (int i = 0; i < sb_count(page_cache.pages); i++)
+        page_cache.pages[i].links_stale = true;
+
+    if (page && (stack_pos > 0))
+        prefetch_links(page);
+}
+
+/**
+ * Rerun the page name search after the catalogue changed and keep
+ * the same page selected if it's still among the results.
+ */
+void refresh_search(const char *selected_name)
+{
+    int view_position = results_selected_index - results_view_offset;
+
+    set_search_results(NULL); /* match indices refer to the old catalogue */
+    update_search();
+
+    if (selected_name)
+    {
+        snprintf(search_selected_name, sizeof(search_selected_name), "%s", selected_name);
+        search_selected_view_position = view_position;
+    }
+}
+
+/* select the result named search_selected_name, without ordering all results */
+static void select_search_result(void)
+{
+    const struct match *selected = NULL;
+    for (int i = 0; i < matches_count; i++)
+    {
+        const struct match *m = &matches_heap[i];
+        if (strcmp(manpage_names[m->idx], search_selected_name) == 0)
+        {
+            selected = m;
+            break;
+        }
+    }
+
+    if (selected == NULL)
+        return;
+
+    int rank = 0;
+    for (int i = 0; i < matches_count; i++)
+    {
+        if (match_is_better(&matches_heap[i], selected))
+            rank++;
+    }
+
+    results_selected_index = rank;
+    results_view_offset = MAX(0, rank - search_selected_view_position);
+}
+
+static void apply_page_search(struct manpage *p, const struct page_search_hit *hits, int n_hits)
+{
+    int search_len = strlen(p->search_string);
+    int selected = p->search_index;
+
+    p->search_num = 0;
+    p->search_index = 0;
+    int search_index_set = 0;
+
+    for (int k = 0; k < n_hits; k++)
+    {
+        search_t *s = &p->searches[p->search_num];
+
+        s->document_rectangle.x = hits[k].column * get_character_width();
+        s->document_rectangle.y = hits[k].line * get_line_advance();
+        s->document_rectangle.x2 = s->document_rectangle.x + search_len * get_character_width();
+        s->document_rectangle.y2 = s->document_rectangle.y + get_line_height();
+
+        if ((s->document_rectangle.y + get_dimension(DIM_DOCUMENT_MARGIN)) >= p->search_start_scroll_position)
+        {
+            if (search_index_set == 0)
+                p->search_index = p->search_num;
+            search_index_set = 1;
+        }
+
+        p->search_num++;
+    }
+
+    if (p->search_extended)
+    {
+        /* the hits it had come first again */
+        p->search_index = MIN(selected, MAX(p->search_num - 1, 0));
+        p->search_extended = false;
+        return;
+    }
+
+    if ((p == page) && (p->search_num > 0))
+    {
+        scroll_in_view(to_document_coordinates(p->searches[p->search_index].document_rectangle), p->search_start_scroll_position);
+    }
+}
+
+/**
+ * Called from the main loop: show the results of finished searches
+ * unless a newer search has been started since.
+ */
+void poll_search_results(void)
+{
+    struct match *name_results = NULL;
+    bool have_name_results = false;
+    struct page_search_hit page_hits[MAX_PAGE_SEARCHES];
+    int page_n_hits = 0;
+    struct manpage *page_target = NULL;
+
+    pthread_mutex_lock(&search_worker.lock);
+
+    if (search_worker.name_results_ready && (search_worker.name_results_generation == search_worker.name_generation))
+    {
+        name_results = search_worker.name_results;
+        have_name_results = true;
+        search_worker.name_results = NULL;
+        search_worker.name_results_ready = false;
+    }
+
+    if (search_worker.page_results_ready && (search_worker.page_results_generation == search_worker.page_generation))
+    {
+        page_target = search_worker.page_results_target;
+        page_n_hits = search_worker.page_n_hits;
+        memcpy(page_hits, search_worker.page_hits, page_n_hits * sizeof(struct page_search_hit));
+        search_worker.page_results_ready = false;
+    }
+
+    pthread_mutex_unlock(&search_worker.lock);
+
+    if (have_name_results)
+    {
+        set_search_results(name_results);
+        if (search_selected_name[0])
+            select_search_result();
+        post_redisplay();
+    }
+
+    if (page_target)
+    {
+        apply_page_search(page_target, page_hits, page_n_hits);
+        post_redisplay();
+    }
+}
+
+/**
+ * Called from the main loop: take over pages scanned by the index thread
+ * and changes of the man directories reported by the watcher.
+ */
+void poll_manpage_database(void)
+{
+    pthread_mutex_lock(&index_state.lock);
+    struct scan_batch *batches = index_state.batches;
+    struct manpage_catalogue *complete = index_state.complete;
+    bool pages_changed = index_state.pages_changed;
+    index_state.batches = NULL;
+    index_state.complete = NULL;
+    index_state.pages_changed = false;
+    pthread_mutex_unlock(&index_state.lock);
+
+    if ((batches == NULL) && (complete == NULL))
+        return;
+
+    char selected_name[577];
+    selected_name[0] = 0;
+    if ((display_mode == D_SEARCH) && (results_selected_index < matches_count))
+        snprintf(selected_name, sizeof(selected_name), "%s", manpage_names[get_match(results_selected_index)->idx]);
+
+    /* batches of a rebuild started by the watcher are ignored, only its result counts */
+    bool preliminary = !manpage_database_ready && (complete == NULL);
+    bool changed = complete || (preliminary && batches);
+    bool names_changed = (complete && pages_changed) || (preliminary && batches);
+
+    pause_name_search();
+
+    if (names_changed)
+    {
+        /* built again over the new names when an exact search needs it */
+        trigram_index_free(manpage_trigrams);
+        manpage_trigrams = NULL;
+    }
+
+    struct manpage_catalogue c = current_manpage_catalogue();
+
+    if (complete)
+    {
+        /* the final catalogue replaces the preliminary (or outdated) one */
+        if (complete_catalogue)
+        {
+            /* freeing all of its strings is left to the index thread */
+            pthread_mutex_lock(&index_state.lock);
+            sb_push(index_state.retired, complete_catalogue);
+            pthread_mutex_unlock(&index_state.lock);
+        }
+        else
+        {
+            free_manpage_catalogue(&c);
+        }
+
+        complete_catalogue = complete;
+        c = *complete;
+        manpage_database_ready = true;
+    }
+
+    for (int i = 0; i < sb_count(batches); i++)
+    {
+        for (int j = 0; j < sb_count(batches[i].pages); j++)
+        {
+            struct scanned_page *sp = &batches[i].pages[j];
+            if (preliminary)
+            {
+                add_manpage_to_database(&c, sp->key, sp->file, strdup(batches[i].path), sp->desc);
+            }
+            else
+            {
+                free(sp->file);
+                free(sp->desc);
+            }
+            free(sp->key);
+        }
+
+        sb_free(batches[i].pages);
+    }
+
+    sb_free(batches);
+
+    set_manpage_catalogue(&c);
+    resume_name_search(changed);
+
+    if (!changed)
+        return;
+
+    /* match indices refer to the old name arrays */
+    refresh_search(selected_name[0] ? selected_name : NULL);
+
+    if (complete && !pages_changed)
+    {
+        /* only more descriptions */
+        post_redisplay();
+        return;
+    }
+
+    if (manpage_database_ready)
+        refresh_links();
+
+    /* pages may have been added or removed */
+    update_fulltext_index();
+
+    post_redisplay();
+}
+
+void change_dir(const char *path)
+{
+    if (chdir(path) != 0)
+    {
+        fprintf(stderr, "Failed to change directory to \"%s\" (%s).\n", path, strerror(errno));
+    }
+}
+
+/**
+ * Read and parse a page file, NULL if it can't be opened. Pages which only
+ * include another one (.so) are followed if follow_so is set, relative to
+ * pwd (the current directory if it's NULL or empty). Messages of the
+ * parser go to stderr unless quiet is set.
+ */
+static struct page_source *parse_manpage(const char *filename, const char *pwd, bool follow_so, bool quiet)
+{
+    pthread_mutex_lock(&parse_lock);
+
+    if (pwd && pwd[0])
+        change_dir(pwd);
+
+    struct mparse *parse = mparse_alloc((follow_so ? MPARSE_SO : 0) | MPARSE_UTF8 | MPARSE_LATIN1 | MPARSE_VALIDATE /*options=autodetect document type*/,
+            MANDOC_OS_OTHER /*mandoc_os = automatically detect*/,
+            NULL /*os_s = string passed to override the result of uname*/);
+
+    mandoc_msg_setinfilename(filename);
+    mandoc_msg_setoutfile(quiet ? NULL : stderr);
+
+    /* a change while it's read makes the page stale, not the other way around */
+    struct doc_source stamp;
+    doc_cache_stat(filename, &stamp);
+
+    int fd = mparse_open(parse, filename); // open a file and if it fails try appending .gz
+
+    if (fd == -1)
+    {
+        int open_errno = errno;
+        mparse_free(parse);
+        pthread_mutex_unlock(&parse_lock);
+        errno = open_errno;
+        return NULL;
+    }
+
+    mparse_readfd(parse, fd, filename);
+
+    close(fd);
+
+    pthread_mutex_unlock(&parse_lock);
+
+    struct page_source *src = ZMALLOC(struct page_source, 1);
+    src->parse = parse;
+    src->meta = mparse_result(parse);
+    pthread_mutex_init(&src->lock, NULL);
+    src->refs = 1;
+    src->stamp = stamp;
+
+    return src;
+}
+
+/**
+ * Format the parsed page file src at line_length columns. The lines are
+ * handed over to stream while it's formatted unless it's NULL.
+ */
+static struct manpage *layout_manpage(struct page_source *src, const char *filename, int line_length, bool quiet,
+        struct page_stream *stream)
+{
+    struct manpage *page = ZMALLOC(struct manpage, 1);
+
+    snprintf(page->filename, sizeof(page->filename), "%s", filename);
+    page->line_length = line_length;
+    page->stamp = src->stamp;
+    page->source = hold_page_source(src);
+
+    get_page_name_and_section(filename, page->manpage_name, sizeof(page->manpage_name), page->manpage_section, sizeof(page->manpage_section));
+
+    doc_add_line(&page->document);
+
+    struct format_output out = {page, quiet, stream, 0, STREAM_FIRST_CHUNK};
+    void *formatter = mangl_formatter(line_length, 5, &out);
+
+    pthread_mutex_lock(&src->lock);
+
+    mandoc_msg_setinfilename(filename);
+    mandoc_msg_setoutfile(quiet ? NULL : stderr);
+
+    if (src->meta->macroset == MACROSET_MDOC)
+    {
+        terminal_mdoc(formatter, src->meta); // for mdoc format
+    }
+    else
+    {
+        terminal_man(formatter, src->meta);
+    }
+
+    pthread_mutex_unlock(&src->lock);
+
+    /* remove the last line empty line */
+    if ((page->document.n_lines > 1) && (page->document.lines[page->document.n_lines - 1].length == 0))
+        doc_remove_last_line(&page->document);
+
+    mangl_formatter_free(formatter);
+
+    return page;
+}
+
+/**
+ * Format a page at line_length columns, NULL if the file can't be opened,
+ * see parse_manpage() and layout_manpage(). The page keeps the parsed
+ * document.
+ */
+static struct manpage *format_manpage(const char *filename, const char *pwd, int line_length, bool follow_so, bool quiet,
+        struct page_stream *stream)
+{
+    struct page_source *src = parse_manpage(filename, pwd, follow_so, quiet);
+    if (src == NULL)
+        return NULL;
+
+    struct manpage *page = layout_manpage(src, filename, line_length, quiet, stream);
+    drop_page_source(src);
+
+    return page;
+}
+
+/*
+ * Pages which take at least this long (in seconds) to format are stored
+ * in the cache directory, opening them again only maps the file.
+ */
+#define DOC_CACHE_MIN_FORMAT_TIME 0.02
+
+/* page stored by store_manpage(), NULL if there is none for this line length or the file changed */
+static struct manpage *load_cached_manpage(const char *filename, int line_length)
+{
+    struct doc_source stamp;
+    struct doc_cache dc;
+    if (doc_cache_open(filename, line_length, &dc, &stamp) != 0)
+        return NULL;
+
+    struct manpage *page = ZMALLOC(struct manpage, 1);
+
+    snprintf(page->filename, sizeof(page->filename), "%s", filename);
+    page->line_length = line_length;
+    page->stamp = stamp;
+    page->cache = dc;
+
+    get_page_name_and_section(filename, page->manpage_name, sizeof(page->manpage_name), page->manpage_section, sizeof(page->manpage_section));
+
+    /* the document has no blocks, the cells belong to the mapping */
+    int n_lines = doc_cache_n_lines(&dc);
+    page->document.lines = ZMALLOC(struct doc_line, n_lines + 1);
+    page->document.n_lines = n_lines;
+    page->document.lines_allocated = n_lines + 1;
+
+    for (int i = 0; i < n_lines; i++)
+        page->document.lines[i] = doc_cache_line(&dc, i);
+
+    return page;
+}
+
+/* store a formatted page in the cache directory */
+static void store_manpage(const struct manpage *p)
+{
+    if (doc_cache_write(p->filename, &p->stamp, p->line_length, p->document.lines, p->document.n_lines) != 0)
+        fprintf(stderr, "Failed to store the formatted page %s in the cache.\n", p->filename);
+}
+
+static bool page_load_is_stale(const struct page_load *load);
+
+/**
+ * Page from the cache directory or formatted (and stored if that was slow),
+ * NULL if the file can't be opened. The lines of a formatted page are
+ * handed over to stream unless it's NULL. If load is set and has been
+ * replaced by another request once the file is parsed, the page isn't laid
+ * out and NULL is returned with errno set to ECANCELED.
+ */
+static struct manpage *read_manpage(const char *filename, const char *pwd, int line_length, bool quiet,
+        struct page_stream *stream, const struct page_load *load)
+{
+    struct manpage *page = load_cached_manpage(filename, line_length);
+
+    if (page == NULL)
+    {
+        double start_time = glfwGetTime();
+
+        struct page_source *src = parse_manpage(filename, pwd, true, quiet);
+        if (src == NULL)
+            return NULL;
+
+        if (load && page_load_is_stale(load))
+        {
+            drop_page_source(src);
+            errno = ECANCELED;
+            return NULL;
+        }
+
+        page = layout_manpage(src, filename, line_length, quiet, stream);
+        drop_page_source(src);
+
+        /* the stored page is only checked against its own file, not the ones it includes */
+        if (((glfwGetTime() - start_time) >= DOC_CACHE_MIN_FORMAT_TIME) && (mparse_so_count(page->source->parse) == 0))
+            store_manpage(page);
+    }
+
+    snprintf(page->pwd, sizeof(page->pwd), "%s", pwd ? pwd : "");
+
+    return page;
+}
+
+struct manpage *load_manpage(const char *filename, const char *pwd)
+{
+    /* a page without a directory of its own includes files relative to the one before */
+    const char *dir = (pwd && pwd[0]) ? pwd : (page ? page->pwd : NULL);
+
+    struct manpage *new_page = read_manpage(filename, dir, settings.current_line_length, false, NULL, NULL);
+
+    if (new_page == NULL)
+    {
+        fprintf(stderr, "Failed to open file %s (%s)\n", filename, strerror(errno));
+        exit(1);
+    }
+
+    snprintf(new_page->pwd, sizeof(new_page->pwd), "%s", pwd ? pwd : "");
+
+    find_links(new_page, 0); // update links
+
+    return new_page;
+}
+
+int cmp_string(const void *a, const void *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/* formatted text of a page for the full-text index, lines separated by '\n' (stretchy buffer) */
+static char *get_manpage_text(const char *filename)
+{
+    /* .so pages are left alone, their targets are indexed by themselves */
+    struct manpage *p = format_manpage(filename, NULL, settings.line_length, false, true, NULL);
+    if (p == NULL)
+        return NULL;
+
+    char *text = NULL;
+
+    for (int i = 0; i < p->document.n_lines; i++)
+    {
+        char line[2048];
+        int len = get_line_text(p, i, line, sizeof(line));
+
+        /* the header and footer only repeat the title, keep the line numbers though */
+        if ((i == 0) || (i == p->document.n_lines - 1))
+            len = 0;
+
+        memcpy(sb_add(text, len), line, len);
+        sb_push(text, '\n');
+    }
+
+    sb_push(text, 0);
+    free_manpage(p);
+
+    return text;
+}
+
+/* update the index file from the given files (sorted), false if it didn't change */
+static bool build_fulltext_index(char **files)
+{
+    char filename[1024];
+    if (manindex_cache_filename("fulltext", filename, sizeof(filename)) != 0)
+        return false;
+
+    int n_files = sb_count(files);
+    struct manindex_stamp *stamps = ZMALLOC(struct manindex_stamp, n_files + 1);
+    manindex_stat_dirs((const char * const *)files, n_files, stamps);
+
+    struct fulltext old;
+    fulltext_open(filename, &old); /* stays unmapped if there is none */
+
+    int n_old = fulltext_doc_count(&old);
+    char *keep = ZMALLOC(char, n_old + 1);
+    int n_kept = 0;
+
+    map_t old_docs = hashmap_new(); /* file -> doc + 1 */
+    for (int d = 0; d < n_old; d++)
+    {
+        const char *file = fulltext_doc_file(&old, d);
+        hashmap_put(old_docs, file, strlen(file), (void *)(intptr_t)(d + 1));
+    }
+
+    int *changed = NULL; /* files to format */
+    for (int i = 0; i < n_files; i++)
+    {
+        if ((stamps[i].sec == 0) && (stamps[i].nsec == 0))
+            continue; /* gone */
+
+        /* a link to another page of the list is found as that page */
+        char real[PATH_MAX];
+        const char *target = real;
+        if ((realpath(files[i], real) != NULL) && (strcmp(real, files[i]) != 0) &&
+                bsearch(&target, files, n_files, sizeof(char *), &cmp_string))
+            continue;
+
+        void *value = NULL;
+        if (hashmap_get(old_docs, files[i], strlen(files[i]), &value) == MAP_OK)
+        {
+            int d = (intptr_t)value - 1;
+            int64_t sec, nsec;
+            fulltext_doc_mtime(&old, d, &sec, &nsec);
+
+            if ((sec == stamps[i].sec) && (nsec == stamps[i].nsec) && !keep[d])
+            {
+                keep[d] = 1;
+                n_kept++;
+                continue;
+            }
+        }
+
+        sb_push(changed, i);
+    }
+
+    hashmap_free(old_docs);
+
+    bool updated = false;
+
+    if ((sb_count(changed) > 0) || (n_kept < n_old))
+    {
+        __atomic_store_n(&fulltext_state.n_done, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&fulltext_state.n_total, sb_count(changed), __ATOMIC_RELAXED);
+
+        struct fulltext_builder *b = fulltext_builder_new();
+        bool failed = (b == NULL) || ((n_kept > 0) && (fulltext_builder_add_unchanged(b, &old, keep) != 0));
+
+        for (int k = 0; (k < sb_count(changed)) && !failed; k++)
+        {
+            int i = changed[k];
+            char *text = get_manpage_text(files[i]);
+
+            if (text)
+                failed = fulltext_builder_add(b, files[i], stamps[i].sec, stamps[i].nsec, text) != 0;
+
+            sb_free(text);
+
+            __atomic_store_n(&fulltext_state.n_done, k + 1, __ATOMIC_RELAXED);
+            if ((k % 256) == 255)
+                glfwPostEmptyEvent(); /* show the progress */
+        }
+
+        updated = !failed && (fulltext_builder_write(b, filename) == 0);
+        if (!updated)
+            fprintf(stderr, "Failed to write the full-text index %s.\n", filename);
+
+        fulltext_builder_free(b);
+    }
+
+    sb_free(changed);
+    free(keep);
+    free(stamps);
+    fulltext_close(&old);
+
+    return updated;
+}
+
+static void *fulltext_index_thread(void *arg)
+{
+    pthread_mutex_lock(&fulltext_state.lock);
+
+    while (fulltext_state.files)
+    {
+        char **files = fulltext_state.files;
+        fulltext_state.files = NULL;
+        pthread_mutex_unlock(&fulltext_state.lock);
+
+        bool updated = build_fulltext_index(files);
+
+        for (int i = 0; i < sb_count(files); i++)
+            free(files[i]);
+        sb_free(files);
+
+        pthread_mutex_lock(&fulltext_state.lock);
+        if (updated)
+            fulltext_state.updated = true;
+    }
+
+    fulltext_state.running = false;
+    pthread_mutex_unlock(&fulltext_state.lock);
+
+    glfwPostEmptyEvent();
+
+    return NULL;
+}
+
+/**
+ * Bring the full-text index up to date with the catalogue on the index
+ * thread, if it is used at all.
+ */
+void update_fulltext_index(void)
+{
+    if (!fulltext_state.wanted || !manpage_database_ready)
+        return;
+
+    char **files = NULL;
+    for (int i = 0; i < sb_count(manpage_names); i++)
+    {
+        const char *key = manpage_names[i];
+        char *file = NULL;
+        if (hashmap_get(manpage_database, key, strlen(key), (void **)&file) == MAP_OK)
+            sb_push(files, strdup(file));
+    }
+
+    /* several names can share a file */
+    if (sb_count(files) > 1)
+        qsort(files, sb_count(files), sizeof(char *), &cmp_string);
+
+    int n_unique = 0;
+    for (int i = 0; i < sb_count(files); i++)
+    {
+        if ((n_unique > 0) && (strcmp(files[n_unique - 1], files[i]) == 0))
+            free(files[i]);
+        else
+            files[n_unique++] = files[i];
+    }
+
+    if (files)
+        stb__sbn(files) = n_unique;
+
+    pthread_mutex_lock(&fulltext_state.lock);
+
+    /* a running update takes the new list when it's done */
+    for (int i = 0; i < sb_count(fulltext_state.files); i++)
+        free(fulltext_state.files[i]);
+    sb_free(fulltext_state.files);
+
+    fulltext_state.files = files;
+
+    bool start = !fulltext_state.running;
+    fulltext_state.running = true;
+
+    pthread_mutex_unlock(&fulltext_state.lock);
+
+    if (start)
+    {
+        pthread_t thread;
+
+        if (pthread_create(&thread, NULL, &fulltext_index_thread, NULL) != 0)
+        {
+            /* build it right here then */
+            fulltext_index_thread(NULL);
+            return;
+        }
+
+        pthread_detach(thread);
+    }
+}
+
+/* full-text search was asked for, build the index if there is none */
+static void want_fulltext_index(void)
+{
+    if (fulltext_state.wanted)
+        return;
+
+    fulltext_state.wanted = true;
+    update_fulltext_index();
+}
+
+/* map the index of the last session, it's kept up to date from then on */
+void open_fulltext_index(void)
+{
+    char filename[1024];
+
+    if ((manindex_cache_filename("fulltext", filename, sizeof(filename)) == 0) &&
+            (fulltext_open(filename, &manpage_fulltext) == 0))
+        fulltext_state.wanted = true;
+}
+
+/**
+ * Called from the main loop: switch to a newly written full-text index
+ * and show the progress of the index thread.
+ */
+void poll_fulltext_index(void)
+{
+    pthread_mutex_lock(&fulltext_state.lock);
+    bool updated = fulltext_state.updated;
+    bool running = fulltext_state.running;
+    fulltext_state.updated = false;
+    pthread_mutex_unlock(&fulltext_state.lock);
+
+    if ((display_mode == D_SEARCH) && (search_mode == SEARCH_FULLTEXT) && (running || updated))
+        post_redisplay();
+
+    if (!running)
+        __atomic_store_n(&fulltext_state.n_total, 0, __ATOMIC_RELAXED);
+
+    if (!updated)
+        return;
+
+    char filename[1024];
+    if (manindex_cache_filename("fulltext", filename, sizeof(filename)) != 0)
+        return;
+
+    char selected_name[577];
+    selected_name[0] = 0;
+    if ((display_mode == D_SEARCH) && (results_selected_index < matches_count))
+        snprintf(selected_name, sizeof(selected_name), "%s", manpage_names[get_match(results_selected_index)->idx]);
+
+    /* the search worker reads the index */
+    pause_name_search();
+    fulltext_close(&manpage_fulltext);
+    fulltext_open(filename, &manpage_fulltext);
+    resume_name_search(true);
+
+    clear_fulltext_snippets();
+
+    /* results of a full-text search refer to pages of the old index */
+    if (search_mode == SEARCH_FULLTEXT)
+        refresh_search(selected_name[0] ? selected_name : NULL);
+}
+
+/**
+ * Open the page of search result i. A full-text hit opens it with the
+ * word searched for and scrolled to it.
+ */
+void open_search_result(int i)
+{
+    const struct match *m = get_match(i);
+    const char *key = manpage_names[m->idx];
+
+    char *file;
+    if (hashmap_get(manpage_database, key, strlen(key), (void **)&file) != MAP_OK)
+        return;
+
+    char *pwd = NULL;
+    hashmap_get(manpage_database_pwd, key, strlen(key), (void **)&pwd);
+
+    struct fulltext_snippet hit = { false };
+    if (m->doc >= 0)
+        hit = *get_fulltext_snippet(m);
+
+    if ((hit.line_number < 0) || (hit.word[0] == 0))
+    {
+        open_new_page(file, pwd);
+        return;
+    }
+
+    for (char *c = hit.word; *c; c++)
+        *c = tolower(*c);
+
+    /* the index was formatted at the default line length, the page may be wider or narrower */
+    int line_length = get_page_line_length();
+    int line = (long)hit.line_number * settings.line_length / line_length;
+
+    request_page(file, pwd, line_length, LOAD_OPEN, hit.word, line);
+}
+
+/* search for word in a page which was just opened, scrolled to line */
+static void show_search_hit(struct manpage *p, const char *word, int line)
+{
+    snprintf(p->search_string, sizeof(p->search_string), "%s", word);
+    p->search_start_scroll_position = MAX(0, line - 2) * get_line_advance();
+    p->search_visible = 1;
+    update_page_search(p);
+}
+
+/* memory used by a formatted page */
+static size_t manpage_size(const struct manpage *p)
+{
+    return sizeof(struct manpage) + doc_size(&p->document) + sb_count(p->links) * sizeof(link_t) + p->cache.map_size;
+}
+
+static void remove_cached_page(int i)
+{
+    page_cache.size -= page_cache.pages[i].size;
+    page_cache.pages[i] = sb_last(page_cache.pages);
+    stb__sbn(page_cache.pages)--;
+}
+
+/* drop the least recently used pages until the cache fits max_size */
+static void trim_page_cache(size_t max_size)
+{
+    while ((page_cache.size > max_size) && (sb_count(page_cache.pages) > 0))
+    {
+        int oldest = 0;
+        for (int i = 1; i < sb_count(page_cache.pages); i++)
+        {
+            if (page_cache.pages[i].last_use < page_cache.pages[oldest].last_use)
+                oldest = i;
+        }
+
+        free_manpage(page_cache.pages[oldest].page);
+        remove_cached_page(oldest);
+    }
+}
+
+/* put a page in the cache if it fits, pages with a lower last_use are dropped first */
+static void cache_manpage(struct manpage *p, unsigned last_use, bool links_stale)
+{
+    size_t max_size = (size_t)MAX(settings.page_cache_size, 0) * 1024 * 1024;
+
+    /* only the pages on the page stack keep their parsed document */
+    drop_page_source(p->source);
+    p->source = NULL;
+
+    size_t size = manpage_size(p);
+    if ((size > max_size) || ((p->stamp.sec == 0) && (p->stamp.nsec == 0)))
+    {
+        free_manpage(p);
+        return;
+    }
+
+    struct cached_page c = { p, p->stamp.sec, p->stamp.nsec, p->line_length, size, last_use, links_stale };
+    sb_push(page_cache.pages, c);
+    page_cache.size += size;
+
+    trim_page_cache(max_size);
+}
+
+/**
+ * Done with a page which isn't on the page stack any more, keep it in the
+ * cache if it fits.
+ */
+static void release_manpage(struct manpage *p)
+{
+    /* one still being laid out goes to the cache when it's done */
+    if (p->load)
+    {
+        free_manpage(p);
+        return;
+    }
+
+    forget_page_search(p);
+    cache_manpage(p, ++page_cache.clock, false);
+}
+
+/* cached page of filename at line_length, -1 if there is none */
+static int find_cached_page(const char *filename, const char *pwd, int line_length)
+{
+    for (int i = 0; i < sb_count(page_cache.pages); i++)
+    {
+        const struct manpage *p = page_cache.pages[i].page;
+
+        if ((strcmp(p->filename, filename) == 0) && (strcmp(p->pwd, pwd ? pwd : "") == 0) &&
+                (page_cache.pages[i].line_length == line_length))
+            return i;
+    }
+
+    return -1;
+}
+
+/* true if filename at line_length is on the page stack */
+static bool is_stacked_page(const char *filename, const char *pwd, int line_length)
+{
+    for (int i = 0; i < sb_count(page_stack); i++)
+    {
+        const struct manpage *p = page_stack[i].ptr;
+
+        if (p && (strcmp(p->filename, filename) == 0) && (strcmp(p->pwd, pwd ? pwd : "") == 0) &&
+                (p->line_length == line_length))
+            return true;
+    }
+
+    return false;
+}
+
+/*
+ * Pages linked from the displayed page are formatted ahead of time on a
+ * low priority thread, the links nearest to the visible part first, and
+ * go into the page cache, so following a link finds them there. The pages
+ * are formatted one at a time and only a moment after a page was opened,
+ * so they don't hold up the page that was asked for (see parse_lock).
+ */
+#define PREFETCH_MAX_PAGES 32
+#define PREFETCH_DELAY 0.1 /* seconds */
+
+struct prefetch_job {
+    char filename[1024];
+    char pwd[1024];
+    int line_length;
+};
+
+struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond; /* jobs were added or a page is done */
+    struct prefetch_job *jobs; /* stretchy buffer, the next one last */
+    struct prefetch_job current; /* being formatted while busy */
+    bool busy;
+    bool running;
+    double not_before; /* glfwGetTime() the next page may be started */
+    struct manpage **done; /* stretchy buffer, for the page cache */
+} prefetch_state = { .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER };
+
+static bool is_job(const struct prefetch_job *job, const char *filename, const char *pwd, int line_length)
+{
+    return (strcmp(job->filename, filename) == 0) && (strcmp(job->pwd, pwd ? pwd : "") == 0) &&
+        (job->line_length == line_length);
+}
+
+static void *prefetch_thread(void *arg)
+{
+#if defined(__linux__)
+    setpriority(PRIO_PROCESS, 0, 19); /* only this thread on Linux */
+#elif defined(__APPLE__)
+    pthread_set_qos_class_self_np(QOS_CLASS_BACKGROUND, 0);
+#endif
+
+    pthread_mutex_lock(&prefetch_state.lock);
+
+    for (;;)
+    {
+        if (sb_count(prefetch_state.jobs) == 0)
+        {
+            pthread_cond_wait(&prefetch_state.cond, &prefetch_state.lock);
+            continue;
+        }
+
+        double delay = prefetch_state.not_before - glfwGetTime();
+        if (delay > 0)
+        {
+            pthread_mutex_unlock(&prefetch_state.lock);
+            usleep(delay * 1e6);
+            pthread_mutex_lock(&prefetch_state.lock);
+            continue;
+        }
+
+        prefetch_state.current = sb_last(prefetch_state.jobs);
+        stb__sbn(prefetch_state.jobs)--;
+        prefetch_state.busy = true;
+        pthread_mutex_unlock(&prefetch_state.lock);
+
+        /* only this thread changes current */
+        const struct prefetch_job *job = &prefetch_state.current;
+        struct manpage *p = read_manpage(job->filename, job->pwd, job->line_length, true, NULL, NULL);
+
+        pthread_mutex_lock(&prefetch_state.lock);
+        if (p)
+            sb_push(prefetch_state.done, p);
+        prefetch_state.busy = false;
+        pthread_cond_broadcast(&prefetch_state.cond);
+
+        glfwPostEmptyEvent();
+    }
+
+    return NULL;
+}
+
+/**
+ * Called from the main loop: put the pages of the prefetch thread in the
+ * page cache, as the least recently used ones, so they never push out
+ * pages which were actually read.
+ */
+void poll_prefetched_pages(void)
+{
+    pthread_mutex_lock(&prefetch_state.lock);
+    struct manpage **done = prefetch_state.done;
+    prefetch_state.done = NULL;
+    pthread_mutex_unlock(&prefetch_state.lock);
+
+    for (int i = 0; i < sb_count(done); i++)
+    {
+        struct manpage *p = done[i];
+
+        /* opened in the meantime */
+        if ((find_cached_page(p->filename, p->pwd, p->line_length) >= 0) || is_stacked_page(p->filename, p->pwd, p->line_length))
+            free_manpage(p);
+        else
+            cache_manpage(p, 0, true);
+    }
+
+    sb_free(done);
+}
+
+/* filename is opened, the prefetch thread doesn't have to format it any more */
+static void forget_prefetch_job(const char *filename, const char *pwd, int line_length)
+{
+    pthread_mutex_lock(&prefetch_state.lock);
+
+    for (int i = sb_count(prefetch_state.jobs) - 1; i >= 0; i--)
+    {
+        if (is_job(&prefetch_state.jobs[i], filename, pwd, line_length))
+        {
+            memmove(&prefetch_state.jobs[i], &prefetch_state.jobs[i + 1],
+                    (sb_count(prefetch_state.jobs) - i - 1) * sizeof(struct prefetch_job));
+            stb__sbn(prefetch_state.jobs)--;
+        }
+    }
+
+    pthread_mutex_unlock(&prefetch_state.lock);
+}
+
+/* wait until the prefetch thread is done with filename if it's formatting it right now */
+static void wait_for_prefetch(const char *filename, const char *pwd, int line_length)
+{
+    pthread_mutex_lock(&prefetch_state.lock);
+
+    while (prefetch_state.busy && is_job(&prefetch_state.current, filename, pwd, line_length))
+        pthread_cond_wait(&prefetch_state.cond, &prefetch_state.lock);
+
+    pthread_mutex_unlock(&prefetch_state.lock);
+}
+
+struct link_distance {
+    int link;
+    int distance; /* from the visible part of the page */
+};
+
+static int cmp_link_distance(const void *a, const void *b)
+{
+    const struct link_distance *la = a;
+    const struct link_distance *lb = b;
+
+    if (la->distance != lb->distance)
+        return (la->distance < lb->distance) ? -1 : 1;
+
+    return la->link - lb->link;
+}
+
+/**
+ * Have the prefetch thread format the pages linked from p (the displayed
+ * page) which aren't formatted yet, instead of the ones it was given before.
+ */
+void prefetch_links(const struct manpage *p)
+{
+    if (settings.page_cache_size <= 0)
+        return;
+
+    poll_prefetched_pages();
+
+    int line_length = p->line_length;
+    int top = p->scroll_position;
+    int bottom = top + window_height;
+
+    struct link_distance *order = NULL;
+    for (int i = 0; i < sb_count(p->links); i++)
+    {
+        const recti *r = &p->links[i].document_rectangle;
+        struct link_distance ld = { i, 0 };
+
+        if (r->y2 < top)
+            ld.distance = top - r->y2;
+        else if (r->y > bottom)
+            ld.distance = r->y - bottom;
+
+        sb_push(order, ld);
+    }
+
+    if (sb_count(order) > 1)
+        qsort(order, sb_count(order), sizeof(struct link_distance), &cmp_link_distance);
+
+    struct prefetch_job *jobs = NULL;
+    for (int i = 0; (i < sb_count(order)) && (sb_count(jobs) < PREFETCH_MAX_PAGES); i++)
+    {
+        const link_t *l = &p->links[order[i].link];
+
+        if ((strcmp(l->link, p->filename) == 0) || (find_cached_page(l->link, l->pwd, line_length) >= 0) ||
+                is_stacked_page(l->link, l->pwd, line_length))
+            continue;
+
+        bool queued = false;
+        for (int k = 0; (k < sb_count(jobs)) && !queued; k++)
+            queued = is_job(&jobs[k], l->link, l->pwd, line_length);
+
+        if (queued)
+            continue;
+
+        struct prefetch_job job;
+        snprintf(job.filename, sizeof(job.filename), "%s", l->link);
+        snprintf(job.pwd, sizeof(job.pwd), "%s", l->pwd);
+        job.line_length = line_length;
+        sb_push(jobs, job);
+    }
+
+    sb_free(order);
+
+    /* the nearest one last */
+    for (int i = 0; i < sb_count(jobs) / 2; i++)
+    {
+        struct prefetch_job tmp = jobs[i];
+        jobs[i] = jobs[sb_count(jobs) - 1 - i];
+        jobs[sb_count(jobs) - 1 - i] = tmp;
+    }
+
+    pthread_mutex_lock(&prefetch_state.lock);
+
+    sb_free(prefetch_state.jobs);
+    prefetch_state.jobs = jobs;
+    prefetch_state.not_before = glfwGetTime() + PREFETCH_DELAY;
+
+    if (!prefetch_state.running && (sb_count(jobs) > 0))
+    {
+        pthread_t thread;
+
+        if (pthread_create(&thread, NULL, &prefetch_thread, NULL) == 0)
+        {
+            pthread_detach(thread);
+            prefetch_state.running = true;
+        }
+        else
+        {
+            /* no prefetching then */
+            sb_free(prefetch_state.jobs);
+            prefetch_state.jobs = NULL;
+        }
+    }
+
+    pthread_cond_broadcast(&prefetch_state.cond);
+    pthread_mutex_unlock(&prefetch_state.lock);
+}
+
+/**
+ * Formatted page of filename at line_length from the cache, NULL if it
+ * isn't there or the file has changed since.
+ */
+static struct manpage *get_cached_manpage(const char *filename, const char *pwd, int line_length)
+{
+    struct manindex_stamp stamp;
+    manindex_stat_dirs(&filename, 1, &stamp);
+
+    forget_prefetch_job(filename, pwd, line_length);
+    poll_prefetched_pages();
+
+    int i = find_cached_page(filename, pwd, line_length);
+    if (i >= 0)
+    {
+        struct cached_page *c = &page_cache.pages[i];
+        struct manpage *p = c->page;
+
+        if ((c->sec != stamp.sec) || (c->nsec != stamp.nsec))
+        {
+            /* changed since */
+            free_manpage(p);
+            remove_cached_page(i);
+            return NULL;
+        }
+
+        if (c->links_stale)
+        {
+            sb_free(p->links);
+            p->links = NULL;
+            find_links(p, 0);
+        }
+
+        remove_cached_page(i);
+
+        /* open it like a new one */
+        p->scroll_position = 0;
+        p->search_input_active = 0;
+        p->search_string[0] = 0;
+        p->search_visible = 0;
+        p->search_num = 0;
+        p->search_index = 0;
+        for (int k = 0; k < sb_count(p->links); k++)
+            p->links[k].highlight = 0;
+
+        return p;
+    }
+
+    return NULL;
+}
+
+void update_window_title(void)
+{
+    switch (display_mode)
+    {
+        case D_MANPAGE:
+            {
+                char window_title[2048];
+
+                if (strlen(page->manpage_name) > 0)
+                {
+                    snprintf(window_title, sizeof(window_title), "%s(%s) - mangl",
+                            page->manpage_name, page->manpage_section);
+                }
+                else
+                {
+                    snprintf(window_title, sizeof(window_title), "%s - mangl",
+                            page->filename);
+                }
+                glfwSetWindowTitle(window, window_title);
+            }
+            break;
+        case D_SEARCH:
+        default:
+            glfwSetWindowTitle(window, "mangl");
+            break;
+    }
+}
+
+struct page_description make_page_description(struct manpage *page, const char *filename, const char *pwd)
+{
+    struct page_description page_desc;
+
+    page_desc.ptr = page;
+    snprintf(page_desc.filename, sizeof(page_desc.filename), "%s", filename);
+    snprintf(page_desc.pwd, sizeof(page_desc.pwd), "%s", pwd);
+
+    return page_desc;
+}
+
+/* show a newly opened page and put it on the page stack */
+static void push_page(struct manpage *new_page, const char *filename, const char *pwd)
+{
+    // put on stack
+    if (stack_pos < sb_count(page_stack))
+    {
+        // additional pages on stack, need NULLing
+        for (int i = stack_pos; i < sb_count(page_stack); i++)
+        {
+            if (page_stack[i].ptr)
+            {
+                release_manpage(page_stack[i].ptr);
+                page_stack[i].ptr = NULL;
+            }
+        }
+
+        stack_pos++;
+        page_stack[stack_pos - 1].ptr = new_page;
+        snprintf(page_stack[stack_pos - 1].filename, sizeof(page_stack[stack_pos - 1].filename), "%s", filename);
+        snprintf(page_stack[stack_pos - 1].pwd, sizeof(page_stack[stack_pos - 1].pwd), "%s", pwd);
+    }
+    else
+    {
+        struct page_description page_desc = make_page_description(new_page, filename, pwd);
+        sb_push(page_stack, page_desc);
+        stack_pos++;
+    }
+
+    page = new_page;
+    settings.current_line_length = page->line_length;
+    if (display_mode == D_SEARCH)
+        display_mode = D_MANPAGE;
+    update_window_title();
+    update_scrollbar();
+    post_redisplay();
+
+    prefetch_links(page);
+}
+
+/* show the current page formatted again (at another line length) */
+static void replace_page(struct manpage *new_page)
+{
+    if (stack_pos < 1)
+    {
+        release_manpage(new_page);
+        return;
+    }
+
+    struct manpage *prev_page = page_stack[stack_pos - 1].ptr;
+
+    page_stack[stack_pos - 1].ptr = new_page;
+    page = new_page;
+
+    if (prev_page)
+    {
+        /* keep the same text at the top of the window */
+        int margin = get_dimension(DIM_DOCUMENT_MARGIN);
+        int top = prev_page->scroll_position - margin;
+
+        if (top > 0)
+        {
+            int line = top / get_line_advance();
+            int new_line = find_text_offset(new_page, get_text_offset(prev_page, line));
+            top += (new_line - line) * get_line_advance();
+        }
+
+        new_page->scroll_position = clamp_scroll_position(top + margin);
+
+        /* the same file, a page from the cache can be laid out again too */
+        if (new_page->source == NULL)
+            new_page->source = hold_page_source(prev_page->source);
+
+        release_manpage(prev_page);
+    }
+
+    /* the line length of the page which is shown */
+    settings.current_line_length = new_page->line_length;
+
+    update_window_title();
+    update_scrollbar();
+    post_redisplay();
+
+    prefetch_links(page);
+}
+
+/* name(section) of a page file, the file name if it doesn't look like one */
+static void get_page_title(const char *filename, char *out, size_t out_len)
+{
+    char name[256], section[64];
+
+    if (get_page_name_and_section(filename, name, sizeof(name), section, sizeof(section)) == 0)
+        snprintf(out, out_len, "%s(%s)", name, section);
+    else
+        snprintf(out, out_len, "%s", filename);
+}
+
+/* a page request is done (or it came from the cache), show it */
+static void finish_page_load(struct page_load *load)
+{
+    struct manpage *new_page = load->page;
+
+    if (new_page == NULL)
+    {
+        char title[512];
+        get_page_title(load->filename, title, sizeof(title));
+        snprintf(page_load_state.error, sizeof(page_load_state.error), "Failed to open %s (%s)", title, strerror(load->error));
+        fprintf(stderr, "Failed to open file %s (%s)\n", load->filename, strerror(load->error));
+        post_redisplay();
+        return;
+    }
+
+    if (load->action == LOAD_RELOAD)
+        replace_page(new_page);
+    else
+        push_page(new_page, load->filename, load->pwd);
+
+    if (load->search_word[0])
+        show_search_hit(new_page, load->search_word, load->search_line);
+}
+
+/* another page was requested (or the load was cancelled) since this one */
+static bool page_load_is_stale(const struct page_load *load)
+{
+    pthread_mutex_lock(&page_load_state.lock);
+    bool stale = load->generation != page_load_state.generation;
+    pthread_mutex_unlock(&page_load_state.lock);
+
+    return stale;
+}
+
+static void run_page_load(struct page_load *load)
+{
+    if (page_load_is_stale(load))
+    {
+        /* dropped before it was started */
+        load->error = ECANCELED;
+    }
+    else if (load->source)
+    {
+        /* only the line length changes, the file isn't read again */
+        load->page = layout_manpage(load->source, load->filename, load->line_length, false, NULL);
+    }
+    else
+    {
+        /* it's done soon then, and likely stored in the cache directory */
+        wait_for_prefetch(load->filename, load->pwd, load->line_length);
+
+        load->page = read_manpage(load->filename, load->dir, load->line_length, false, load->stream, load);
+        load->error = errno;
+    }
+
+    if (load->source)
+    {
+        drop_page_source(load->source);
+        load->source = NULL;
+    }
+
+    pthread_mutex_lock(&page_load_state.lock);
+    sb_push(page_load_state.done, load);
+    pthread_mutex_unlock(&page_load_state.lock);
+
+    glfwPostEmptyEvent();
+}
+
+static void *page_loader_thread(void *arg)
+{
+    for (;;)
+    {
+        pthread_mutex_lock(&page_load_state.lock);
+
+        while (sb_count(page_load_state.queue) == 0)
+            pthread_cond_wait(&page_load_state.cond, &page_load_state.lock);
+
+        /* oldest first, stale ones are dropped right away */
+        struct page_load *load = page_load_state.queue[0];
+        memmove(&page_load_state.queue[0], &page_load_state.queue[1], (sb_count(page_load_state.queue) - 1) * sizeof(struct page_load *));
+        stb__sbn(page_load_state.queue)--;
+
+        pthread_mutex_unlock(&page_load_state.lock);
+
+        run_page_load(load);
+    }
+
+    return NULL;
+}
+
+static void start_page_loaders(void)
+{
+    for (int i = 0; i < PAGE_LOADER_THREADS; i++)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, &page_loader_thread, NULL) == 0)
+        {
+            pthread_detach(thread);
+            page_load_state.n_loaders++;
+        }
+    }
+}
+
+/**
+ * Open filename at line_length, right away if it's in the page cache and
+ * on the loader thread otherwise. action says what to do with it, a
+ * search_word is searched for in the page, which is scrolled to
+ * search_line.
+ */
+void request_page(const char *filename, const char *pwd, int line_length, int action, const char *search_word, int search_line)
+{
+    struct page_load *load = ZMALLOC(struct page_load, 1);
+
+    snprintf(load->filename, sizeof(load->filename), "%s", filename);
+    snprintf(load->pwd, sizeof(load->pwd), "%s", pwd ? pwd : "");
+    /* a page without a directory of its own includes files relative to the one before */
+    snprintf(load->dir, sizeof(load->dir), "%s", (pwd && pwd[0]) ? pwd : (page ? page->pwd : ""));
+    snprintf(load->search_word, sizeof(load->search_word), "%s", search_word ? search_word : "");
+    load->line_length = line_length;
+    load->action = action;
+    load->search_line = search_line;
+
+    /* this one replaces any other */
+    cancel_page_load();
+
+    load->page = get_cached_manpage(filename, pwd, line_length);
+    if (load->page)
+    {
+        finish_page_load(load);
+        free(load);
+        return;
+    }
+
+    if ((action == LOAD_RELOAD) && page)
+        load->source = hold_page_source(page->source);
+
+    /* a new page is shown as soon as its top is laid out, unless it's shown at a search hit */
+    if ((action == LOAD_OPEN) && (load->search_word[0] == 0))
+    {
+        load->stream = ZMALLOC(struct page_stream, 1);
+        pthread_mutex_init(&load->stream->lock, NULL);
+        sb_push(page_load_state.streaming, load);
+    }
+
+    load->generation = page_load_state.generation;
+    page_load_state.action = action;
+    page_load_state.loading = true;
+    page_load_state.start_time = glfwGetTime();
+    get_page_title(filename, page_load_state.title, sizeof(page_load_state.title));
+
+    if (page_load_state.n_loaders == 0)
+        start_page_loaders();
+
+    if (page_load_state.n_loaders == 0)
+    {
+        /* load it right here then */
+        run_page_load(load);
+        return;
+    }
+
+    pthread_mutex_lock(&page_load_state.lock);
+    sb_push(page_load_state.queue, load);
+    pthread_cond_signal(&page_load_state.cond);
+    pthread_mutex_unlock(&page_load_state.lock);
+}
+
+/* forget about the page being loaded and a failed one */
+void cancel_page_load(void)
+{
+    if (!page_load_state.loading && !page_load_state.error[0])
+        return;
+
+    /* the loaders drop the requests of older generations */
+    pthread_mutex_lock(&page_load_state.lock);
+    page_load_state.generation++;
+    pthread_mutex_unlock(&page_load_state.lock);
 
-    return 0;
+    page_load_state.loading = false;
+    page_load_state.error[0] = 0;
+    post_redisplay();
 }
 
-void change_dir(const char *path)
+static void free_page_load(struct page_load *load)
 {
-    if (chdir(path) != 0)
+    if (load->stream)
     {
-        fprintf(stderr, "Failed to change directory to \"%s\" (%s).\n", path, strerror(errno));
+        sb_free(load->stream->lines);
+        pthread_mutex_destroy(&load->stream->lock);
+        free(load->stream);
     }
+
+    free(load);
 }
 
-struct manpage *load_manpage(const char *filename, const char *pwd)
+/* p gets n_lines more lines, which are still laid out, searches of it start over */
+static void add_streamed_lines(struct manpage *p, const struct doc_line *lines, int n_lines)
 {
-    mchars_alloc(); // initialize charset table
+    bool dropped = forget_page_search(p);
+    int first_line = p->document.n_lines;
 
-    struct mparse *parse = mparse_alloc(MPARSE_SO | MPARSE_UTF8 | MPARSE_LATIN1 | MPARSE_VALIDATE /*options=autodetect document type*/,
-            MANDOC_OS_OTHER /*mandoc_os = automatically detect*/,
-            NULL /*os_s = string passed to override the result of uname*/);
+    doc_add_lines(&p->document, lines, n_lines);
 
-    mandoc_msg_setinfilename(filename);
-    mandoc_msg_setoutfile(stderr);
+    find_links(p, first_line);
 
-    int fd = mparse_open(parse, filename); // open a file and if it fails try appending .gz
+    extend_page_search(p, dropped);
 
-    if (fd == -1)
+    if (p == page)
     {
-        fprintf(stderr, "Failed to open file %s (%s)\n", filename, strerror(errno));
-        exit(1);
+        update_scrollbar();
+        post_redisplay();
     }
+}
 
-    mparse_readfd(parse, fd, filename);
-
-    close(fd);
-
-    struct roff_meta *meta = mparse_result(parse);
+/* the page shown from the stream of load gets the whole page of load */
+static void finish_streamed_page(struct page_load *load)
+{
+    struct manpage *p = load->shown;
+    struct manpage *done = load->page;
 
-    struct manpage *page = ZMALLOC(struct manpage, 1);
+    bool dropped = forget_page_search(p);
+    int first_line = p->document.n_lines;
 
-    strcpy(page->filename, filename);
-    strcpy(page->pwd, pwd ? pwd : "");
+    /* the lines it has are the first ones of done */
+    doc_free(&p->document);
+    p->document = done->document;
+    p->stamp = done->stamp;
+    p->source = done->source;
+    p->load = NULL;
+    free(done);
 
-    get_page_name_and_section(filename, page->manpage_name, sizeof(page->manpage_name), page->manpage_section, sizeof(page->manpage_section));
+    load->page = NULL;
+    load->shown = NULL;
 
-    add_line(page);
+    find_links(p, first_line);
 
-    void *formatter = mangl_formatter(settings.current_line_length, 5);
-    formatting_page = page; // temporary use of a global variable for formatting functions (not multithreaded)
+    extend_page_search(p, dropped);
 
-    if (meta->macroset == MACROSET_MDOC)
+    if (p == page)
     {
-        terminal_mdoc(formatter, meta); // for mdoc format
+        update_scrollbar();
+        post_redisplay();
+        prefetch_links(p);
     }
-    else
+}
+
+/**
+ * Show the lines of pages which are still laid out, the page requested last
+ * is shown as soon as its first lines are there.
+ */
+static void poll_page_streams(void)
+{
+    for (int i = 0; i < sb_count(page_load_state.streaming); i++)
     {
-        terminal_man(formatter, meta);
-    }
+        struct page_load *load = page_load_state.streaming[i];
 
-    formatting_page = NULL;
+        pthread_mutex_lock(&load->stream->lock);
+        struct doc_line *lines = load->stream->lines;
+        load->stream->lines = NULL;
+        pthread_mutex_unlock(&load->stream->lock);
 
-    /* remove the last line empty line */
-    if (page->document.n_lines > 1)
-    {
-        struct span *s = page->document.lines[page->document.n_lines - 1];
-        if (((s->buffer == NULL) || (strlen(s->buffer) == 0)) && (s->next == NULL))
-        {
-            page->document.n_lines--;
-            page->document.lines[page->document.n_lines /* already decremented */] = NULL;
-            free_span(s);
-        }
-    }
+        if (lines == NULL)
+            continue;
 
-    find_links(page); // update links
+        if ((load->shown == NULL) && page_load_state.loading && (load->generation == page_load_state.generation))
+        {
+            struct manpage *p = ZMALLOC(struct manpage, 1);
 
-    mangl_formatter_free(formatter);
-    mparse_free(parse);
-    mchars_free();
+            snprintf(p->filename, sizeof(p->filename), "%s", load->filename);
+            snprintf(p->pwd, sizeof(p->pwd), "%s", load->pwd);
+            p->line_length = load->line_length;
+            p->load = load;
+            get_page_name_and_section(p->filename, p->manpage_name, sizeof(p->manpage_name), p->manpage_section, sizeof(p->manpage_section));
 
-    return page;
-}
+            page_load_state.loading = false;
+            load->shown = p;
+            push_page(p, load->filename, load->pwd);
+        }
 
-void update_window_title(void)
-{
-    switch (display_mode)
-    {
-        case D_MANPAGE:
-            {
-                char window_title[2048];
+        if (load->shown)
+        {
+            add_streamed_lines(load->shown, lines, sb_count(lines));
+        }
+        else
+        {
+            /* the page isn't shown (any more), it goes to the cache when it's done */
+            pthread_mutex_lock(&load->stream->lock);
+            load->stream->abandoned = true;
+            pthread_mutex_unlock(&load->stream->lock);
+        }
 
-                if (strlen(page->manpage_name) > 0)
-                {
-                    snprintf(window_title, sizeof(window_title), "%s(%s) - mangl",
-                            page->manpage_name, page->manpage_section);
-                }
-                else
-                {
-                    snprintf(window_title, sizeof(window_title), "%s - mangl",
-                            page->filename);
-                }
-                glfwSetWindowTitle(window, window_title);
-            }
-            break;
-        case D_SEARCH:
-        default:
-            glfwSetWindowTitle(window, "mangl");
-            break;
+        sb_free(lines);
     }
 }
 
-struct page_description make_page_description(struct manpage *page, const char *filename, const char *pwd)
+/**
+ * Called from the main loop: show the page requested last when it's
+ * loaded, or its top while the rest is laid out. Pages of earlier requests
+ * only go to the cache.
+ */
+void poll_page_loads(void)
 {
-    struct page_description page_desc;
-
-    page_desc.ptr = page;
-    snprintf(page_desc.filename, sizeof(page_desc.filename), "%s", filename);
-    snprintf(page_desc.pwd, sizeof(page_desc.pwd), "%s", pwd);
+    poll_page_streams();
 
-    return page_desc;
-}
+    pthread_mutex_lock(&page_load_state.lock);
+    struct page_load **done = page_load_state.done;
+    page_load_state.done = NULL;
+    pthread_mutex_unlock(&page_load_state.lock);
 
-void open_new_page(const char *filename, const char *pwd)
-{
-    if (page && strlen(page->pwd))
-        change_dir(page->pwd); /* make sure load_manpage can succeed (if it uses source command) */
+    for (int i = 0; i < sb_count(done); i++)
+    {
+        struct page_load *load = done[i];
 
-    struct manpage *new_page = load_manpage(filename, pwd);
+        for (int k = 0; k < sb_count(page_load_state.streaming); k++)
+        {
+            if (page_load_state.streaming[k] == load)
+            {
+                page_load_state.streaming[k] = sb_last(page_load_state.streaming);
+                stb__sbn(page_load_state.streaming)--;
+                break;
+            }
+        }
 
-    // put on stack
-    if (stack_pos < sb_count(page_stack))
-    {
-        // additional pages on stack, need NULLing
-        for (int i = stack_pos; i < sb_count(page_stack); i++)
+        if (load->shown)
         {
-            if (page_stack[i].ptr)
+            finish_streamed_page(load);
+        }
+        else if (page_load_state.loading && (load->generation == page_load_state.generation))
+        {
+            page_load_state.loading = false;
+
+            if (load->page)
             {
-                free_manpage(page_stack[i].ptr);
-                page_stack[i].ptr = NULL;
+                snprintf(load->page->pwd, sizeof(load->page->pwd), "%s", load->pwd);
+                find_links(load->page, 0);
             }
+
+            finish_page_load(load);
         }
+        else if (load->page)
+        {
+            struct manpage *p = load->page;
+            snprintf(p->pwd, sizeof(p->pwd), "%s", load->pwd);
 
-        stack_pos++;
-        page_stack[stack_pos - 1].ptr = new_page;
-        snprintf(page_stack[stack_pos - 1].filename, sizeof(page_stack[stack_pos - 1].filename), "%s", filename);
-        snprintf(page_stack[stack_pos - 1].pwd, sizeof(page_stack[stack_pos - 1].pwd), "%s", pwd);
-    }
-    else
-    {
-        struct page_description page_desc = make_page_description(new_page, filename, pwd);
-        sb_push(page_stack, page_desc);
-        stack_pos++;
+            if ((find_cached_page(p->filename, p->pwd, p->line_length) >= 0) || is_stacked_page(p->filename, p->pwd, p->line_length))
+                free_manpage(p);
+            else
+                cache_manpage(p, 0, true);
+        }
+
+        free_page_load(load);
     }
 
-    page = new_page;
-    if (display_mode == D_SEARCH)
-        display_mode = D_MANPAGE;
-    update_window_title();
-    update_scrollbar();
-    post_redisplay();
+    sb_free(done);
+
+    if (page_load_state.loading)
+        post_redisplay(); /* the loading indicator */
+}
+
+void open_new_page(const char *filename, const char *pwd)
+{
+    request_page(filename, pwd, get_page_line_length(), LOAD_OPEN, NULL, 0);
 }
 
-void reload_current_page(void)
+/* format the current page again at line_length */
+void reload_current_page(int line_length)
 {
     if (stack_pos < 1)
         return;
 
+    if (page->line_length == line_length)
     {
-        const char *filename = page_stack[stack_pos - 1].filename;
-        const char *pwd = page_stack[stack_pos - 1].pwd;
+        /* the page is laid out at another one, that's not wanted any more */
+        if (page_load_state.loading && (page_load_state.action == LOAD_RELOAD))
+            cancel_page_load();
 
-        struct manpage *new_page = load_manpage(filename, pwd);
-        struct manpage *prev_page = page_stack[stack_pos - 1].ptr;
+        return;
+    }
 
-        page_stack[stack_pos - 1].ptr = new_page;
-        page = new_page;
+    request_page(page_stack[stack_pos - 1].filename, page_stack[stack_pos - 1].pwd, line_length, LOAD_RELOAD, NULL, 0);
+}
 
-        if (prev_page)
-        {
-            free_manpage(prev_page);
-        }
+/**
+ * Called from the main loop: fit the displayed page to the window once
+ * its width settled.
+ */
+void poll_reflow(void)
+{
+    if ((reflow_time == 0) || (glfwGetTime() < reflow_time))
+        return;
 
-        update_window_title();
-        update_scrollbar();
-        post_redisplay();
-    }
+    /* a page being opened is fitted when it's shown */
+    if (page_load_state.loading && (page_load_state.action == LOAD_OPEN))
+        return;
+
+    reflow_time = 0;
+
+    if (fit_to_window && (display_mode == D_MANPAGE))
+        reload_current_page(get_page_line_length());
 }
 
 void page_back(void)
 {
+    /* going back from a link which is still loading (or failed) stays on this page */
+    if (page_load_state.loading || page_load_state.error[0])
+    {
+        cancel_page_load();
+        return;
+    }
+
     if (stack_pos > 1)
     {
         stack_pos--;
         page = page_stack[stack_pos - 1].ptr;
+        settings.current_line_length = page->line_length;
         update_window_title();
         update_scrollbar();
         post_redisplay();
+
+        prefetch_links(page);
+        want_reflow(0);
     }
     else if (display_mode == D_MANPAGE)
     {
@@ -3180,10 +7018,89 @@ void page_forward(void)
     {
         stack_pos++;
         page = page_stack[stack_pos - 1].ptr;
+        settings.current_line_length = page->line_length;
         update_window_title();
         update_scrollbar();
         post_redisplay();
+
+        prefetch_links(page);
+        want_reflow(0);
+    }
+}
+
+/* requests of other mangl invocations, received by the ipc thread */
+struct {
+    pthread_mutex_t lock;
+    struct ipc_request *requests;
+    int listen_fd;
+} ipc_state = { .lock = PTHREAD_MUTEX_INITIALIZER, .listen_fd = -1 };
+
+static void *ipc_thread(void *arg)
+{
+    for (;;)
+    {
+        struct ipc_request req;
+        if (ipc_receive_request(ipc_state.listen_fd, &req) != 0)
+            continue;
+
+        pthread_mutex_lock(&ipc_state.lock);
+        sb_push(ipc_state.requests, req);
+        pthread_mutex_unlock(&ipc_state.lock);
+
+        glfwPostEmptyEvent(); /* wake up the main loop */
+    }
+
+    return NULL;
+}
+
+void start_ipc_server(void)
+{
+    pthread_t thread;
+
+    if (pthread_create(&thread, NULL, &ipc_thread, NULL) != 0)
+    {
+        fprintf(stderr, "Failed to start the server thread\n");
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_detach(thread);
+}
+
+/**
+ * Called from the main loop: open the pages requested by other invocations
+ * and bring the window up.
+ */
+void poll_ipc_requests(void)
+{
+    pthread_mutex_lock(&ipc_state.lock);
+    struct ipc_request *requests = ipc_state.requests;
+    ipc_state.requests = NULL;
+    pthread_mutex_unlock(&ipc_state.lock);
+
+    for (int i = 0; i < sb_count(requests); i++)
+    {
+        if (requests[i].filename[0])
+        {
+            open_new_page(requests[i].filename, requests[i].pwd);
+        }
+        else
+        {
+            cancel_page_load();
+            display_mode = D_SEARCH;
+            search_term[0] = 0;
+            update_search();
+            update_window_title();
+            post_redisplay();
+        }
+    }
+
+    if (requests)
+    {
+        glfwShowWindow(window);
+        glfwFocusWindow(window);
     }
+
+    sb_free(requests);
 }
 
 int parse_line(char *line, char *name_out, char *value_out)
@@ -3344,6 +7261,14 @@ void load_settings(void)
                 {
                     initial_window_rows = atoi(value);
                 }
+                else if (strcmp(name, "page_cache_size") == 0)
+                {
+                    settings.page_cache_size = atoi(value);
+                }
+                else if (strcmp(name, "fit_to_window") == 0)
+                {
+                    settings.fit_to_window = atoi(value);
+                }
                 else if (strcmp(name, "color_background") == 0)
                     parse_color(value, color_table[COLOR_INDEX_BACKGROUND]);
                 else if (strcmp(name, "color_foreground") == 0)
@@ -3388,6 +7313,7 @@ int main(int argc, char *argv[])
 {
     char window_title[2048];
     char tmp_filename[1024];
+    char local_path[PATH_MAX];
     const char *filename = NULL;
     int no_fork = 0;
     int local_file = 0;
@@ -3395,17 +7321,21 @@ int main(int argc, char *argv[])
 
     manpage_database = hashmap_new();
     manpage_database_pwd = hashmap_new();
+    manpage_database_desc = hashmap_new();
 
     load_settings();
-    make_manpage_database();
+    fit_to_window = settings.fit_to_window;
 
     const char *first_arg = NULL;
     const char *second_arg = NULL;
 
-    while ((ch = getopt_long(argc, argv, "fhlV", longopts, NULL)) != -1)
+    while ((ch = getopt_long(argc, argv, "dfhlV", longopts, NULL)) != -1)
     {
         switch (ch)
         {
+            case 'd':
+                daemon_mode = true;
+                break;
             case 'f':
                 no_fork = 1;
                 break;
@@ -3445,6 +7375,10 @@ int main(int argc, char *argv[])
         if (first_arg)
         {
             filename = second_arg ? second_arg : first_arg;
+
+            /* other threads change the current directory while formatting */
+            if (realpath(filename, local_path) != NULL)
+                filename = local_path;
         }
         else
         {
@@ -3489,6 +7423,65 @@ int main(int argc, char *argv[])
         }
     }
 
+    if (filename)
+    {
+        /* the page is loaded after forking, report a missing one while the exit status still counts */
+        int fd = open(filename, O_RDONLY);
+        if (fd == -1)
+        {
+            fprintf(stderr, "Failed to open file %s (%s)\n", filename, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+
+        close(fd);
+    }
+
+    if (daemon_mode)
+    {
+        /* listen before forking, so the socket is ready when the command returns */
+        ipc_state.listen_fd = ipc_listen();
+        if (ipc_state.listen_fd == -1)
+            exit(EXIT_FAILURE);
+    }
+    else
+    {
+        /* let a resident instance open the page */
+        struct ipc_request req;
+        req.filename[0] = '\0';
+
+        if (getcwd(req.pwd, sizeof(req.pwd)) == NULL)
+            req.pwd[0] = '\0';
+
+        if ((filename == NULL) || (realpath(filename, req.filename) != NULL))
+        {
+            if (ipc_send_request(&req) == 0)
+                exit(EXIT_SUCCESS);
+        }
+    }
+
+    /* display gui */
+    if (!no_fork)
+    {
+        if (fork() != 0)
+        {
+            exit(EXIT_SUCCESS);
+        }
+    }
+
+    if (!glfwInit())
+    {
+        fprintf(stderr, "Failed to init GLFW\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* the character table is shared by the formatting threads, it's never changed */
+    mchars_alloc();
+
+    /* build the page index while the font and the window are set up */
+    start_manpage_database();
+    open_fulltext_index();
+    start_search_worker();
+
     /* init font */
     init_builtin_font();
     init_freetype();
@@ -3496,7 +7489,7 @@ int main(int argc, char *argv[])
     {
         if (get_font_file(settings.font_file))
         {
-            render_font_texture(settings.font_file, (int)(settings.gui_scale * settings.font_size));
+            load_font(settings.font_file, (int)(settings.gui_scale * settings.font_size));
             mainFont = loadedFont;
         }
         else
@@ -3538,21 +7531,6 @@ int main(int argc, char *argv[])
         }
     }
 
-    /* display gui */
-    if (!no_fork)
-    {
-        if (fork() != 0)
-        {
-            exit(EXIT_SUCCESS);
-        }
-    }
-
-    if (!glfwInit())
-    {
-        fprintf(stderr, "Failed to init GLFW\n");
-        exit(EXIT_FAILURE);
-    }
-
     glfwSetErrorCallback(&glfw_error_callback);
 
     glfwWindowHintString(GLFW_X11_CLASS_NAME, "mangl");
@@ -3563,6 +7541,9 @@ int main(int argc, char *argv[])
         glfwWindowHintString(GLFW_WAYLAND_APP_ID, "mangl");
 #endif
 
+    if (daemon_mode && (filename == NULL))
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE); /* until the first request */
+
     window = glfwCreateWindow(fitting_window_width(), fitting_window_height(initial_window_rows), window_title, NULL, NULL);
 
     if (!window)
@@ -3605,8 +7586,20 @@ int main(int argc, char *argv[])
     framebuffer_size_func(window, w, h);
     redisplay_needed = true;
 
-    while (!glfwWindowShouldClose(window))
+    if (daemon_mode)
+        start_ipc_server();
+
+    for (;;)
     {
+        if (glfwWindowShouldClose(window))
+        {
+            if (!daemon_mode)
+                break;
+
+            glfwSetWindowShouldClose(window, GLFW_FALSE);
+            close_window();
+        }
+
         if (redisplay_needed)
         {
             render();
@@ -3614,7 +7607,21 @@ int main(int argc, char *argv[])
             redisplay_needed = false;
         }
 
-        glfwWaitEvents();
+        /* animate the loading indicator */
+        if (page_load_state.loading)
+            glfwWaitEventsTimeout(PAGE_LOAD_INDICATOR_INTERVAL);
+        else if (reflow_time > 0)
+            glfwWaitEventsTimeout(MAX(reflow_time - glfwGetTime(), 0.0));
+        else
+            glfwWaitEvents();
+
+        poll_page_loads();
+        poll_reflow();
+        poll_manpage_database();
+        poll_ipc_requests();
+        poll_search_results();
+        poll_fulltext_index();
+        poll_prefetched_pages();
     }
 
     glfwDestroyWindow(window);
@@ -318,6 +318,7 @@ eqn_reset(struct eqn_node *ep)
 	free(ep->data);
 	ep->data = ep->start = ep->end = NULL;
 	ep->sz = ep->toksz = 0;
+	ep->last_len = ep->lim = 0;
 }
 
 void
@@ -375,8 +376,6 @@ eqn_def_find(struct eqn_node *ep)
 static enum eqn_tok
 eqn_next(struct eqn_node *ep, enum parse_mode mode)
 {
-	static int	 last_len, lim;
-
 	struct eqn_def	*def;
 	size_t		 start;
 	int		 diff, i, quoted;
@@ -386,8 +385,8 @@ eqn_next(struct eqn_node *ep, enum parse_mode mode)
 	 * Reset the recursion counter after advancing
 	 * beyond the end of the previous substitution.
 	 */
-	if (ep->end - ep->data >= last_len)
-		lim = 0;
+	if (ep->end - ep->data >= ep->last_len)
+		ep->lim = 0;
 
 	ep->start = ep->end;
 	quoted = mode == MODE_QUOTED;
@@ -434,7 +433,7 @@ eqn_next(struct eqn_node *ep, enum parse_mode mode)
 			return EQN_TOK__MAX;
 		if ((def = eqn_def_find(ep)) == NULL)
 			break;
-		if (++lim > EQN_NEST_MAX) {
+		if (++ep->lim > EQN_NEST_MAX) {
 			mandoc_msg(MANDOCERR_ROFFLOOP,
 			    ep->node->line, ep->node->pos, NULL);
 			return EQN_TOK_EOF;
@@ -451,7 +450,7 @@ eqn_next(struct eqn_node *ep, enum parse_mode mode)
 			memmove(ep->start + def->valsz, ep->start + ep->toksz,
 			    strlen(ep->start + ep->toksz) + 1);
 		memcpy(ep->start, def->val, def->valsz);
-		last_len = ep->start - ep->data + def->valsz;
+		ep->last_len = ep->start - ep->data + def->valsz;
 	}
 	if (mode != MODE_TOK)
 		return quoted ? EQN_TOK_QUOTED : EQN_TOK__MAX;
@@ -33,6 +33,8 @@ struct	eqn_node {
 	size_t		  sz;      /* Length of the source code. */
 	size_t		  toksz;   /* Length of the current token. */
 	int		  gsize;   /* Default point size. */
+	int		  last_len; /* End of the last expansion. */
+	int		  lim;     /* Nesting depth of expansions. */
 	int		  delim;   /* In-line delimiters enabled. */
 	char		  odelim;  /* In-line opening delimiter. */
 	char		  cdelim;  /* In-line closing delimiter. */
@@ -48,7 +48,8 @@ static	void	  check_abort(CHKARGS) __attribute__((__noreturn__));
 static	void	  check_par(CHKARGS);
 static	void	  check_part(CHKARGS);
 static	void	  check_root(CHKARGS);
-static	void	  check_tag(struct roff_node *, struct roff_node *);
+static	void	  check_tag(struct roff_man *, struct roff_node *,
+			struct roff_node *);
 static	void	  check_text(CHKARGS);
 
 static	void	  post_AT(CHKARGS);
@@ -212,7 +213,7 @@ check_abort(CHKARGS)
  * Priority is high unless whitespace is present.
  */
 static void
-check_tag(struct roff_node *n, struct roff_node *nt)
+check_tag(struct roff_man *man, struct roff_node *n, struct roff_node *nt)
 {
 	const char	*cp, *arg;
 	int		 prio, sz;
@@ -262,7 +263,7 @@ check_tag(struct roff_node *n, struct roff_node *nt)
 			break;
 		default:
 			if (isalpha((unsigned char)*cp))
-				tag_put(cp, prio, n);
+				tag_put(man, cp, prio, n);
 			return;
 		}
 	}
@@ -326,9 +327,9 @@ post_SH(CHKARGS)
 					*cp = '_';
 			if (nc != NULL && nc->type == ROFFT_TEXT &&
 			    strcmp(nc->string, tag) == 0)
-				tag_put(NULL, TAG_STRONG, n);
+				tag_put(man, NULL, TAG_STRONG, n);
 			else
-				tag_put(tag, TAG_FALLBACK, n);
+				tag_put(man, tag, TAG_FALLBACK, n);
 			free(tag);
 		}
 		return;
@@ -428,7 +429,7 @@ post_IP(CHKARGS)
 			roff_node_delete(man, n);
 		break;
 	case ROFFT_HEAD:
-		check_tag(n, n->child);
+		check_tag(man, n, n->child);
 		break;
 	case ROFFT_BODY:
 		if (n->parent->head->child == NULL && n->child == NULL)
@@ -468,7 +469,7 @@ post_TP(CHKARGS)
 	default:
 		break;
 	}
-	check_tag(n, nt);
+	check_tag(man, n, nt);
 }
 
 static void
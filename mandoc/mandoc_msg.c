@@ -279,10 +279,14 @@ static	const char *const type_message[MANDOCERR_MAX] = {
 	"write",
 };
 
-static	FILE		*fileptr = NULL;
-static	const char	*filename = NULL;
-static	enum mandocerr	 min_type = MANDOCERR_BADARG;
-static	enum mandoclevel rc = MANDOCLEVEL_OK;
+/*
+ * The message state is per thread, such that several parsers
+ * can run at the same time; mandoc_msg() gets no parser handle.
+ */
+static	_Thread_local FILE		*fileptr = NULL;
+static	_Thread_local const char	*filename = NULL;
+static	_Thread_local enum mandocerr	 min_type = MANDOCERR_BADARG;
+static	_Thread_local enum mandoclevel	 rc = MANDOCLEVEL_OK;
 
 
 void
@@ -42,3 +42,4 @@ int		  mparse_open(struct mparse *, const char *);
 void		  mparse_readfd(struct mparse *, int, const char *);
 void		  mparse_reset(struct mparse *);
 struct roff_meta *mparse_result(struct mparse *);
+int		  mparse_so_count(const struct mparse *);
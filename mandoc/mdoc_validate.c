@@ -294,7 +294,6 @@ static	const char * const secnames[SEC__MAX] = {
 	NULL
 };
 
-static	int	  fn_prio = TAG_STRONG;
 
 
 /* Validate the subtree rooted at mdoc->last. */
@@ -1214,7 +1213,7 @@ post_tg(POST_ARGS)
 		nn = n;
 		break;
 	}
-	tag_put(nt->string, TAG_MANUAL, nn);
+	tag_put(mdoc, nt->string, TAG_MANUAL, nn);
 	if (nn != n)
 		n->flags |= NODE_NOPRT;
 }
@@ -1327,7 +1326,7 @@ post_fname(POST_ARGS)
 		if (cp[pos] == '\0') {
 			if (n->sec == SEC_DESCRIPTION ||
 			    n->sec == SEC_CUSTOM)
-				tag_put(NULL, fn_prio++, n);
+				tag_put(mdoc, NULL, mdoc->fn_prio++, n);
 			return;
 		}
 	}
@@ -1579,7 +1578,7 @@ static void
 post_em(POST_ARGS)
 {
 	post_tag(mdoc);
-	tag_put(NULL, TAG_FALLBACK, mdoc->last);
+	tag_put(mdoc, NULL, TAG_FALLBACK, mdoc->last);
 }
 
 static void
@@ -1600,7 +1599,7 @@ post_er(POST_ARGS)
 	    (n->parent->tok == MDOC_It ||
 	     (n->parent->tok == MDOC_Bq &&
 	      n->parent->parent->parent->tok == MDOC_It)))
-		tag_put(NULL, TAG_STRONG, n);
+		tag_put(mdoc, NULL, TAG_STRONG, n);
 	post_delim_nb(mdoc);
 }
 
@@ -1617,7 +1616,7 @@ post_tag(POST_ARGS)
 	     (n->parent->tok == MDOC_Xo &&
 	      n->parent->parent->prev == NULL &&
 	      n->parent->parent->parent->tok == MDOC_It)))
-		tag_put(NULL, TAG_STRONG, n);
+		tag_put(mdoc, NULL, TAG_STRONG, n);
 	post_delim_nb(mdoc);
 }
 
@@ -2496,7 +2495,7 @@ post_sh_head(POST_ARGS)
 		mdoc->flags &= ~MDOC_SYNOPSIS;
 	}
 	if (sec == SEC_DESCRIPTION)
-		fn_prio = TAG_STRONG;
+		mdoc->fn_prio = TAG_STRONG;
 
 	/* Mark our last section. */
 
@@ -2617,9 +2616,9 @@ post_section(POST_ARGS)
 			if ((nch = n->child) != NULL &&
 			    nch->type == ROFFT_TEXT &&
 			    strcmp(nch->string, tag) == 0)
-				tag_put(NULL, TAG_STRONG, n);
+				tag_put(mdoc, NULL, TAG_STRONG, n);
 			else
-				tag_put(tag, TAG_FALLBACK, n);
+				tag_put(mdoc, tag, TAG_FALLBACK, n);
 			free(tag);
 		}
 		post_delim(mdoc);
@@ -2682,7 +2681,7 @@ post_par(POST_ARGS)
 {
 	struct roff_node *np;
 
-	fn_prio = TAG_STRONG;
+	mdoc->fn_prio = TAG_STRONG;
 	post_prevpar(mdoc);
 
 	np = mdoc->last;
@@ -2872,7 +2871,6 @@ post_os(POST_ARGS)
 {
 #ifndef OSNAME
 	struct utsname	  utsname;
-	static char	 *defbuf;
 #endif
 	struct roff_node *n;
 
@@ -2909,15 +2907,12 @@ post_os(POST_ARGS)
 #ifdef OSNAME
 	mdoc->meta.os = mandoc_strdup(OSNAME);
 #else /*!OSNAME */
-	if (defbuf == NULL) {
-		if (uname(&utsname) == -1) {
-			mandoc_msg(MANDOCERR_OS_UNAME, n->line, n->pos, "Os");
-			defbuf = mandoc_strdup("UNKNOWN");
-		} else
-			mandoc_asprintf(&defbuf, "%s %s",
-			    utsname.sysname, utsname.release);
-	}
-	mdoc->meta.os = mandoc_strdup(defbuf);
+	if (uname(&utsname) == -1) {
+		mandoc_msg(MANDOCERR_OS_UNAME, n->line, n->pos, "Os");
+		mdoc->meta.os = mandoc_strdup("UNKNOWN");
+	} else
+		mandoc_asprintf(&mdoc->meta.os, "%s %s",
+		    utsname.sysname, utsname.release);
 #endif /*!OSNAME*/
 
 out:
@@ -64,6 +64,8 @@ struct	mparse {
 	int		  filenc; /* encoding of the current file */
 	int		  reparse_count; /* finite interp. stack */
 	int		  line; /* line number in the file */
+	int		  recursion_depth; /* of .so requests */
+	int		  so_count; /* .so requests followed */
 };
 
 static	void	  choose_parser(struct mparse *);
@@ -381,6 +383,7 @@ rerun:
 				    mandoc_strdup(ln.buf + of);
 				goto out;
 			}
+			curp->so_count++;
 			if ((fd = mparse_open(curp, ln.buf + of)) != -1) {
 				mparse_readfd(curp, fd, ln.buf + of);
 				close(fd);
@@ -602,8 +605,6 @@ mparse_end(struct mparse *curp)
 void
 mparse_readfd(struct mparse *curp, int fd, const char *filename)
 {
-	static int	 recursion_depth;
-
 	struct buf	 blk;
 	struct buf	*save_primary;
 	const char	*save_filename, *cp;
@@ -611,10 +612,10 @@ mparse_readfd(struct mparse *curp, int fd, const char *filename)
 	int		 save_filenc, save_lineno;
 	int		 with_mmap;
 
-	if (recursion_depth > 64) {
+	if (curp->recursion_depth > 64) {
 		mandoc_msg(MANDOCERR_ROFFLOOP, curp->line, 0, NULL);
 		return;
-	} else if (recursion_depth == 0 &&
+	} else if (curp->recursion_depth == 0 &&
 	    (cp = strrchr(filename, '.')) != NULL &&
             cp[1] >= '1' && cp[1] <= '9')
                 curp->man->filesec = cp[1];
@@ -648,9 +649,9 @@ mparse_readfd(struct mparse *curp, int fd, const char *filename)
 	} else
 		offset = 0;
 
-	recursion_depth++;
+	curp->recursion_depth++;
 	mparse_buf_r(curp, blk, offset, 1);
-	if (--recursion_depth == 0)
+	if (--curp->recursion_depth == 0)
 		mparse_end(curp);
 
 	/*
@@ -749,26 +750,27 @@ mparse_alloc(int options, enum mandoc_os os_e, const char *os_s)
 	}
 	curp->man->meta.first->tok = TOKEN_NONE;
 	curp->man->meta.os_e = os_e;
-	tag_alloc();
+	tag_alloc(curp->man);
 	return curp;
 }
 
 void
 mparse_reset(struct mparse *curp)
 {
-	tag_free();
+	tag_free(curp->man);
 	roff_reset(curp->roff);
 	roff_man_reset(curp->man);
 	free_buf_list(curp->secondary);
 	curp->secondary = NULL;
 	curp->gzip = 0;
-	tag_alloc();
+	curp->so_count = 0;
+	tag_alloc(curp->man);
 }
 
 void
 mparse_free(struct mparse *curp)
 {
-	tag_free();
+	tag_free(curp->man);
 	roffhash_free(curp->man->mdocmac);
 	roffhash_free(curp->man->manmac);
 	roff_man_free(curp->man);
@@ -777,6 +779,16 @@ mparse_free(struct mparse *curp)
 	free(curp);
 }
 
+/*
+ * Number of .so requests followed (or tried), the result then
+ * depends on other files and the current directory as well.
+ */
+int
+mparse_so_count(const struct mparse *curp)
+{
+	return curp->so_count;
+}
+
 struct roff_meta *
 mparse_result(struct mparse *curp)
 {
@@ -39,6 +39,7 @@
 #include "roff_int.h"
 #include "tbl_parse.h"
 #include "eqn_parse.h"
+#include "tag.h"
 
 /*
  * ASCII_ESC is used to signal from roff_getarg() to roff_expand()
@@ -131,6 +132,10 @@ struct	roff {
 	int		 rstacksz; /* current size limit of rstack */
 	int		 rstackpos; /* position in rstack */
 	int		 format; /* current file in mdoc or man format */
+	int		 ce_lines; /* number of input lines to center */
+	struct roff_node *ce_node; /* active request */
+	int		 it_lines; /* number of lines to delay */
+	char		*it_macro; /* nil-terminated macro line */
 	char		 control; /* control character */
 	char		 escape; /* escape character */
 };
@@ -626,10 +631,6 @@ static	const struct predef predefs[PREDEFS_MAX] = {
 #include "predefs.in"
 };
 
-static	int	 roffce_lines;	/* number of input lines to center */
-static	struct roff_node *roffce_node;  /* active request */
-static	int	 roffit_lines;  /* number of lines to delay */
-static	char	*roffit_macro;  /* nil-terminated macro line */
 
 
 /* --- request table ------------------------------------------------------ */
@@ -778,10 +779,10 @@ roff_reset(struct roff *r)
 	r->format = r->options & (MPARSE_MDOC | MPARSE_MAN);
 	r->control = '\0';
 	r->escape = '\\';
-	roffce_lines = 0;
-	roffce_node = NULL;
-	roffit_lines = 0;
-	roffit_macro = NULL;
+	r->ce_lines = 0;
+	r->ce_node = NULL;
+	r->it_lines = 0;
+	r->it_macro = NULL;
 }
 
 void
@@ -847,6 +848,7 @@ roff_man_alloc1(struct roff_man *man)
 	man->meta.first = mandoc_calloc(1, sizeof(*man->meta.first));
 	man->meta.first->type = ROFFT_ROOT;
 	man->meta.macroset = MACROSET_NONE;
+	man->fn_prio = TAG_STRONG;
 	roff_state_reset(man);
 }
 
@@ -1767,26 +1769,26 @@ roff_parsetext(struct roff *r, struct buf *buf, int pos, int *offs)
 
 	/* Spring the input line trap. */
 
-	if (roffit_lines == 1) {
-		isz = mandoc_asprintf(&p, "%s\n.%s", buf->buf, roffit_macro);
+	if (r->it_lines == 1) {
+		isz = mandoc_asprintf(&p, "%s\n.%s", buf->buf, r->it_macro);
 		free(buf->buf);
 		buf->buf = p;
 		buf->sz = isz + 1;
 		*offs = 0;
-		free(roffit_macro);
-		roffit_lines = 0;
+		free(r->it_macro);
+		r->it_lines = 0;
 		return ROFF_REPARSE;
-	} else if (roffit_lines > 1)
-		--roffit_lines;
+	} else if (r->it_lines > 1)
+		--r->it_lines;
 
-	if (roffce_node != NULL && buf->buf[pos] != '\0') {
-		if (roffce_lines < 1) {
-			r->man->last = roffce_node;
+	if (r->ce_node != NULL && buf->buf[pos] != '\0') {
+		if (r->ce_lines < 1) {
+			r->man->last = r->ce_node;
 			r->man->next = ROFF_NEXT_SIBLING;
-			roffce_lines = 0;
-			roffce_node = NULL;
+			r->ce_lines = 0;
+			r->ce_node = NULL;
 		} else
-			roffce_lines--;
+			r->ce_lines--;
 	}
 
 	/* Convert all breakable hyphens into ASCII_HYPH. */
@@ -1936,13 +1938,13 @@ roff_parseln(struct roff *r, int ln, struct buf *buf, int *offs, size_t len)
 
 	/* For now, let high level macros abort .ce mode. */
 
-	if (ctl && roffce_node != NULL &&
+	if (ctl && r->ce_node != NULL &&
 	    (t == TOKEN_NONE || t == ROFF_Dd || t == ROFF_EQ ||
 	     t == ROFF_TH || t == ROFF_TS)) {
-		r->man->last = roffce_node;
+		r->man->last = r->ce_node;
 		r->man->next = ROFF_NEXT_SIBLING;
-		roffce_lines = 0;
-		roffce_node = NULL;
+		r->ce_lines = 0;
+		r->ce_node = NULL;
 	}
 
 	/*
@@ -2407,13 +2409,13 @@ roff_cond_sub(ROFF_ARGS)
 
 	/* For now, let high level macros abort .ce mode. */
 
-	if (roffce_node != NULL &&
+	if (r->ce_node != NULL &&
 	    (t == TOKEN_NONE || t == ROFF_Dd || t == ROFF_EQ ||
              t == ROFF_TH || t == ROFF_TS)) {
-		r->man->last = roffce_node;
+		r->man->last = r->ce_node;
 		r->man->next = ROFF_NEXT_SIBLING;
-		roffce_lines = 0;
-		roffce_node = NULL;
+		r->ce_lines = 0;
+		r->ce_node = NULL;
 	}
 
 	/*
@@ -3278,8 +3280,8 @@ roff_it(ROFF_ARGS)
 	 * with DocBook stupidly fiddling with man(7) internals.
 	 */
 
-	roffit_lines = iv;
-	roffit_macro = mandoc_strdup(iv != 1 ||
+	r->it_lines = iv;
+	r->it_macro = mandoc_strdup(iv != 1 ||
 	    strcmp(buf->buf + pos, "an-trap") ?
 	    buf->buf + pos : "br");
 	return ROFF_IGN;
@@ -3503,8 +3505,8 @@ roff_onearg(ROFF_ARGS)
 	     tok == ROFF_ti))
 		man_breakscope(r->man, tok);
 
-	if (roffce_node != NULL && (tok == ROFF_ce || tok == ROFF_rj)) {
-		r->man->last = roffce_node;
+	if (r->ce_node != NULL && (tok == ROFF_ce || tok == ROFF_rj)) {
+		r->man->last = r->ce_node;
 		r->man->next = ROFF_NEXT_SIBLING;
 	}
 
@@ -3531,17 +3533,17 @@ roff_onearg(ROFF_ARGS)
 		}
 		npos = 0;
 		if (roff_evalnum(r, ln, r->man->last->string, &npos,
-		    &roffce_lines, 0) == 0) {
+		    &r->ce_lines, 0) == 0) {
 			mandoc_msg(MANDOCERR_CE_NONUM,
 			    ln, pos, "ce %s", buf->buf + pos);
-			roffce_lines = 1;
+			r->ce_lines = 1;
 		}
-		if (roffce_lines < 1) {
+		if (r->ce_lines < 1) {
 			r->man->last = r->man->last->parent;
-			roffce_node = NULL;
-			roffce_lines = 0;
+			r->ce_node = NULL;
+			r->ce_lines = 0;
 		} else
-			roffce_node = r->man->last->parent;
+			r->ce_node = r->man->last->parent;
 	} else {
 		n->flags |= NODE_VALID | NODE_ENDED;
 		r->man->last = n;
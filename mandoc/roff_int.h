@@ -60,6 +60,8 @@ struct	roff_man {
 	enum roff_sec	  lastnamed; /* Last standard section seen. */
 	enum roff_next	  next;    /* Where to put the next node. */
 	char		  filesec; /* Section digit in the file name. */
+	int		  fn_prio; /* Tag priority of the next Fn. */
+	struct ohash	 *tags;    /* Where terms are defined, see tag.c. */
 };
 
 
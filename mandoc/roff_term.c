@@ -159,11 +159,10 @@ static void
 roff_term_pre_po(ROFF_TERM_ARGS)
 {
 	struct roffsu	 su;
-	static int	 po, pouse, polast;
 	int		 ponew;
 
 	/* Revert the currently active page offset. */
-	p->tcol->offset -= pouse;
+	p->tcol->offset -= p->pouse;
 
 	/* Determine the requested page offset. */
 	if (n->child != NULL &&
@@ -171,18 +170,18 @@ roff_term_pre_po(ROFF_TERM_ARGS)
 		ponew = term_hen(p, &su);
 		if (*n->child->string == '+' ||
 		    *n->child->string == '-')
-			ponew += po;
+			ponew += p->po;
 	} else
-		ponew = polast;
+		ponew = p->polast;
 
 	/* Remeber both the previous and the newly requested offset. */
-	polast = po;
-	po = ponew;
+	p->polast = p->po;
+	p->po = ponew;
 
 	/* Truncate to the range [-offset, 60], remember, and apply it. */
-	pouse = po >= 60 ? 60 :
-	    po < -(int)p->tcol->offset ? -(int)p->tcol->offset : po;
-	p->tcol->offset += pouse;
+	p->pouse = p->po >= 60 ? 60 :
+	    p->po < -(int)p->tcol->offset ? -(int)p->tcol->offset : p->po;
+	p->tcol->offset += p->pouse;
 }
 
 static void
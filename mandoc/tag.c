@@ -47,35 +47,34 @@ static void		 tag_move_href(struct roff_man *,
 				struct roff_node *, const char *);
 static void		 tag_move_id(struct roff_node *);
 
-static struct ohash	 tag_data;
-
-
 /*
- * Set up the ohash table to collect nodes
+ * Set up the ohash table of the parser to collect nodes
  * where various marked-up terms are documented.
  */
 void
-tag_alloc(void)
+tag_alloc(struct roff_man *man)
 {
-	mandoc_ohash_init(&tag_data, 4, offsetof(struct tag_entry, s));
+	man->tags = mandoc_malloc(sizeof(*man->tags));
+	mandoc_ohash_init(man->tags, 4, offsetof(struct tag_entry, s));
 }
 
 void
-tag_free(void)
+tag_free(struct roff_man *man)
 {
 	struct tag_entry	*entry;
 	unsigned int		 slot;
 
-	if (tag_data.info.free == NULL)
+	if (man->tags == NULL)
 		return;
-	entry = ohash_first(&tag_data, &slot);
+	entry = ohash_first(man->tags, &slot);
 	while (entry != NULL) {
 		free(entry->nodes);
 		free(entry);
-		entry = ohash_next(&tag_data, &slot);
+		entry = ohash_next(man->tags, &slot);
 	}
-	ohash_delete(&tag_data);
-	tag_data.info.free = NULL;
+	ohash_delete(man->tags);
+	free(man->tags);
+	man->tags = NULL;
 }
 
 /*
@@ -83,7 +82,7 @@ tag_free(void)
  * unless it is already defined at a lower priority.
  */
 void
-tag_put(const char *s, int prio, struct roff_node *n)
+tag_put(struct roff_man *man, const char *s, int prio, struct roff_node *n)
 {
 	struct tag_entry	*entry;
 	struct roff_node	*nold;
@@ -130,8 +129,8 @@ tag_put(const char *s, int prio, struct roff_node *n)
 	if (*se != '\0' && prio < TAG_WEAK)
 		prio = TAG_WEAK;
 
-	slot = ohash_qlookupi(&tag_data, s, &se);
-	entry = ohash_find(&tag_data, slot);
+	slot = ohash_qlookupi(man->tags, s, &se);
+	entry = ohash_find(man->tags, slot);
 
 	/* Build a new entry. */
 
@@ -141,7 +140,7 @@ tag_put(const char *s, int prio, struct roff_node *n)
 		entry->s[len] = '\0';
 		entry->nodes = NULL;
 		entry->maxnodes = entry->nnodes = 0;
-		ohash_insert(&tag_data, slot, entry);
+		ohash_insert(man->tags, slot, entry);
 	}
 
 	/*
@@ -188,9 +187,9 @@ tag_put(const char *s, int prio, struct roff_node *n)
 }
 
 int
-tag_exists(const char *tag)
+tag_exists(const struct roff_man *man, const char *tag)
 {
-	return ohash_find(&tag_data, ohash_qlookup(&tag_data, tag)) != NULL;
+	return ohash_find(man->tags, ohash_qlookup(man->tags, tag)) != NULL;
 }
 
 /*
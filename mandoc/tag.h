@@ -28,8 +28,9 @@
 #define	TAG_FALLBACK	(INT_MAX - 1)	/* Tag only used if unique. */
 #define	TAG_DELETE	(INT_MAX)	/* Tag not used at all. */
 
-void		 tag_alloc(void);
-int		 tag_exists(const char *);
-void		 tag_put(const char *, int, struct roff_node *);
+void		 tag_alloc(struct roff_man *);
+int		 tag_exists(const struct roff_man *, const char *);
+void		 tag_put(struct roff_man *, const char *, int,
+			struct roff_node *);
 void		 tag_postprocess(struct roff_man *, struct roff_node *);
-void		 tag_free(void);
+void		 tag_free(struct roff_man *);
@@ -62,6 +62,7 @@ term_free(struct termp *p)
 		free(p->tcol->buf);
 	free(p->tcols);
 	free(p->fontq);
+	term_tab_free(p);
 	free(p);
 }
 
@@ -168,7 +169,7 @@ term_flushln(struct termp *p)
 			switch (p->tcol->buf[ic]) {
 			case '\t':
 				if (p->flags & TERMP_BRTRSP)
-					vbr = term_tab_next(vbr);
+					vbr = term_tab_next(p, vbr);
 				continue;
 			case ' ':
 				if (p->flags & TERMP_BRTRSP)
@@ -272,7 +273,7 @@ term_fill(struct termp *p, size_t *nbr, size_t *vbr, size_t vtarget)
 		case ASCII_BREAK:  /* Escape \: (breakpoint). */
 			switch (p->tcol->buf[ic]) {
 			case '\t':
-				vn = term_tab_next(vis);
+				vn = term_tab_next(p, vis);
 				break;
 			case ' ':
 				vn = vis + (*p->width)(p, ' ');
@@ -367,7 +368,7 @@ term_field(struct termp *p, size_t vbl, size_t nbr)
 		case ASCII_BREAK:
 			continue;
 		case '\t':
-			vn = term_tab_next(vis);
+			vn = term_tab_next(p, vis);
 			vbl += vn - vis;
 			vis = vn;
 			continue;
@@ -41,6 +41,7 @@ struct	roff_meta;
 struct	roff_node;
 struct	tbl_span;
 struct	termp;
+struct	termp_tabs;
 
 typedef void	(*term_margin)(struct termp *, const struct roff_meta *);
 
@@ -121,6 +122,12 @@ struct	termp {
 	const void	 *argf;		/* arg for headf/footf */
 	const char	 *mc;		/* Margin character. */
 	struct termp_ps	 *ps;
+	struct termp_tabs *tabs;	/* Tab positions. */
+	int		  po;		/* Page offset, see roff_term.c. */
+	int		  pouse;
+	int		  polast;
+	size_t		  tbl_offset;	/* Of the table, see tbl_term.c. */
+	void		 *userdata;	/* For the letter and endline callbacks. */
 };
 
 
@@ -147,9 +154,10 @@ int		  term_vspan(const struct termp *, const struct roffsu *);
 size_t		  term_strlen(const struct termp *, const char *);
 size_t		  term_len(const struct termp *, size_t);
 
-void		  term_tab_set(const struct termp *, const char *);
-void		  term_tab_iset(size_t);
-size_t		  term_tab_next(size_t);
+void		  term_tab_set(struct termp *, const char *);
+void		  term_tab_iset(struct termp *, size_t);
+size_t		  term_tab_next(const struct termp *, size_t);
+void		  term_tab_free(struct termp *);
 
 void		  term_fontpush(struct termp *, enum termfont);
 void		  term_fontpop(struct termp *);
@@ -19,6 +19,7 @@
 #include <sys/types.h>
 
 #include <stddef.h>
+#include <stdlib.h>
 
 #include "mandoc_aux.h"
 #include "out.h"
@@ -30,36 +31,41 @@ struct tablist {
 	size_t	 n;	/* Currently used number of positions. */
 };
 
-static struct {
+/* Kept with the terminal, so each formatter has its own. */
+struct	termp_tabs {
 	struct tablist	 a;	/* All tab positions for lookup. */
 	struct tablist	 p;	/* Periodic tab positions to add. */
 	size_t		 d;	/* Default tab width in units of n. */
-} tabs;
+	int		 recording_period;
+};
 
 
 void
-term_tab_set(const struct termp *p, const char *arg)
+term_tab_set(struct termp *p, const char *arg)
 {
-	static int	 recording_period;
-
+	struct termp_tabs *tabs;
 	struct roffsu	 su;
 	struct tablist	*tl;
 	size_t		 pos;
 	int		 add;
 
+	if (p->tabs == NULL)
+		p->tabs = mandoc_calloc(1, sizeof(*p->tabs));
+	tabs = p->tabs;
+
 	/* Special arguments: clear all tabs or switch lists. */
 
 	if (arg == NULL) {
-		tabs.a.n = tabs.p.n = 0;
-		recording_period = 0;
-		if (tabs.d == 0) {
+		tabs->a.n = tabs->p.n = 0;
+		tabs->recording_period = 0;
+		if (tabs->d == 0) {
 			a2roffsu(".8i", &su, SCALE_IN);
-			tabs.d = term_hen(p, &su);
+			tabs->d = term_hen(p, &su);
 		}
 		return;
 	}
 	if (arg[0] == 'T' && arg[1] == '\0') {
-		recording_period = 1;
+		tabs->recording_period = 1;
 		return;
 	}
 
@@ -75,7 +81,7 @@ term_tab_set(const struct termp *p, const char *arg)
 
 	/* Select the list, and extend it if it is full. */
 
-	tl = recording_period ? &tabs.p : &tabs.a;
+	tl = tabs->recording_period ? &tabs->p : &tabs->a;
 	if (tl->n >= tl->s) {
 		tl->s += 8;
 		tl->t = mandoc_reallocarray(tl->t, tl->s, sizeof(*tl->t));
@@ -95,36 +101,57 @@ term_tab_set(const struct termp *p, const char *arg)
  * never incremental, never periodic, for use by tbl(7).
  */
 void
-term_tab_iset(size_t inc)
+term_tab_iset(struct termp *p, size_t inc)
 {
-	if (tabs.a.n >= tabs.a.s) {
-		tabs.a.s += 8;
-		tabs.a.t = mandoc_reallocarray(tabs.a.t, tabs.a.s,
-		    sizeof(*tabs.a.t));
+	struct termp_tabs *tabs;
+
+	if (p->tabs == NULL)
+		p->tabs = mandoc_calloc(1, sizeof(*p->tabs));
+	tabs = p->tabs;
+
+	if (tabs->a.n >= tabs->a.s) {
+		tabs->a.s += 8;
+		tabs->a.t = mandoc_reallocarray(tabs->a.t, tabs->a.s,
+		    sizeof(*tabs->a.t));
 	}
-	tabs.a.t[tabs.a.n++] = inc;
+	tabs->a.t[tabs->a.n++] = inc;
 }
 
 size_t
-term_tab_next(size_t prev)
+term_tab_next(const struct termp *p, size_t prev)
 {
+	struct termp_tabs *tabs;
 	size_t	 i, j;
 
+	if ((tabs = p->tabs) == NULL)
+		return prev;
+
 	for (i = 0;; i++) {
-		if (i == tabs.a.n) {
-			if (tabs.p.n == 0)
+		if (i == tabs->a.n) {
+			if (tabs->p.n == 0)
 				return prev;
-			tabs.a.n += tabs.p.n;
-			if (tabs.a.s < tabs.a.n) {
-				tabs.a.s = tabs.a.n;
-				tabs.a.t = mandoc_reallocarray(tabs.a.t,
-				    tabs.a.s, sizeof(*tabs.a.t));
+			tabs->a.n += tabs->p.n;
+			if (tabs->a.s < tabs->a.n) {
+				tabs->a.s = tabs->a.n;
+				tabs->a.t = mandoc_reallocarray(tabs->a.t,
+				    tabs->a.s, sizeof(*tabs->a.t));
 			}
-			for (j = 0; j < tabs.p.n; j++)
-				tabs.a.t[i + j] = tabs.p.t[j] +
-				    (i ? tabs.a.t[i - 1] : 0);
+			for (j = 0; j < tabs->p.n; j++)
+				tabs->a.t[i + j] = tabs->p.t[j] +
+				    (i ? tabs->a.t[i - 1] : 0);
 		}
-		if (prev < tabs.a.t[i])
-			return tabs.a.t[i];
+		if (prev < tabs->a.t[i])
+			return tabs->a.t[i];
 	}
 }
+
+void
+term_tab_free(struct termp *p)
+{
+	if (p->tabs == NULL)
+		return;
+	free(p->tabs->a.t);
+	free(p->tabs->p.t);
+	free(p->tabs);
+	p->tabs = NULL;
+}
@@ -0,0 +1,429 @@
+/*
+ * manindex.c
+ *
+ * persistent index of man page names, stored in the cache directory
+ * and mapped into memory on startup
+ *
+ * The index remembers modification times of all scanned man directories.
+ * As long as none of them changes, the stored names are used directly
+ * from the mapped file and no directory has to be read.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "manindex.h"
+
+#ifdef __APPLE__
+#define st_mtim st_mtimespec
+#endif
+
+#define MANINDEX_MAGIC "MANGLIDX"
+#define MANINDEX_VERSION 2
+
+struct manindex_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t n_dirs;
+    uint64_t n_entries;
+    uint64_t strings_size;
+};
+
+struct manindex_dir {
+    uint32_t path;
+    uint32_t reserved;
+    int64_t sec;
+    int64_t nsec;
+};
+
+struct manindex_entry {
+    uint32_t name;
+    uint32_t name_lower;
+    uint32_t file;
+    uint32_t pwd;
+    uint32_t desc;
+    uint32_t reserved;
+};
+
+static const struct manindex_header *get_header(const struct manindex *idx)
+{
+    return (const struct manindex_header *)idx->map;
+}
+
+static const struct manindex_dir *get_dirs(const struct manindex *idx)
+{
+    return (const struct manindex_dir *)((const char *)idx->map + sizeof(struct manindex_header));
+}
+
+static const struct manindex_entry *get_entries(const struct manindex *idx)
+{
+    return (const struct manindex_entry *)(get_dirs(idx) + get_header(idx)->n_dirs);
+}
+
+static const char *get_strings(const struct manindex *idx)
+{
+    return (const char *)(get_entries(idx) + get_header(idx)->n_entries);
+}
+
+static int make_dir(const char *path)
+{
+    if ((mkdir(path, 0755) != 0) && (errno != EEXIST))
+        return -1;
+
+    return 0;
+}
+
+/**
+ * Build the path of a file in the mangl cache directory
+ * ($XDG_CACHE_HOME/mangl or ~/.cache/mangl), creating the directory if
+ * necessary.
+ */
+int manindex_cache_filename(const char *name, char *out, size_t out_len)
+{
+    char dir[1024];
+
+    const char *xdg_cache = getenv("XDG_CACHE_HOME");
+    if (xdg_cache && (xdg_cache[0] == '/'))
+    {
+        snprintf(dir, sizeof(dir), "%s", xdg_cache);
+    }
+    else
+    {
+        const char *home = getenv("HOME");
+        if ((home == NULL) || (home[0] == '\0'))
+            return -1;
+
+        snprintf(dir, sizeof(dir), "%s/.cache", home);
+    }
+
+    if (make_dir(dir) != 0)
+        return -1;
+
+    size_t len = strlen(dir);
+    snprintf(dir + len, sizeof(dir) - len, "/mangl");
+
+    if (make_dir(dir) != 0)
+        return -1;
+
+    if (snprintf(out, out_len, "%s/%s", dir, name) >= out_len)
+        return -1;
+
+    return 0;
+}
+
+void manindex_stat_dirs(const char * const *dirs, size_t n_dirs, struct manindex_stamp *stamps)
+{
+    for (size_t i = 0; i < n_dirs; i++)
+    {
+        struct stat sb;
+
+        if (stat(dirs[i], &sb) == 0)
+        {
+            stamps[i].sec = sb.st_mtim.tv_sec;
+            stamps[i].nsec = sb.st_mtim.tv_nsec;
+        }
+        else
+        {
+            stamps[i].sec = 0;
+            stamps[i].nsec = 0;
+        }
+    }
+}
+
+static int validate(const struct manindex *idx)
+{
+    const struct manindex_header *h = get_header(idx);
+
+    if (idx->map_size < sizeof(*h))
+        return -1;
+
+    if ((memcmp(h->magic, MANINDEX_MAGIC, sizeof(h->magic)) != 0) || (h->version != MANINDEX_VERSION))
+        return -1;
+
+    uint64_t expected = sizeof(*h) + (uint64_t)h->n_dirs * sizeof(struct manindex_dir) +
+        h->n_entries * sizeof(struct manindex_entry) + h->strings_size;
+
+    if ((expected != idx->map_size) || (h->strings_size == 0))
+        return -1;
+
+    const char *strings = get_strings(idx);
+    if (strings[h->strings_size - 1] != '\0')
+        return -1;
+
+    const struct manindex_dir *dirs = get_dirs(idx);
+    for (uint32_t i = 0; i < h->n_dirs; i++)
+    {
+        if (dirs[i].path >= h->strings_size)
+            return -1;
+    }
+
+    const struct manindex_entry *entries = get_entries(idx);
+    for (uint64_t i = 0; i < h->n_entries; i++)
+    {
+        if ((entries[i].name >= h->strings_size) || (entries[i].name_lower >= h->strings_size) ||
+                (entries[i].file >= h->strings_size) || (entries[i].pwd >= h->strings_size) ||
+                (entries[i].desc >= h->strings_size))
+            return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Map the index file and check that it was built from exactly the given
+ * directories and that none of them was modified since.
+ *
+ * Returns 0 if the index can be used, -1 if it is missing or stale.
+ */
+int manindex_open(const char *filename, const char * const *dirs, size_t n_dirs, struct manindex *idx)
+{
+    memset(idx, 0, sizeof(*idx));
+
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+
+    struct stat sb;
+    if ((fstat(fd, &sb) != 0) || (sb.st_size < sizeof(struct manindex_header)))
+    {
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED)
+        return -1;
+
+    idx->map = map;
+    idx->map_size = sb.st_size;
+
+    if (validate(idx) != 0)
+        goto stale;
+
+    const struct manindex_header *h = get_header(idx);
+    if (h->n_dirs != n_dirs)
+        goto stale;
+
+    const struct manindex_dir *stored = get_dirs(idx);
+    const char *strings = get_strings(idx);
+
+    for (size_t i = 0; i < n_dirs; i++)
+    {
+        if (strcmp(&strings[stored[i].path], dirs[i]) != 0)
+            goto stale;
+    }
+
+    struct manindex_stamp *stamps = calloc(n_dirs ? n_dirs : 1, sizeof(struct manindex_stamp));
+    if (stamps == NULL)
+        goto stale;
+
+    manindex_stat_dirs(dirs, n_dirs, stamps);
+
+    for (size_t i = 0; i < n_dirs; i++)
+    {
+        if ((stamps[i].sec != stored[i].sec) || (stamps[i].nsec != stored[i].nsec))
+        {
+            free(stamps);
+            goto stale;
+        }
+    }
+
+    free(stamps);
+
+    idx->count = h->n_entries;
+    return 0;
+
+stale:
+    manindex_close(idx);
+    return -1;
+}
+
+struct manindex_page manindex_get(const struct manindex *idx, size_t i)
+{
+    const struct manindex_entry *e = &get_entries(idx)[i];
+    const char *strings = get_strings(idx);
+
+    struct manindex_page p = {
+        .name = &strings[e->name],
+        .name_lower = &strings[e->name_lower],
+        .file = &strings[e->file],
+        .pwd = &strings[e->pwd],
+        .desc = &strings[e->desc],
+    };
+
+    return p;
+}
+
+void manindex_close(struct manindex *idx)
+{
+    if (idx->map)
+        munmap(idx->map, idx->map_size);
+
+    memset(idx, 0, sizeof(*idx));
+}
+
+struct string_pool {
+    char *data;
+    size_t size;
+    size_t allocated;
+};
+
+static int64_t pool_add(struct string_pool *pool, const char *str)
+{
+    size_t len = strlen(str) + 1;
+
+    if ((pool->size + len) > UINT32_MAX)
+        return -1;
+
+    if ((pool->size + len) > pool->allocated)
+    {
+        size_t new_size = pool->allocated ? pool->allocated * 2 : 65536;
+        while (new_size < (pool->size + len))
+            new_size *= 2;
+
+        char *new_data = realloc(pool->data, new_size);
+        if (new_data == NULL)
+            return -1;
+
+        pool->data = new_data;
+        pool->allocated = new_size;
+    }
+
+    memcpy(&pool->data[pool->size], str, len);
+    pool->size += len;
+
+    return pool->size - len;
+}
+
+static int write_all(int fd, const void *data, size_t size)
+{
+    const char *ptr = data;
+
+    while (size > 0)
+    {
+        ssize_t written = write(fd, ptr, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        ptr += written;
+        size -= written;
+    }
+
+    return 0;
+}
+
+/**
+ * Store the index. Pages must already be sorted in the order they should be
+ * returned by manindex_get(). The file is replaced atomically so a running
+ * instance can keep using the old mapping.
+ */
+int manindex_write(const char *filename, const char * const *dirs, const struct manindex_stamp *stamps, size_t n_dirs,
+        char * const *names, char * const *names_lower, char * const *files, char * const *pwds, char * const *descs,
+        size_t count)
+{
+    struct string_pool pool = {0};
+    struct manindex_dir *dir_table = calloc(n_dirs ? n_dirs : 1, sizeof(struct manindex_dir));
+    struct manindex_entry *entries = calloc(count ? count : 1, sizeof(struct manindex_entry));
+    int ret = -1;
+    int fd = -1;
+    char tmp_filename[1100];
+
+    if ((dir_table == NULL) || (entries == NULL))
+        goto out;
+
+    for (size_t i = 0; i < n_dirs; i++)
+    {
+        int64_t off = pool_add(&pool, dirs[i]);
+        if (off < 0)
+            goto out;
+
+        dir_table[i].path = off;
+        dir_table[i].sec = stamps[i].sec;
+        dir_table[i].nsec = stamps[i].nsec;
+    }
+
+    /* there are only a few distinct pwd strings (one per man path) */
+    const char *last_pwd = NULL;
+    int64_t last_pwd_off = -1;
+    int64_t empty = pool_add(&pool, "");
+
+    if (empty < 0)
+        goto out;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        int64_t name = pool_add(&pool, names[i]);
+        int64_t name_lower = (strcmp(names[i], names_lower[i]) == 0) ? name : pool_add(&pool, names_lower[i]);
+        int64_t file = pool_add(&pool, files[i]);
+
+        if ((last_pwd == NULL) || (strcmp(last_pwd, pwds[i]) != 0))
+        {
+            last_pwd = pwds[i];
+            last_pwd_off = pool_add(&pool, pwds[i]);
+        }
+
+        int64_t desc = (descs[i] && descs[i][0]) ? pool_add(&pool, descs[i]) : empty;
+
+        if ((name < 0) || (name_lower < 0) || (file < 0) || (last_pwd_off < 0) || (desc < 0))
+            goto out;
+
+        entries[i].name = name;
+        entries[i].name_lower = name_lower;
+        entries[i].file = file;
+        entries[i].pwd = last_pwd_off;
+        entries[i].desc = desc;
+    }
+
+    struct manindex_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MANINDEX_MAGIC, sizeof(h.magic));
+    h.version = MANINDEX_VERSION;
+    h.n_dirs = n_dirs;
+    h.n_entries = count;
+    h.strings_size = pool.size;
+
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.%ld", filename, (long)getpid());
+
+    fd = open(tmp_filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1)
+        goto out;
+
+    if ((write_all(fd, &h, sizeof(h)) != 0) ||
+            (write_all(fd, dir_table, n_dirs * sizeof(struct manindex_dir)) != 0) ||
+            (write_all(fd, entries, count * sizeof(struct manindex_entry)) != 0) ||
+            (write_all(fd, pool.data, pool.size) != 0))
+    {
+        close(fd);
+        unlink(tmp_filename);
+        goto out;
+    }
+
+    close(fd);
+
+    if (rename(tmp_filename, filename) != 0)
+    {
+        unlink(tmp_filename);
+        goto out;
+    }
+
+    ret = 0;
+
+out:
+    free(pool.data);
+    free(entries);
+    free(dir_table);
+    return ret;
+}
@@ -0,0 +1,39 @@
+#ifndef __MANINDEX_H__
+#define __MANINDEX_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* modification time of a scanned directory, all zero if it doesn't exist */
+struct manindex_stamp {
+    int64_t sec;
+    int64_t nsec;
+};
+
+/* one page of a loaded index, all strings point into the mapped file */
+struct manindex_page {
+    const char *name;
+    const char *name_lower;
+    const char *file;
+    const char *pwd;
+    const char *desc; /* one-line description, empty if unknown */
+};
+
+struct manindex {
+    void *map;
+    size_t map_size;
+    size_t count;
+};
+
+int manindex_cache_filename(const char *name, char *out, size_t out_len);
+void manindex_stat_dirs(const char * const *dirs, size_t n_dirs, struct manindex_stamp *stamps);
+
+int manindex_open(const char *filename, const char * const *dirs, size_t n_dirs, struct manindex *idx);
+struct manindex_page manindex_get(const struct manindex *idx, size_t i);
+void manindex_close(struct manindex *idx);
+
+int manindex_write(const char *filename, const char * const *dirs, const struct manindex_stamp *stamps, size_t n_dirs,
+        char * const *names, char * const *names_lower, char * const *files, char * const *pwds, char * const *descs,
+        size_t count);
+
+#endif // __MANINDEX_H__
@@ -1,121 +1,419 @@
 /*
  * manpath.c
  *
- * retrieving paths for man pages from `manpath` executable
- */
-
-/**
- * Buffer size might seem excessive, but keeps the algorithm simple for the
- * moment. Though it's checked, if the buffer was insufficient and a warning
- * is given in case.
+ * retrieving paths for man pages the way `manpath` does it, without
+ * running it: from MANPATH, man_db.conf/manpath.config (man-db), man.conf
+ * (mandoc) and the directories next to the ones in PATH
  *
- * Using Nix package manager and `nix shell` 500 characters output is reached
- * easily.
+ * The candidate directories are cached in the mangl cache directory and
+ * used as long as the environment and the configuration files don't change.
+ * Which of them exist is checked every time, so a directory created or
+ * removed later doesn't need a new cache.
  */
-#define MAN_PATHS_BUFFER_SIZE 4096
 
 // just for easy debugging
 //#define DEBUG_MANPATH(...) fprintf(stderr, __VA_ARGS__)
 #define DEBUG_MANPATH(...) while(0)
 
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "stretchy_buffer.h"
+#include "manindex.h"
+#include "manpath.h"
+
+#ifdef __APPLE__
+#define st_mtim st_mtimespec
+#endif
+
+#define MANPATH_CACHE_VERSION 2
+
+/* man-db uses one of the first two, mandoc the last one */
+static const char * const config_files[] = {
+    "/etc/man_db.conf",
+    "/etc/manpath.config",
+    "/etc/man.conf"
+};
 
-static int read_stdout_from_manpath(char *buffer)
+/* MANPATH_MAP entry of man_db.conf */
+struct path_map {
+    char *bin;
+    char *man;
+};
+
+struct man_config {
+    char **mandatory;
+    struct path_map *maps;
+    char **manpaths; /* man.conf */
+};
+
+static int is_directory(const char *path)
 {
-    DEBUG_MANPATH("execute `manpath` and read stdout into string\n");
+    struct stat sb;
+    return (stat(path, &sb) == 0) && S_ISDIR(sb.st_mode);
+}
 
-    FILE *manpath_stdout;
-    char *retval;
+/* candidate for a man path, whether it exists is checked by keep_directories() */
+static void add_path(char ***paths, const char *path)
+{
+    if (path[0] != '/')
+        return;
 
-    manpath_stdout = popen("/usr/bin/env manpath --quiet", "r");
-    retval = fgets(buffer, MAN_PATHS_BUFFER_SIZE, manpath_stdout);
-    if(retval == NULL)
-        return 0;
+    for (int i = 0; i < sb_count(*paths); i++)
+    {
+        if (strcmp((*paths)[i], path) == 0)
+            return;
+    }
 
-    DEBUG_MANPATH("checking if buffer was exceeded\n");
-    // let's assume there is no filename with a newline
-    // `manpath` always ends on a newline
-    if(strchr(buffer, '\n') == NULL)
+    DEBUG_MANPATH("adding \"%s\"\n", path);
+    sb_push(*paths, strdup(path));
+}
+
+/* split the line into whitespace separated words, returns number of words */
+static int split_words(char *line, char **words, int max_words)
+{
+    int n = 0;
+    char *next;
+    char *word = strtok_r(line, " \t\r\n", &next);
+
+    while ((word != NULL) && (n < max_words))
     {
-        fprintf(stderr, "Output of `manpath` exceeded buffer of %d.\n", MAN_PATHS_BUFFER_SIZE);
-        fprintf(stderr, "Not all paths to man pages will be searched.\n");
+        words[n++] = word;
+        word = strtok_r(NULL, " \t\r\n", &next);
     }
-    pclose(manpath_stdout);
 
-    DEBUG_MANPATH("%s", buffer);
-    return 1;
+    return n;
 }
-static int allocating_array_for_paths(char *buffer, char const ***manpath_paths)
+
+static void read_config_file(const char *filename, struct man_config *conf)
 {
-    DEBUG_MANPATH("allocating array for pointers to path\n");
+    FILE *f = fopen(filename, "r");
+    if (f == NULL)
+        return;
+
+    DEBUG_MANPATH("reading \"%s\"\n", filename);
 
-    // XXX: saw too late, that there is stretchy_buffer …
-    char *current_path = buffer;
-    size_t number_of_manpath_paths = 1;
+    char *line = NULL;
+    size_t line_size = 0;
 
-    while((current_path = strchr(++current_path, ':')) != NULL)
-        ++number_of_manpath_paths;
-    *manpath_paths = calloc(number_of_manpath_paths, sizeof(char *));
-    if(*manpath_paths == NULL)
+    while (getline(&line, &line_size, f) != -1)
     {
-        fprintf(stderr, "Failed to calloc() memory in `%s` at line %d\n", __FILE__, __LINE__);
-        fprintf(stderr, "Falling back original hard coded paths\n");
-        return 0;
+        char *words[3];
+        int n = split_words(line, words, 3);
+
+        if ((n < 2) || (words[0][0] == '#'))
+            continue;
+
+        if (strcmp(words[0], "MANDATORY_MANPATH") == 0)
+        {
+            sb_push(conf->mandatory, strdup(words[1]));
+        }
+        else if ((strcmp(words[0], "MANPATH_MAP") == 0) && (n == 3))
+        {
+            struct path_map m = { strdup(words[1]), strdup(words[2]) };
+            sb_push(conf->maps, m);
+        }
+        else if (strcmp(words[0], "manpath") == 0)
+        {
+            sb_push(conf->manpaths, strdup(words[1]));
+        }
     }
 
-    DEBUG_MANPATH("allocated space, number of paths: %ld\n", number_of_manpath_paths);
-    return number_of_manpath_paths;
+    free(line);
+    fclose(f);
 }
 
-static void split_buffer_into_paths(char *buffer, char const ***manpath_paths)
+static void free_config(struct man_config *conf)
 {
-    DEBUG_MANPATH("splitting buffer into paths\n");
-
-    size_t manpath_paths_index = 0;
-    char *current_path, *next_path;
-    current_path = strtok_r(buffer, ":\n", &next_path);
+    for (int i = 0; i < sb_count(conf->mandatory); i++)
+        free(conf->mandatory[i]);
 
-    while (current_path != NULL)
+    for (int i = 0; i < sb_count(conf->maps); i++)
     {
-        DEBUG_MANPATH("%ld — \"%s\"\n", (current_path - buffer), current_path);
-        (*manpath_paths)[manpath_paths_index++] = current_path;
-        current_path = strtok_r(NULL, ":\n", &next_path);
+        free(conf->maps[i].bin);
+        free(conf->maps[i].man);
     }
 
-    DEBUG_MANPATH("splitting done, paths index: %ld\n", manpath_paths_index);
+    for (int i = 0; i < sb_count(conf->manpaths); i++)
+        free(conf->manpaths[i]);
+
+    sb_free(conf->mandatory);
+    sb_free(conf->maps);
+    sb_free(conf->manpaths);
 }
 
 /**
- * Retrieves paths to man pages by running `manpath` and splitting its
- * stdout into an array. If successful, the result is cached and
- * subsequent calls will return the same result.
+ * Man paths used when MANPATH doesn't say otherwise: every directory in
+ * PATH contributes its mapped man directories or the man directories
+ * next to it (`/usr/bin` -> `/usr/man`, `/usr/share/man`), followed by
+ * the mandatory ones from the configuration.
  */
-size_t get_man_paths_from_manpath_executable(const char * const *paths[])
+static void add_system_paths(char ***paths, const struct man_config *conf)
+{
+    for (int i = 0; i < sb_count(conf->manpaths); i++)
+        add_path(paths, conf->manpaths[i]);
+
+    const char *env_path = getenv("PATH");
+    if (env_path)
+    {
+        char *path_copy = strdup(env_path);
+        char *next;
+
+        for (char *dir = strtok_r(path_copy, ":", &next); dir != NULL; dir = strtok_r(NULL, ":", &next))
+        {
+            int mapped = 0;
+            for (int i = 0; i < sb_count(conf->maps); i++)
+            {
+                if (strcmp(conf->maps[i].bin, dir) == 0)
+                {
+                    add_path(paths, conf->maps[i].man);
+                    mapped = 1;
+                }
+            }
+
+            if (mapped)
+                continue;
+
+            char parent[1024];
+            snprintf(parent, sizeof(parent), "%s", dir);
+
+            size_t len = strlen(parent);
+            while ((len > 1) && (parent[len - 1] == '/'))
+                parent[--len] = '\0';
+
+            char *slash = strrchr(parent, '/');
+            if ((slash == NULL) || ((strcmp(slash, "/bin") != 0) && (strcmp(slash, "/sbin") != 0)))
+                continue;
+
+            *slash = '\0';
+
+            char man_dir[1100];
+            snprintf(man_dir, sizeof(man_dir), "%s/man", parent);
+            add_path(paths, man_dir);
+            snprintf(man_dir, sizeof(man_dir), "%s/share/man", parent);
+            add_path(paths, man_dir);
+        }
+
+        free(path_copy);
+    }
+
+    for (int i = 0; i < sb_count(conf->mandatory); i++)
+        add_path(paths, conf->mandatory[i]);
+}
+
+static char **resolve_man_paths(void)
 {
-    // Keep the result around for simpler memory management and caching.
-    // Entries in `manpath_paths` just point to partial strings in `buffer[]`.
-    static char const **manpath_paths = NULL;
-    static size_t number_of_manpath_paths = 0;
-    static char buffer[MAN_PATHS_BUFFER_SIZE];
-
-    // if `manpath` returned anything prevously, use that
-    if (manpath_paths != NULL)
+    struct man_config conf = {0};
+    char **paths = NULL;
+
+    for (size_t i = 0; i < sizeof(config_files) / sizeof(config_files[0]); i++)
+        read_config_file(config_files[i], &conf);
+
+    const char *env_manpath = getenv("MANPATH");
+    if ((env_manpath == NULL) || (env_manpath[0] == '\0'))
+    {
+        add_system_paths(&paths, &conf);
+    }
+    else
     {
-        *paths = manpath_paths;
-        return number_of_manpath_paths;
+        /* an empty component (leading, trailing or double colon) stands for the system paths */
+        const char *start = env_manpath;
+        int system_added = 0;
+
+        for (;;)
+        {
+            const char *end = strchr(start, ':');
+            size_t len = end ? (size_t)(end - start) : strlen(start);
+
+            if (len == 0)
+            {
+                if (!system_added)
+                    add_system_paths(&paths, &conf);
+                system_added = 1;
+            }
+            else
+            {
+                char *dir = strndup(start, len);
+                add_path(&paths, dir);
+                free(dir);
+            }
+
+            if (end == NULL)
+                break;
+            start = end + 1;
+        }
     }
 
-    if(!read_stdout_from_manpath(buffer))
-        return 0;
+    free_config(&conf);
+    return paths;
+}
+
+/* everything the result depends on, the cache is only used if it matches */
+static char *make_cache_header(void)
+{
+    const char *env_manpath = getenv("MANPATH");
+    const char *env_path = getenv("PATH");
+
+    size_t size = 256 + (env_manpath ? strlen(env_manpath) : 0) + (env_path ? strlen(env_path) : 0);
+    for (size_t i = 0; i < sizeof(config_files) / sizeof(config_files[0]); i++)
+        size += strlen(config_files[i]) + 64;
+
+    char *header = malloc(size);
+    if (header == NULL)
+        return NULL;
 
-    number_of_manpath_paths = allocating_array_for_paths(buffer, &manpath_paths);
-    if(!number_of_manpath_paths)
-        return 0;
+    size_t len = snprintf(header, size, "mangl manpath %d\nMANPATH=%s\nPATH=%s\n", MANPATH_CACHE_VERSION,
+            env_manpath ? env_manpath : "", env_path ? env_path : "");
 
-    split_buffer_into_paths(buffer, &manpath_paths);
+    for (size_t i = 0; i < sizeof(config_files) / sizeof(config_files[0]); i++)
+    {
+        struct stat sb;
+        long long sec = 0;
+        long long nsec = 0;
+
+        if (stat(config_files[i], &sb) == 0)
+        {
+            sec = sb.st_mtim.tv_sec;
+            nsec = sb.st_mtim.tv_nsec;
+        }
+
+        len += snprintf(header + len, size - len, "%s %lld %lld\n", config_files[i], sec, nsec);
+    }
+
+    snprintf(header + len, size - len, "\n");
+    return header;
+}
+
+static char **read_cached_man_paths(const char *filename, const char *header)
+{
+    FILE *f = fopen(filename, "r");
+    if (f == NULL)
+        return NULL;
+
+    char **paths = NULL;
+    char *line = NULL;
+    size_t line_size = 0;
+    const char *expected = header;
+    int header_matches = 1;
+    ssize_t len;
+
+    while ((len = getline(&line, &line_size, f)) != -1)
+    {
+        if (*expected)
+        {
+            /* header lines have to be identical */
+            if (strncmp(expected, line, len) != 0)
+            {
+                header_matches = 0;
+                break;
+            }
+
+            expected += len;
+            continue;
+        }
+
+        if ((len > 0) && (line[len - 1] == '\n'))
+            line[--len] = '\0';
+
+        if (len > 0)
+            sb_push(paths, strdup(line));
+    }
+
+    free(line);
+    fclose(f);
+
+    if (!header_matches || *expected)
+    {
+        for (int i = 0; i < sb_count(paths); i++)
+            free(paths[i]);
+        sb_free(paths);
+        return NULL;
+    }
+
+    return paths;
+}
+
+static void write_cached_man_paths(const char *filename, const char *header, char **paths)
+{
+    char tmp_filename[1100];
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.%ld", filename, (long)getpid());
+
+    FILE *f = fopen(tmp_filename, "w");
+    if (f == NULL)
+        return;
+
+    fputs(header, f);
+    for (int i = 0; i < sb_count(paths); i++)
+        fprintf(f, "%s\n", paths[i]);
+
+    if ((fclose(f) != 0) || (rename(tmp_filename, filename) != 0))
+        unlink(tmp_filename);
+}
+
+/* remove the paths which aren't (or no longer) directories */
+static void keep_directories(char **paths)
+{
+    int n = 0;
+
+    for (int i = 0; i < sb_count(paths); i++)
+    {
+        if (is_directory(paths[i]))
+        {
+            paths[n++] = paths[i];
+        }
+        else
+        {
+            DEBUG_MANPATH("skipping \"%s\"\n", paths[i]);
+            free(paths[i]);
+        }
+    }
+
+    if (paths)
+        stb__sbn(paths) = n;
+}
+
+// Keep the result around for simpler memory management and caching.
+static char **manpath_paths = NULL;
+static pthread_once_t manpath_once = PTHREAD_ONCE_INIT;
+
+static void load_man_paths(void)
+{
+    char cache_filename[1024];
+    int use_cache = manindex_cache_filename("manpath", cache_filename, sizeof(cache_filename)) == 0;
+    char *header = make_cache_header();
+
+    if (use_cache && header)
+        manpath_paths = read_cached_man_paths(cache_filename, header);
+
+    if (manpath_paths == NULL)
+    {
+        DEBUG_MANPATH("resolving man paths\n");
+        manpath_paths = resolve_man_paths();
+
+        if (use_cache && header && manpath_paths)
+            write_cached_man_paths(cache_filename, header, manpath_paths);
+    }
+
+    keep_directories(manpath_paths);
+
+    free(header);
+}
+
+/**
+ * Retrieves paths to man pages from the environment and the configuration
+ * files. The result is cached and subsequent calls (from any thread) will
+ * return the same result. Returns 0 if no path was found.
+ */
+size_t get_man_paths_from_configuration(const char * const *paths[])
+{
+    pthread_once(&manpath_once, &load_man_paths);
 
-    *paths = manpath_paths;
-    return number_of_manpath_paths;
+    *paths = (const char * const *)manpath_paths;
+    return sb_count(manpath_paths);
 }
@@ -1,6 +1,6 @@
 #ifndef __MANPATH_H__
 #define __MANPATH_H__
 
-size_t get_man_paths_from_manpath_executable(const char * const *paths[]);
+size_t get_man_paths_from_configuration(const char * const *paths[]);
 
 #endif // __MANPATH_H__
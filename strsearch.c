@@ -0,0 +1,193 @@
+/*
+ * strsearch.c
+ *
+ * substring search used by the page name search and the in-page search
+ *
+ * The vector versions compare the first and the last byte of the needle
+ * with 16 (SSE2) or 32 (AVX2) positions of the haystack at once and only
+ * compare the whole needle where both of them match. The implementation
+ * is chosen on the first call, depending on what the CPU supports.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define STRSEARCH_X86 1
+#endif
+
+#include "strsearch.h"
+
+static inline unsigned char fold(unsigned char c)
+{
+    return ((c >= 'A') && (c <= 'Z')) ? (c | 0x20) : c;
+}
+
+/* needle is already folded if ignore_case is set */
+static inline int equal_at(const char *text, const char *needle, size_t len, int ignore_case)
+{
+    if (!ignore_case)
+        return memcmp(text, needle, len) == 0;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        if (fold(text[i]) != (unsigned char)needle[i])
+            return 0;
+    }
+
+    return 1;
+}
+
+static long find_scalar(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len,
+        int ignore_case, size_t start)
+{
+    for (size_t i = start; i + needle_len <= haystack_len; i++)
+    {
+        if (equal_at(&haystack[i], needle, needle_len, ignore_case))
+            return i;
+    }
+
+    return -1;
+}
+
+#ifdef STRSEARCH_X86
+
+__attribute__((target("sse2")))
+static inline __m128i fold_sse2(__m128i x)
+{
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(x, _mm_set1_epi8('Z' + 1)));
+    return _mm_or_si128(x, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+__attribute__((target("sse2")))
+static long find_sse2(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len, int ignore_case)
+{
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needle_len - 1]);
+    size_t i = 0;
+
+    for (; i + needle_len - 1 + 16 <= haystack_len; i += 16)
+    {
+        __m128i block_first = _mm_loadu_si128((const __m128i *)&haystack[i]);
+        __m128i block_last = _mm_loadu_si128((const __m128i *)&haystack[i + needle_len - 1]);
+
+        if (ignore_case)
+        {
+            block_first = fold_sse2(block_first);
+            block_last = fold_sse2(block_last);
+        }
+
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, last)));
+
+        while (mask)
+        {
+            int bit = __builtin_ctz(mask);
+            if (equal_at(&haystack[i + bit], needle, needle_len, ignore_case))
+                return i + bit;
+
+            mask &= mask - 1;
+        }
+    }
+
+    return find_scalar(haystack, haystack_len, needle, needle_len, ignore_case, i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i fold_avx2(__m256i x)
+{
+    __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(x, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), x));
+    return _mm256_or_si256(x, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+
+__attribute__((target("avx2")))
+static long find_avx2(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len, int ignore_case)
+{
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[needle_len - 1]);
+    size_t i = 0;
+
+    for (; i + needle_len - 1 + 32 <= haystack_len; i += 32)
+    {
+        __m256i block_first = _mm256_loadu_si256((const __m256i *)&haystack[i]);
+        __m256i block_last = _mm256_loadu_si256((const __m256i *)&haystack[i + needle_len - 1]);
+
+        if (ignore_case)
+        {
+            block_first = fold_avx2(block_first);
+            block_last = fold_avx2(block_last);
+        }
+
+        unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(block_first, first), _mm256_cmpeq_epi8(block_last, last)));
+
+        while (mask)
+        {
+            int bit = __builtin_ctz(mask);
+            if (equal_at(&haystack[i + bit], needle, needle_len, ignore_case))
+                return i + bit;
+
+            mask &= mask - 1;
+        }
+    }
+
+    /* the remaining positions are covered with 16 byte blocks or one by one */
+    long pos = find_sse2(&haystack[i], haystack_len - i, needle, needle_len, ignore_case);
+    return (pos < 0) ? -1 : (long)i + pos;
+}
+
+#endif
+
+static long find_generic(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len, int ignore_case)
+{
+    return find_scalar(haystack, haystack_len, needle, needle_len, ignore_case, 0);
+}
+
+typedef long (*find_func)(const char *, size_t, const char *, size_t, int);
+
+static find_func select_implementation(void)
+{
+#ifdef STRSEARCH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return &find_avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return &find_sse2;
+#endif
+    return &find_generic;
+}
+
+long strsearch_find(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len, int ignore_case)
+{
+    static find_func selected = NULL;
+
+    find_func find = __atomic_load_n(&selected, __ATOMIC_RELAXED);
+    if (find == NULL)
+    {
+        find = select_implementation(); /* same result on every thread */
+        __atomic_store_n(&selected, find, __ATOMIC_RELAXED);
+    }
+
+    if (needle_len == 0)
+        return 0;
+
+    if (needle_len > haystack_len)
+        return -1;
+
+    if (!ignore_case)
+        return find(haystack, haystack_len, needle, needle_len, 0);
+
+    char buffer[512];
+    char *folded = (needle_len > sizeof(buffer)) ? malloc(needle_len) : buffer;
+    if (folded == NULL)
+        return -1;
+
+    for (size_t i = 0; i < needle_len; i++)
+        folded[i] = fold(needle[i]);
+
+    long pos = find(haystack, haystack_len, folded, needle_len, 1);
+
+    if (folded != buffer)
+        free(folded);
+
+    return pos;
+}
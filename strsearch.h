@@ -0,0 +1,9 @@
+#ifndef __STRSEARCH_H__
+#define __STRSEARCH_H__
+
+#include <stddef.h>
+
+/* position of the first occurrence of needle in haystack or -1, ignore_case folds ASCII letters only */
+long strsearch_find(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len, int ignore_case);
+
+#endif // __STRSEARCH_H__
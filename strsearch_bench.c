@@ -0,0 +1,164 @@
+/*
+ * strsearch_bench.c
+ *
+ * timing of the substring search (see strsearch.c) against the loops it
+ * replaced, run with "make bench"
+ *
+ * A haystack of man page like text is searched for a needle which only
+ * occurs close to its end, case sensitively (the old find_string() loop)
+ * and ignoring case (the old strncasecmp() loop of the in-page search).
+ * Each implementation is run several times and the fastest run counts.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <time.h>
+
+/* the implementations are static */
+#include "strsearch.c"
+
+#define HAYSTACK_SIZE (64 << 20)
+#define RUNS 5
+
+/* find_string() before strsearch.c, always case sensitive, the last possible position was never tried */
+static long old_find_string(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len, int ignore_case)
+{
+    int search_len = needle_len;
+    int text_len = haystack_len;
+
+    for (int i = 0; i < (text_len - search_len); i++)
+    {
+        bool match = true;
+        for (int j = 0; j < search_len; j++)
+        {
+            if (needle[j] != haystack[i + j])
+            {
+                match = false;
+                break;
+            }
+        }
+
+        if (match)
+            return i;
+    }
+
+    return -1;
+}
+
+/* the in-page search before strsearch.c, ignoring case */
+static long old_strncasecmp(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len, int ignore_case)
+{
+    for (const char *str = haystack; *str; str++)
+    {
+        if (strncasecmp(str, needle, needle_len) == 0)
+            return str - haystack;
+    }
+
+    return -1;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Fastest of RUNS runs of f, false if it didn't find the needle at expected.
+ * The vector versions expect a folded needle if ignore_case is set, like
+ * strsearch_find() passes it.
+ */
+static bool bench(const char *name, find_func f, const char *haystack, size_t haystack_len, const char *needle,
+        int ignore_case, long expected)
+{
+    double best = 0;
+    long pos = -1;
+
+    for (int run = 0; run < RUNS; run++)
+    {
+        double start = now();
+        pos = f(haystack, haystack_len, needle, strlen(needle), ignore_case);
+        double t = now() - start;
+
+        if ((run == 0) || (t < best))
+            best = t;
+    }
+
+    printf("  %-16s %8.4fs %8.2f GB/s%s\n", name, best, haystack_len / best * 1e-9, (pos == expected) ? "" : "  WRONG RESULT");
+    return pos == expected;
+}
+
+/* text of lowercase words with some capitalized ones, like a formatted page */
+static char *make_haystack(size_t size)
+{
+    static const char * const words[] = { "the", "file", "option", "is", "set", "to", "a", "value", "of",
+        "directory", "See", "NAME", "print", "when", "and", "default", "The", "output", "-f", "section" };
+
+    char *text = malloc(size + 1);
+    unsigned seed = 1;
+    size_t len = 0;
+
+    while (len < size)
+    {
+        seed = seed * 1103515245 + 12345;
+        const char *w = words[(seed >> 16) % (sizeof(words) / sizeof(words[0]))];
+
+        for (; *w && (len < size); w++)
+            text[len++] = *w;
+
+        if (len < size)
+            text[len++] = ((seed >> 8) % 12) ? ' ' : '\n';
+    }
+
+    text[size] = 0;
+    return text;
+}
+
+int main(void)
+{
+    char *haystack = make_haystack(HAYSTACK_SIZE);
+    size_t haystack_len = HAYSTACK_SIZE;
+
+    /* the only match, near the end so every version has to look at nearly everything */
+    const char *needle = "Printable";
+    const char *folded = "printable";
+    long expected = haystack_len - 4096;
+    memcpy(&haystack[expected], needle, strlen(needle));
+
+    bool ok = true;
+
+#ifdef STRSEARCH_X86
+    __builtin_cpu_init();
+    bool have_avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+    printf("%d MiB, needle \"%s\"\n", HAYSTACK_SIZE >> 20, needle);
+
+    printf("case sensitive:\n");
+    ok &= bench("old find_string", &old_find_string, haystack, haystack_len, needle, 0, expected);
+    ok &= bench("scalar", &find_generic, haystack, haystack_len, needle, 0, expected);
+#ifdef STRSEARCH_X86
+    ok &= bench("sse2", &find_sse2, haystack, haystack_len, needle, 0, expected);
+    if (have_avx2)
+        ok &= bench("avx2", &find_avx2, haystack, haystack_len, needle, 0, expected);
+#endif
+    ok &= bench("strsearch_find", &strsearch_find, haystack, haystack_len, needle, 0, expected);
+
+    printf("ignoring case:\n");
+    ok &= bench("old strncasecmp", &old_strncasecmp, haystack, haystack_len, needle, 1, expected);
+    ok &= bench("scalar", &find_generic, haystack, haystack_len, folded, 1, expected);
+#ifdef STRSEARCH_X86
+    ok &= bench("sse2", &find_sse2, haystack, haystack_len, folded, 1, expected);
+    if (have_avx2)
+        ok &= bench("avx2", &find_avx2, haystack, haystack_len, folded, 1, expected);
+#endif
+    ok &= bench("strsearch_find", &strsearch_find, haystack, haystack_len, needle, 1, expected);
+
+    free(haystack);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,246 @@
+/*
+ * trigram.c
+ *
+ * trigram index over the page names, used to find the names containing
+ * a search term without looking at every name
+ *
+ * Every string is split into its (overlapping) three byte sequences. For
+ * each sequence the index keeps the sorted list of strings containing it.
+ * The strings containing a term are among the intersection of the lists
+ * of all trigrams of the term, which is usually a tiny fraction of all
+ * strings, so only those have to be compared with the term.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "trigram.h"
+
+#define TRIGRAM(s) (((uint32_t)(unsigned char)(s)[0] << 16) | ((uint32_t)(unsigned char)(s)[1] << 8) | (unsigned char)(s)[2])
+
+/* (trigram << 32) | string index */
+static void radix_sort_by_trigram(uint64_t *pairs, uint64_t *tmp, size_t count)
+{
+    /* stable, so string indices stay ascending for each trigram */
+    for (int shift = 32; shift < 56; shift += 8)
+    {
+        size_t bucket[257] = {0};
+
+        for (size_t i = 0; i < count; i++)
+            bucket[((pairs[i] >> shift) & 0xff) + 1]++;
+
+        for (int b = 0; b < 256; b++)
+            bucket[b + 1] += bucket[b];
+
+        for (size_t i = 0; i < count; i++)
+            tmp[bucket[(pairs[i] >> shift) & 0xff]++] = pairs[i];
+
+        memcpy(pairs, tmp, count * sizeof(uint64_t));
+    }
+}
+
+struct trigram_index *trigram_index_build(char * const *strings, int count)
+{
+    size_t n_pairs = 0;
+    for (int i = 0; i < count; i++)
+    {
+        size_t len = strlen(strings[i]);
+        if (len >= 3)
+            n_pairs += len - 2;
+    }
+
+    struct trigram_index *t = calloc(1, sizeof(struct trigram_index));
+    uint64_t *pairs = malloc((n_pairs + 1) * sizeof(uint64_t));
+    uint64_t *tmp = malloc((n_pairs + 1) * sizeof(uint64_t));
+
+    if ((t == NULL) || (pairs == NULL) || (tmp == NULL))
+        goto fail;
+
+    size_t n = 0;
+    for (int i = 0; i < count; i++)
+    {
+        for (const char *s = strings[i]; s[0] && s[1] && s[2]; s++)
+            pairs[n++] = ((uint64_t)TRIGRAM(s) << 32) | (uint32_t)i;
+    }
+
+    radix_sort_by_trigram(pairs, tmp, n_pairs);
+    free(tmp);
+    tmp = NULL;
+
+    /* at most one key per pair, shrunk below */
+    t->keys = malloc((n_pairs + 1) * sizeof(uint32_t));
+    t->offsets = malloc((n_pairs + 2) * sizeof(uint32_t));
+    t->postings = malloc((n_pairs + 1) * sizeof(int32_t));
+    t->n_strings = count;
+
+    if ((t->keys == NULL) || (t->offsets == NULL) || (t->postings == NULL))
+        goto fail;
+
+    size_t n_postings = 0;
+    for (size_t i = 0; i < n_pairs; i++)
+    {
+        uint32_t key = pairs[i] >> 32;
+        int32_t index = (int32_t)(uint32_t)pairs[i];
+
+        if ((t->n_keys == 0) || (t->keys[t->n_keys - 1] != key))
+        {
+            t->keys[t->n_keys] = key;
+            t->offsets[t->n_keys] = n_postings;
+            t->n_keys++;
+        }
+        else if (t->postings[n_postings - 1] == index)
+        {
+            continue; /* trigram repeated within the string */
+        }
+
+        t->postings[n_postings++] = index;
+    }
+
+    t->offsets[t->n_keys] = n_postings;
+    free(pairs);
+
+    return t;
+
+fail:
+    free(pairs);
+    free(tmp);
+    trigram_index_free(t);
+    return NULL;
+}
+
+void trigram_index_free(struct trigram_index *t)
+{
+    if (t == NULL)
+        return;
+
+    free(t->keys);
+    free(t->offsets);
+    free(t->postings);
+    free(t);
+}
+
+static int find_key(const struct trigram_index *t, uint32_t key)
+{
+    int lo = 0;
+    int hi = t->n_keys;
+
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (t->keys[mid] < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return ((lo < t->n_keys) && (t->keys[lo] == key)) ? lo : -1;
+}
+
+/* first position in list[start..count) with a value >= value, galloping from start */
+static int gallop(const int32_t *list, int start, int count, int32_t value)
+{
+    int step = 1;
+    int hi = start;
+
+    while ((hi < count) && (list[hi] < value))
+    {
+        start = hi + 1;
+        hi += step;
+        step *= 2;
+    }
+
+    if (hi > count)
+        hi = count;
+
+    while (start < hi)
+    {
+        int mid = start + (hi - start) / 2;
+        if (list[mid] < value)
+            start = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return start;
+}
+
+struct posting_list {
+    const int32_t *data;
+    int count;
+};
+
+static int cmp_posting_list(const void *a, const void *b)
+{
+    return ((const struct posting_list *)a)->count - ((const struct posting_list *)b)->count;
+}
+
+/**
+ * Find the strings which may contain the term. The candidates (ascending
+ * string indices) still have to be compared with the term.
+ *
+ * Returns the number of candidates, or -1 if the term is shorter than
+ * a trigram and every string is a candidate.
+ */
+int trigram_index_query(const struct trigram_index *t, const char *term, int32_t **candidates_out)
+{
+    *candidates_out = NULL;
+
+    size_t len = strlen(term);
+    if (len < 3)
+        return -1;
+
+    struct posting_list *lists = malloc((len - 2) * sizeof(struct posting_list));
+    if (lists == NULL)
+        return -1;
+
+    int n_lists = 0;
+    for (size_t i = 0; i + 2 < len; i++)
+    {
+        int k = find_key(t, TRIGRAM(&term[i]));
+        if (k < 0)
+        {
+            free(lists);
+            return 0; /* no string contains this trigram */
+        }
+
+        lists[n_lists].data = &t->postings[t->offsets[k]];
+        lists[n_lists].count = t->offsets[k + 1] - t->offsets[k];
+        n_lists++;
+    }
+
+    /* start with the shortest list, it bounds the result */
+    qsort(lists, n_lists, sizeof(struct posting_list), &cmp_posting_list);
+
+    int32_t *candidates = malloc((lists[0].count + 1) * sizeof(int32_t));
+    if (candidates == NULL)
+    {
+        free(lists);
+        return -1;
+    }
+
+    int n_candidates = lists[0].count;
+    memcpy(candidates, lists[0].data, n_candidates * sizeof(int32_t));
+
+    for (int l = 1; (l < n_lists) && (n_candidates > 0); l++)
+    {
+        int kept = 0;
+        int pos = 0;
+
+        for (int i = 0; i < n_candidates; i++)
+        {
+            pos = gallop(lists[l].data, pos, lists[l].count, candidates[i]);
+            if (pos >= lists[l].count)
+                break;
+
+            if (lists[l].data[pos] == candidates[i])
+                candidates[kept++] = candidates[i];
+        }
+
+        n_candidates = kept;
+    }
+
+    free(lists);
+
+    *candidates_out = candidates;
+    return n_candidates;
+}
@@ -0,0 +1,20 @@
+#ifndef __TRIGRAM_H__
+#define __TRIGRAM_H__
+
+#include <stdint.h>
+
+/* posting lists of all three byte sequences occurring in a list of strings */
+struct trigram_index {
+    uint32_t *keys; /* sorted */
+    uint32_t *offsets; /* postings of keys[i] are postings[offsets[i]] .. postings[offsets[i + 1] - 1] */
+    int32_t *postings; /* string indices, ascending within a list */
+    int n_keys;
+    int n_strings;
+};
+
+struct trigram_index *trigram_index_build(char * const *strings, int count);
+void trigram_index_free(struct trigram_index *t);
+
+int trigram_index_query(const struct trigram_index *t, const char *term, int32_t **candidates_out);
+
+#endif // __TRIGRAM_H__
@@ -0,0 +1,225 @@
+/*
+ * whatis.c
+ *
+ * one-line description of a man page, read from its NAME section
+ *
+ * Used for pages which aren't in an up to date mandoc.db. Only the start
+ * of the (possibly gzip compressed) source is read and only the usual
+ * forms are understood: "name \- description" text in a man(7) page and
+ * the .Nd macro of an mdoc(7) page.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <zlib.h>
+
+#include "whatis.h"
+
+#define WHATIS_READ_SIZE 16384
+
+/* append text to out without roff escapes and quotes, and with single spaces */
+static void append_text(char *out, size_t out_len, const char *text, const char *end)
+{
+    size_t len = strlen(out);
+
+    for (const char *p = text; (p < end) && (len + 1 < out_len); p++)
+    {
+        char c = *p;
+
+        if ((c == '\\') && (p + 1 < end))
+        {
+            p++;
+            switch (*p)
+            {
+                case 'f': /* font: \fB, \f(CW, \f[CR] */
+                    if ((p + 1 < end) && (p[1] == '('))
+                        p += 3;
+                    else if ((p + 1 < end) && (p[1] == '['))
+                        while ((p < end) && (*p != ']')) p++;
+                    else
+                        p++;
+                    continue;
+                case '(': /* special character: \(em and \(en are dashes, the rest is dropped */
+                    if ((p + 2 < end) && ((strncmp(p + 1, "em", 2) == 0) || (strncmp(p + 1, "en", 2) == 0)))
+                        c = '-';
+                    else
+                        c = '\0';
+                    p += 2;
+                    break;
+                case '*': /* string */
+                    if ((p + 1 < end) && (p[1] == '('))
+                        p += 3;
+                    else
+                        p++;
+                    continue;
+                case '-':
+                    c = '-';
+                    break;
+                case 'e':
+                    c = '\\';
+                    break;
+                case ' ':
+                    c = ' ';
+                    break;
+                case '&':
+                case 'c':
+                case '%':
+                    continue;
+                default:
+                    c = *p;
+                    break;
+            }
+
+            if (c == '\0')
+                continue;
+        }
+
+        if (c == '"')
+            continue;
+
+        if ((c == ' ') || (c == '\t') || (c == '\n'))
+        {
+            if ((len == 0) || (out[len - 1] == ' '))
+                continue;
+            c = ' ';
+        }
+
+        out[len++] = c;
+    }
+
+    out[len] = '\0';
+}
+
+/* the description follows the first "\-", " - " or "\(em" */
+static const char *find_separator(const char *text, size_t *separator_len)
+{
+    const char *separators[] = { "\\-", " - ", "\\(em", "\\(en" };
+    const char *found = NULL;
+
+    for (size_t i = 0; i < sizeof(separators) / sizeof(separators[0]); i++)
+    {
+        const char *s = strstr(text, separators[i]);
+        if (s && ((found == NULL) || (s < found)))
+        {
+            found = s;
+            *separator_len = strlen(separators[i]);
+        }
+    }
+
+    return found;
+}
+
+static int is_section_heading(const char *line)
+{
+    return (strncmp(line, ".SH", 3) == 0) || (strncmp(line, ".Sh", 3) == 0);
+}
+
+/* macros of a man(7) NAME section whose arguments are part of the text */
+static int is_font_macro(const char *line)
+{
+    static const char * const macros[] = { ".B ", ".I ", ".BR ", ".RB ", ".IR ", ".RI ", ".BI ", ".IB " };
+
+    for (size_t i = 0; i < sizeof(macros) / sizeof(macros[0]); i++)
+    {
+        if (strncmp(line, macros[i], strlen(macros[i])) == 0)
+            return strlen(macros[i]);
+    }
+
+    return 0;
+}
+
+/**
+ * Read the description of the page in filename into out.
+ * Returns 0 on success, -1 if there is no description.
+ */
+int whatis_extract(const char *filename, char *out, size_t out_len)
+{
+    gzFile f = gzopen(filename, "rb"); /* also reads uncompressed files */
+    if (f == NULL)
+        return -1;
+
+    char *buffer = malloc(WHATIS_READ_SIZE + 1);
+    if (buffer == NULL)
+    {
+        gzclose(f);
+        return -1;
+    }
+
+    int size = gzread(f, buffer, WHATIS_READ_SIZE);
+    gzclose(f);
+
+    if (size <= 0)
+    {
+        free(buffer);
+        return -1;
+    }
+
+    buffer[size] = '\0';
+
+    char text[1024];
+    text[0] = '\0';
+    int in_name = 0;
+    int ret = -1;
+
+    for (char *line = buffer; line && *line;)
+    {
+        char *next = strchr(line, '\n');
+        if (next)
+            *next++ = '\0';
+
+        if (is_section_heading(line))
+        {
+            if (in_name)
+                break;
+
+            const char *title = line + 3;
+            while ((*title == ' ') || (*title == '"'))
+                title++;
+
+            in_name = (strncasecmp(title, "NAME", 4) == 0);
+        }
+        else if (in_name)
+        {
+            int macro_len;
+
+            if (strncmp(line, ".Nd ", 4) == 0)
+            {
+                out[0] = '\0';
+                append_text(out, out_len, line + 4, line + strlen(line));
+                ret = (out[0] != '\0') ? 0 : -1;
+                break;
+            }
+            else if (((macro_len = is_font_macro(line)) > 0) || ((line[0] != '.') && (line[0] != '\'')))
+            {
+                /* keep the escapes for now, "\-" is the separator */
+                size_t len = strlen(text);
+                snprintf(text + len, sizeof(text) - len, "%s%s", len ? " " : "", line + macro_len);
+            }
+        }
+
+        line = next;
+    }
+
+    if ((ret != 0) && text[0])
+    {
+        size_t separator_len = 0;
+        const char *separator = find_separator(text, &separator_len);
+        if (separator)
+        {
+            const char *desc = separator + separator_len;
+            out[0] = '\0';
+            append_text(out, out_len, desc, desc + strlen(desc));
+            ret = (out[0] != '\0') ? 0 : -1;
+        }
+    }
+
+    /* trailing space */
+    size_t len = (ret == 0) ? strlen(out) : 0;
+    if ((len > 0) && (out[len - 1] == ' '))
+        out[len - 1] = '\0';
+
+    free(buffer);
+    return ret;
+}
@@ -0,0 +1,8 @@
+#ifndef __WHATIS_H__
+#define __WHATIS_H__
+
+#include <stddef.h>
+
+int whatis_extract(const char *filename, char *out, size_t out_len);
+
+#endif // __WHATIS_H__